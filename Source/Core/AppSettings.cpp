@@ -32,6 +32,10 @@ void AppSettings::loadSettings()
     {
         defaultFolder = xml->getStringAttribute("defaultFolder", "");
         showSeparateChannels = xml->getBoolAttribute("showSeparateChannels", false);
+        frequencyColours = xml->getBoolAttribute("frequencyColours", false);
+        peakSidecars = xml->getBoolAttribute("peakSidecars", false);
+        oscEnabled = xml->getBoolAttribute("oscEnabled", false);
+        oscPort = juce::jlimit(1, 65535, xml->getIntAttribute("oscPort", 9000));
         
         // Load window bounds
         int wx = xml->getIntAttribute("windowX", 0);
@@ -62,6 +66,10 @@ void AppSettings::saveSettings()
     
     xml->setAttribute("defaultFolder", defaultFolder);
     xml->setAttribute("showSeparateChannels", showSeparateChannels);
+    xml->setAttribute("frequencyColours", frequencyColours);
+    xml->setAttribute("peakSidecars", peakSidecars);
+    xml->setAttribute("oscEnabled", oscEnabled);
+    xml->setAttribute("oscPort", oscPort);
     
     // Save window bounds
     if (windowBounds.getWidth() > 0 && windowBounds.getHeight() > 0)
@@ -109,6 +117,30 @@ void AppSettings::setShowSeparateChannels(bool separate)
     saveSettings();
 }
 
+void AppSettings::setFrequencyColours(bool useFrequencyColours)
+{
+    frequencyColours = useFrequencyColours;
+    saveSettings();
+}
+
+void AppSettings::setPeakSidecars(bool useSidecars)
+{
+    peakSidecars = useSidecars;
+    saveSettings();
+}
+
+void AppSettings::setOscEnabled(bool enabled)
+{
+    oscEnabled = enabled;
+    saveSettings();
+}
+
+void AppSettings::setOscPort(int port)
+{
+    oscPort = juce::jlimit(1, 65535, port);
+    saveSettings();
+}
+
 void AppSettings::setWindowBounds(juce::Rectangle<int> bounds)
 {
     windowBounds = bounds;
@@ -22,6 +22,20 @@ public:
     bool getShowSeparateChannels() const { return showSeparateChannels; }
     void setShowSeparateChannels(bool separate);
     
+    // Colour waveforms by low/mid/high balance instead of the stem colour
+    bool getFrequencyColours() const { return frequencyColours; }
+    void setFrequencyColours(bool useFrequencyColours);
+    
+    // Save waveform peaks as ".peaks" files next to the stems instead of the app data folder
+    bool getPeakSidecars() const { return peakSidecars; }
+    void setPeakSidecars(bool useSidecars);
+    
+    // Receive OSC from show-control software on a local UDP port
+    bool getOscEnabled() const { return oscEnabled; }
+    void setOscEnabled(bool enabled);
+    int getOscPort() const { return oscPort; }
+    void setOscPort(int port);
+    
     // Window state
     juce::Rectangle<int> getWindowBounds() const { return windowBounds; }
     void setWindowBounds(juce::Rectangle<int> bounds);
@@ -33,6 +47,10 @@ private:
     juce::String defaultFolder;
     std::array<juce::String, NUM_STEM_TYPES> stemRegexPatterns;
     bool showSeparateChannels { false };  // false = mixed, true = separate channels
+    bool frequencyColours { false };
+    bool peakSidecars { false };
+    bool oscEnabled { false };
+    int oscPort { 9000 };
     juce::Rectangle<int> windowBounds { 0, 0, 0, 0 };
     
     JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(AppSettings)
@@ -0,0 +1,194 @@
+#include "LibraryIndex.h"
+#include "ParallelFor.h"
+#include "StemPack.h"
+
+LibraryIndex::LibraryIndex()
+{
+    formatManager.registerBasicFormats();
+}
+
+juce::File LibraryIndex::getIndexFile()
+{
+    auto settingsDir = juce::File::getSpecialLocation(juce::File::userApplicationDataDirectory)
+                           .getChildFile("StemPlayer");
+    
+    if (!settingsDir.exists())
+        settingsDir.createDirectory();
+    
+    return settingsDir.getChildFile("library.xml");
+}
+
+void LibraryIndex::loadIndex()
+{
+    auto file = getIndexFile();
+    
+    if (!file.existsAsFile())
+        return;
+    
+    auto xml = juce::XmlDocument::parse(file);
+    
+    if (xml == nullptr || !xml->hasTagName("LibraryIndex"))
+        return;
+    
+    juce::ScopedLock sl(lock);
+    entries.clear();
+    
+    for (auto* fileElement : xml->getChildWithTagNameIterator("File"))
+    {
+        Entry entry;
+        entry.fileSize = fileElement->getStringAttribute("size").getLargeIntValue();
+        entry.modificationTime = fileElement->getStringAttribute("modified").getLargeIntValue();
+        entry.info.valid = fileElement->getBoolAttribute("valid", false);
+        entry.info.formatName = fileElement->getStringAttribute("format");
+        entry.info.sampleRate = fileElement->getDoubleAttribute("sampleRate", 0.0);
+        entry.info.numChannels = fileElement->getIntAttribute("channels", 0);
+        entry.info.lengthInSamples = fileElement->getStringAttribute("length").getLargeIntValue();
+        entry.info.stemMask = fileElement->getIntAttribute("stems", 0);
+        
+        entries[fileElement->getStringAttribute("path")] = entry;
+    }
+}
+
+void LibraryIndex::saveIndex()
+{
+    auto xml = std::make_unique<juce::XmlElement>("LibraryIndex");
+    
+    {
+        juce::ScopedLock sl(lock);
+        
+        for (const auto& pair : entries)
+        {
+            const auto& entry = pair.second;
+            auto* fileElement = xml->createNewChildElement("File");
+            fileElement->setAttribute("path", pair.first);
+            fileElement->setAttribute("size", juce::String(entry.fileSize));
+            fileElement->setAttribute("modified", juce::String(entry.modificationTime));
+            fileElement->setAttribute("valid", entry.info.valid);
+            
+            if (entry.info.valid)
+            {
+                fileElement->setAttribute("format", entry.info.formatName);
+                fileElement->setAttribute("sampleRate", entry.info.sampleRate);
+                fileElement->setAttribute("channels", entry.info.numChannels);
+                fileElement->setAttribute("length", juce::String(entry.info.lengthInSamples));
+                
+                if (entry.info.stemMask != 0)
+                    fileElement->setAttribute("stems", entry.info.stemMask);
+            }
+        }
+    }
+    
+    xml->writeTo(getIndexFile());
+}
+
+StemFileInfo LibraryIndex::probeFile(const juce::File& file)
+{
+    StemFileInfo info;
+    
+    // createReaderFor only parses the header; no audio is decoded here
+    std::unique_ptr<juce::AudioFormatReader> reader(StemPack::createReaderFor(formatManager, file));
+    
+    if (reader != nullptr)
+    {
+        info.formatName = reader->getFormatName();
+        info.sampleRate = reader->sampleRate;
+        info.lengthInSamples = reader->lengthInSamples;
+        info.numChannels = static_cast<int>(reader->numChannels);
+        
+        if (auto* pack = dynamic_cast<StemPackReader*>(reader.get()))
+            info.stemMask = pack->getStemMask();
+        info.valid = info.sampleRate > 0.0 && info.lengthInSamples > 0;
+    }
+    
+    return info;
+}
+
+bool LibraryIndex::getCachedInfo(const juce::File& file, StemFileInfo& info) const
+{
+    // Stat the file before locking, so probes on other threads aren't held up by the disk
+    const auto fileSize = file.getSize();
+    const auto modificationTime = file.getLastModificationTime().toMilliseconds();
+    
+    juce::ScopedLock sl(lock);
+    
+    auto it = entries.find(file.getFullPathName());
+    if (it == entries.end())
+        return false;
+    
+    if (it->second.fileSize != fileSize || it->second.modificationTime != modificationTime)
+        return false;
+    
+    info = it->second.info;
+    return true;
+}
+
+void LibraryIndex::probeSongs(juce::Array<DetectedSong>& songs)
+{
+    // Flatten to one work item per stem file so large songs don't serialise the scan.
+    // Containers are a single item (stem index -1).
+    std::vector<std::pair<int, int>> work;
+    for (int s = 0; s < songs.size(); ++s)
+    {
+        const auto& song = songs.getReference(s);
+        
+        if (song.isContainer())
+        {
+            work.emplace_back(s, -1);
+            continue;
+        }
+        
+        for (int i = 0; i < NUM_STEM_TYPES; ++i)
+        {
+            if (song.stemFound[i])
+                work.emplace_back(s, i);
+        }
+    }
+    
+    std::atomic<bool> anyProbed { false };
+    
+    parallelFor(static_cast<int>(work.size()), [&](int item) {
+        auto& song = songs.getReference(work[(size_t) item].first);
+        const int stemIndex = work[(size_t) item].second;
+        const auto file = stemIndex < 0 ? song.containerFile : song.stemFiles[stemIndex];
+        
+        StemFileInfo info;
+        if (!getCachedInfo(file, info))
+        {
+            Entry entry;
+            entry.fileSize = file.getSize();
+            entry.modificationTime = file.getLastModificationTime().toMilliseconds();
+            entry.info = info = probeFile(file);
+            
+            juce::ScopedLock sl(lock);
+            entries[file.getFullPathName()] = entry;
+            anyProbed = true;
+        }
+        
+        if (stemIndex >= 0)
+        {
+            song.stemInfo[stemIndex] = info;
+            return;
+        }
+        
+        // Every stem of a container shares the container's header
+        if (!info.valid)
+            return;
+        
+        auto layout = StemDetector::getContainerChannelLayout(info.numChannels, info.stemMask);
+        for (int i = 0; i < NUM_STEM_TYPES; ++i)
+        {
+            if (layout[(size_t) i] >= 0)
+            {
+                song.stemFound[i] = true;
+                song.stemFiles[i] = file;
+                song.stemInfo[i] = info;
+            }
+        }
+    });
+    
+    for (auto& song : songs)
+        song.probed = true;
+    
+    if (anyProbed)
+        saveIndex();
+}
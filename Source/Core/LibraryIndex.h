@@ -0,0 +1,41 @@
+#pragma once
+
+#include <JuceHeader.h>
+#include "StemDetector.h"
+#include <unordered_map>
+
+// Persistent cache of probed stem headers, keyed by file path and validated
+// against file size and modification time
+class LibraryIndex
+{
+public:
+    LibraryIndex();
+    ~LibraryIndex() = default;
+
+    void loadIndex();
+    void saveIndex();
+    
+    // Fills stemInfo for every found stem, probing uncached files in parallel.
+    // Saves the index if anything new was probed.
+    void probeSongs(juce::Array<DetectedSong>& songs);
+    
+    bool getCachedInfo(const juce::File& file, StemFileInfo& info) const;
+    
+    static juce::File getIndexFile();
+
+private:
+    struct Entry
+    {
+        int64_t fileSize { 0 };
+        int64_t modificationTime { 0 };
+        StemFileInfo info;
+    };
+    
+    StemFileInfo probeFile(const juce::File& file);
+    
+    juce::AudioFormatManager formatManager;
+    std::unordered_map<juce::String, Entry> entries;  // Keyed by full path
+    juce::CriticalSection lock;
+    
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(LibraryIndex)
+};
@@ -1,6 +1,40 @@
 #include "MidiLearnManager.h"
 #include "StemEngine.h"
 
+namespace
+{
+    bool isParameterSource(MidiSource source)
+    {
+        return source == MidiSource::Nrpn || source == MidiSource::Rpn;
+    }
+    
+    // Numbers the dispatch table has room for: 14-bit CCs also use number + 32
+    bool isValidNumber(MidiSource source, int number)
+    {
+        const int maxNumber = isParameterSource(source) ? 16383 : source == MidiSource::Controller14Bit ? 31 : 127;
+        return number >= 0 && number <= maxNumber;
+    }
+    
+    bool usesController(const MidiMapping& mapping, int cc)
+    {
+        return mapping.ccNumber == cc || (mapping.source == MidiSource::Controller14Bit && mapping.ccNumber + 32 == cc);
+    }
+    
+    // Two mappings that would read the same messages
+    bool sharesSource(const MidiMapping& a, const MidiMapping& b)
+    {
+        if (!a.isMapped() || !b.isMapped())
+            return false;
+        
+        // Parameters and notes only clash with the very same parameter or note
+        if (isParameterSource(a.source) || isParameterSource(b.source) || a.source == MidiSource::Note || b.source == MidiSource::Note)
+            return a.source == b.source && a.ccNumber == b.ccNumber;
+        
+        return usesController(a, b.ccNumber) || usesController(b, a.ccNumber)
+            || (b.source == MidiSource::Controller14Bit && usesController(a, b.ccNumber + 32));
+    }
+}
+
 MidiLearnManager::MidiLearnManager()
 {
     // Initialize all mappings
@@ -10,6 +44,10 @@ MidiLearnManager::MidiLearnManager()
         mappings[i].ccNumber = -1;
         mappings[i].channel = -1;
     }
+    
+    lastSentValues.fill(-1);
+    lastSentTimes.fill(0);
+    publishDispatchTable();
 }
 
 juce::String MidiLearnManager::getControlName(MidiControlType type)
@@ -26,156 +64,727 @@ juce::String MidiLearnManager::getControlName(MidiControlType type)
         case MidiControlType::Stop:        return "Stop";
         case MidiControlType::Rewind:      return "Rewind";
         case MidiControlType::FastForward: return "Fast Forward";
-        default: return "Unknown";
+        case MidiControlType::Seek:        return "Seek";
+        default: break;
     }
+    
+    const int control = static_cast<int>(type);
+    
+    if (type >= MidiControlType::Stem1Mute && type <= MidiControlType::Stem6Mute)
+        return StemDetector::getStemTypeName(control - static_cast<int>(MidiControlType::Stem1Mute)) + " Mute";
+    
+    if (type >= MidiControlType::Stem1Solo && type <= MidiControlType::Stem6Solo)
+        return StemDetector::getStemTypeName(control - static_cast<int>(MidiControlType::Stem1Solo)) + " Solo";
+    
+    if (type >= MidiControlType::Cue1 && type <= MidiControlType::Cue8)
+        return "Cue " + juce::String(control - static_cast<int>(MidiControlType::Cue1) + 1);
+    
+    return "Unknown";
 }
 
 void MidiLearnManager::startLearning(MidiControlType controlType)
 {
-    juce::ScopedLock sl(lock);
-    learning = true;
     learningControlType = controlType;
+    learning = true;
 }
 
 void MidiLearnManager::stopLearning()
 {
-    juce::ScopedLock sl(lock);
     learning = false;
 }
 
-void MidiLearnManager::processMidiMessages(const juce::MidiBuffer& midiMessages, StemEngine& engine)
+void MidiLearnManager::beginBlock()
 {
-    juce::ScopedLock sl(lock);
+    // Parameters selected before the mappings changed may feed a different control now,
+    // and feedback goes out afresh to whatever the controls are mapped to
+    if (dispatchTable.update())
+    {
+        for (int channel = 0; channel < 16; ++channel)
+            resolveParameter(channel);
+        
+        lastSentValues.fill(-1);
+    }
+    
+    if (!learning.load())
+    {
+        pendingLearn = {};
+    }
+    else if (pendingLearn.cc >= 0 && ++pendingLearn.blocksWaited >= 2)
+    {
+        // No LSB followed, so it's a plain 7-bit controller
+        finishLearning(MidiSource::Controller, pendingLearn.cc, pendingLearn.channel);
+    }
+}
+
+bool MidiLearnManager::isMapped(const juce::MidiMessage& message) const
+{
+    if (message.isProgramChange())
+        return programChangeSelectsSong.load();
+    
+    if (message.isNoteOn())
+        return learning.load() || dispatchTable.getReadBuffer().notes[(size_t) (message.getChannel() - 1)][(size_t) message.getNoteNumber()] >= 0;
+    
+    if (!message.isController())
+        return false;
+    
+    if (learning.load())
+        return true;
+    
+    const auto& table = dispatchTable.getReadBuffer();
+    const int cc = message.getControllerNumber();
+    
+    if (table.numParameters > 0 && (cc == 6 || cc == 38 || (cc >= 96 && cc <= 101)))
+        return true;
+    
+    return table.controllers[(size_t) (message.getChannel() - 1)][(size_t) cc].control >= 0;
+}
+
+void MidiLearnManager::handleMessage(const juce::MidiMessage& message, StemEngine& engine)
+{
+    using Command = StemEngine::Command;
+    
+    if (message.isProgramChange())
+    {
+        if (programChangeSelectsSong.load())
+            engine.applyCommand({ Command::Type::SelectSong, -1, static_cast<double>(message.getProgramChangeNumber()) });
+        return;
+    }
+    
+    if (message.isNoteOn())
+    {
+        const int channel = message.getChannel() - 1;
+        const int note = message.getNoteNumber();
+        
+        if (learning.load())
+        {
+            // A CC held back for its LSB came first; that one wins
+            if (pendingLearn.cc >= 0)
+                finishLearning(MidiSource::Controller, pendingLearn.cc, pendingLearn.channel);
+            else
+                finishLearning(MidiSource::Note, note, channel);
+            return;
+        }
+        
+        const int control = dispatchTable.getReadBuffer().notes[(size_t) channel][(size_t) note];
+        if (control >= 0)
+            applyAbsolute(control, 1.0f, engine);
+        return;
+    }
+    
+    if (!message.isController())
+        return;
+    
+    const int channel = message.getChannel() - 1;
+    const int cc = message.getControllerNumber();
+    const int value = message.getControllerValue();
+    
+    if (learning.load())
+    {
+        learnFrom(channel, cc, value);
+        return;
+    }
+    
+    if (handleParameterMessage(channel, cc, value, engine))
+        return;
+    
+    const auto& table = dispatchTable.getReadBuffer();
+    const auto slot = table.controllers[(size_t) channel][(size_t) cc];
+    if (slot.control < 0)
+        return;
+    
+    auto& state = channelStates[(size_t) channel];
+    
+    switch (slot.role)
+    {
+        case ControllerSlot::Msb:
+            // Held until the LSB arrives, so the value never jumps back by the old fine part
+            state.msb[(size_t) cc] = static_cast<uint8_t>(value);
+            break;
+        
+        case ControllerSlot::Lsb:
+            applyAbsolute(slot.control, static_cast<float>(state.msb[(size_t) (cc - 32)] * 128 + value) / 16383.0f, engine);
+            break;
+        
+        case ControllerSlot::Value:
+            if (table.modes[(size_t) slot.control] == MidiValueMode::Absolute)
+                applyAbsolute(slot.control, static_cast<float>(value) / 127.0f, engine);
+            else if (const int steps = decodeRelative(table.modes[(size_t) slot.control], value))
+                applyRelative(static_cast<MidiControlType>(slot.control), steps, engine);
+            break;
+    }
+}
+
+bool MidiLearnManager::handleParameterMessage(int channel, int cc, int value, StemEngine& engine)
+{
+    auto& state = channelStates[(size_t) channel];
     
-    for (const auto metadata : midiMessages)
+    switch (cc)
     {
-        auto message = metadata.getMessage();
+        case 98:
+        case 99:
+        case 100:
+        case 101:
+            state.selectParameter(cc, value);
+            resolveParameter(channel);
+            return dispatchTable.getReadBuffer().numParameters > 0;
+        
+        case 6:
+        case 38:
+        case 96:
+        case 97:
+            break;
         
-        if (message.isController())
+        default:
+            return false;
+    }
+    
+    // Data entry for a parameter nobody mapped is left to plain CC mappings
+    const int control = state.parameterControl;
+    if (control < 0)
+        return false;
+    
+    if (cc == 6)
+    {
+        state.dataMsb = static_cast<uint8_t>(value);
+        applyAbsolute(control, static_cast<float>(value * 128) / 16383.0f, engine);
+    }
+    else if (cc == 38)
+    {
+        applyAbsolute(control, static_cast<float>(state.dataMsb * 128 + value) / 16383.0f, engine);
+    }
+    else
+    {
+        applyRelative(static_cast<MidiControlType>(control), cc == 96 ? 1 : -1, engine);
+    }
+    
+    return true;
+}
+
+void MidiLearnManager::resolveParameter(int channel)
+{
+    auto& state = channelStates[(size_t) channel];
+    const auto& table = dispatchTable.getReadBuffer();
+    const int parameter = state.getParameter();
+    
+    state.parameterControl = -1;
+    
+    for (int i = 0; i < table.numParameters && parameter >= 0; ++i)
+    {
+        const auto& slot = table.parameters[(size_t) i];
+        if (slot.number == parameter && slot.isRpn == state.parameterIsRpn && (slot.channel < 0 || slot.channel == channel))
         {
-            int cc = message.getControllerNumber();
-            int channel = message.getChannel();
-            float value = message.getControllerValue() / 127.0f;
+            state.parameterControl = slot.control;
+            break;
+        }
+    }
+}
+
+void MidiLearnManager::learnFrom(int channel, int cc, int value)
+{
+    auto& state = channelStates[(size_t) channel];
+    
+    // Parameter selection only sets up what the data entry that follows belongs to
+    if (cc >= 98 && cc <= 101)
+    {
+        state.selectParameter(cc, value);
+        return;
+    }
+    
+    if ((cc == 6 || cc == 38) && state.getParameter() >= 0)
+    {
+        finishLearning(state.parameterIsRpn ? MidiSource::Rpn : MidiSource::Nrpn, state.getParameter(), channel);
+        return;
+    }
+    
+    if (pendingLearn.cc >= 0)
+    {
+        if (channel == pendingLearn.channel && cc == pendingLearn.cc + 32)
+            finishLearning(MidiSource::Controller14Bit, pendingLearn.cc, channel);
+        else
+            finishLearning(MidiSource::Controller, pendingLearn.cc, pendingLearn.channel);
+        return;
+    }
+    
+    // CCs 0-31 may be the MSB of a 14-bit pair; wait to see if the LSB follows
+    if (cc < 32)
+        pendingLearn = { channel, cc, 0 };
+    else
+        finishLearning(MidiSource::Controller, cc, channel);
+}
+
+void MidiLearnManager::finishLearning(MidiSource source, int number, int channel)
+{
+    pendingLearn = {};
+    
+    // Stopped from the UI in the meantime
+    if (!learning.exchange(false))
+        return;
+    
+    // The mapping itself is changed on the message thread
+    MidiControlType capturedType = learningControlType;
+    juce::MessageManager::callAsync([this, capturedType, source, number, channel]() {
+        setMapping(capturedType, number, channel + 1, source);
+        
+        if (onMappingChanged)
+            onMappingChanged(capturedType, number);
+    });
+}
+
+int MidiLearnManager::decodeRelative(MidiValueMode mode, int value)
+{
+    switch (mode)
+    {
+        case MidiValueMode::RelativeTwosComplement: return value < 64 ? value : value - 128;
+        case MidiValueMode::RelativeSignBit:        return value < 64 ? value : 64 - value;
+        case MidiValueMode::RelativeBinaryOffset:   return value - 64;
+        default: return 0;
+    }
+}
+
+float MidiLearnManager::applyCurve(MidiCurve curve, float normalized)
+{
+    switch (curve)
+    {
+        case MidiCurve::Decibel:
+            return normalized > 0.0f ? juce::Decibels::decibelsToGain(-60.0f * (1.0f - normalized)) : 0.0f;
+        case MidiCurve::Squared:
+            return normalized * normalized;
+        default:
+            return normalized;
+    }
+}
+
+float MidiLearnManager::invertCurve(MidiCurve curve, float value)
+{
+    switch (curve)
+    {
+        case MidiCurve::Decibel:
+            return value > 0.0f ? juce::jlimit(0.0f, 1.0f, 1.0f + juce::Decibels::gainToDecibels(value) / 60.0f) : 0.0f;
+        case MidiCurve::Squared:
+            return std::sqrt(juce::jmax(0.0f, value));
+        default:
+            return value;
+    }
+}
+
+float MidiLearnManager::lookUpCurve(int control, float normalized) const
+{
+    const auto& curve = dispatchTable.getReadBuffer().curves[(size_t) control];
+    const float position = juce::jlimit(0.0f, 1.0f, normalized) * curveTableSize;
+    const int index = juce::jmin(static_cast<int>(position), curveTableSize - 1);
+    
+    return curve[(size_t) index] + (position - static_cast<float>(index)) * (curve[(size_t) index + 1] - curve[(size_t) index]);
+}
+
+void MidiLearnManager::applyAbsolute(int control, float normalized, StemEngine& engine)
+{
+    using Command = StemEngine::Command;
+    const auto controlType = static_cast<MidiControlType>(control);
+    
+    // A fader already shows the value it sent, so that value isn't echoed back to it
+    auto markAsSent = [this, control, normalized]
+    {
+        const auto& target = dispatchTable.getReadBuffer().feedback[(size_t) control];
+        lastSentValues[(size_t) control] = juce::roundToInt(normalized * static_cast<float>(target.getMaxValue()));
+    };
+    
+    // Called from within the engine's render, so commands take effect on this exact sample
+    switch (controlType)
+    {
+        case MidiControlType::Stem1Volume:
+        case MidiControlType::Stem2Volume:
+        case MidiControlType::Stem3Volume:
+        case MidiControlType::Stem4Volume:
+        case MidiControlType::Stem5Volume:
+        case MidiControlType::Stem6Volume:
+            engine.applyCommand({ Command::Type::SetTrackVolume, control, lookUpCurve(control, normalized) });
+            markAsSent();
+            break;
+        case MidiControlType::Seek:
+            engine.applyCommand({ Command::Type::SetPositionNormalized, -1, lookUpCurve(control, normalized) });
+            markAsSent();
+            break;
+        default:
+            // Everything else is a button, pressed by the upper half of the range
+            if (normalized > 0.5f)
+                pressButton(controlType, engine);
+            break;
+    }
+}
+
+void MidiLearnManager::applyRelative(MidiControlType controlType, int steps, StemEngine& engine)
+{
+    using Command = StemEngine::Command;
+    const int control = static_cast<int>(controlType);
+    
+    switch (controlType)
+    {
+        case MidiControlType::Stem1Volume:
+        case MidiControlType::Stem2Volume:
+        case MidiControlType::Stem3Volume:
+        case MidiControlType::Stem4Volume:
+        case MidiControlType::Stem5Volume:
+        case MidiControlType::Stem6Volume:
+            engine.applyCommand({ Command::Type::SetTrackVolume, control,
+                                  juce::jlimit(0.0f, 1.0f, engine.getTrackVolume(control) + static_cast<float>(steps) * relativeVolumeStep) });
+            break;
+        case MidiControlType::Seek:
+            engine.applyCommand({ Command::Type::SetPosition, -1,
+                                  juce::jlimit(0.0, engine.getTotalLengthInSeconds(),
+                                               engine.getPositionInSeconds() + steps * relativeSeekSeconds) });
+            break;
+        default:
+            // An encoder turned up acts as a button press
+            if (steps > 0)
+                pressButton(controlType, engine);
+            break;
+    }
+}
+
+void MidiLearnManager::pressButton(MidiControlType controlType, StemEngine& engine)
+{
+    using Command = StemEngine::Command;
+    const int control = static_cast<int>(controlType);
+    
+    if (controlType >= MidiControlType::Stem1Mute && controlType <= MidiControlType::Stem6Mute)
+        engine.applyCommand({ Command::Type::ToggleMute, control - static_cast<int>(MidiControlType::Stem1Mute) });
+    else if (controlType >= MidiControlType::Stem1Solo && controlType <= MidiControlType::Stem6Solo)
+        engine.applyCommand({ Command::Type::ToggleSolo, control - static_cast<int>(MidiControlType::Stem1Solo) });
+    else if (controlType >= MidiControlType::Cue1 && controlType <= MidiControlType::Cue8)
+        engine.applyCommand({ Command::Type::TriggerCue, -1, static_cast<double>(control - static_cast<int>(MidiControlType::Cue1)) });
+    else if (controlType == MidiControlType::PlayPause)
+        engine.applyCommand({ Command::Type::TogglePlayPause });
+    else if (controlType == MidiControlType::Stop)
+        engine.applyCommand({ Command::Type::Stop });
+    else if (controlType == MidiControlType::Rewind)
+        engine.applyCommand({ Command::Type::Rewind });
+    else if (controlType == MidiControlType::FastForward)
+        engine.applyCommand({ Command::Type::FastForward });
+}
+
+void MidiLearnManager::writeFeedback(StemEngine& engine, int numSamples, double sampleRate, juce::MidiBuffer& output)
+{
+    const auto& table = dispatchTable.getReadBuffer();
+    
+    feedbackClock += numSamples;
+    feedbackBudget = juce::jmin(feedbackBurstBytes, feedbackBudget + numSamples * feedbackBytesPerSecond / sampleRate);
+    const auto minInterval = static_cast<int64_t>(feedbackIntervalSeconds * sampleRate);
+    
+    // Starts where the budget ran out last time, so every control gets its turn
+    for (size_t i = 0; i < numControls; ++i)
+    {
+        const size_t control = (nextFeedbackControl + i) % numControls;
+        const auto& target = table.feedback[control];
+        if (target.number < 0)
+            continue;
+        
+        const float value = getFeedbackValue(static_cast<MidiControlType>(control), engine);
+        if (value < 0.0f)
+            continue;
+        
+        // A 14-bit round trip through the curve may be off by a step; not worth moving a fader for
+        const int maxValue = target.getMaxValue();
+        const int quantised = juce::roundToInt(invertCurve(target.curve, value) * static_cast<float>(maxValue));
+        const int lastSent = lastSentValues[control];
+        
+        if (lastSent >= 0 && std::abs(quantised - lastSent) <= (maxValue > 127 ? 2 : 0))
+            continue;
+        
+        if (lastSent >= 0 && feedbackClock - lastSentTimes[control] < minInterval)
+            continue;
+        
+        const int bytes = getFeedbackBytes(target.source);
+        if (bytes > feedbackBudget)
+        {
+            nextFeedbackControl = control;
+            return;
+        }
+        
+        writeFeedbackMessages(target, quantised, output);
+        feedbackBudget -= bytes;
+        lastSentValues[control] = quantised;
+        lastSentTimes[control] = feedbackClock;
+    }
+}
+
+float MidiLearnManager::getFeedbackValue(MidiControlType controlType, StemEngine& engine)
+{
+    const int control = static_cast<int>(controlType);
+    
+    if (controlType >= MidiControlType::Stem1Volume && controlType <= MidiControlType::Stem6Volume)
+        return engine.getTrackVolume(control);
+    
+    if (controlType >= MidiControlType::Stem1Mute && controlType <= MidiControlType::Stem6Mute)
+    {
+        const auto* track = engine.getTrack(control - static_cast<int>(MidiControlType::Stem1Mute));
+        return track != nullptr && track->isMuted() ? 1.0f : 0.0f;
+    }
+    
+    if (controlType >= MidiControlType::Stem1Solo && controlType <= MidiControlType::Stem6Solo)
+    {
+        const auto* track = engine.getTrack(control - static_cast<int>(MidiControlType::Stem1Solo));
+        return track != nullptr && track->isSolo() ? 1.0f : 0.0f;
+    }
+    
+    if (controlType >= MidiControlType::Cue1 && controlType <= MidiControlType::Cue8)
+        return engine.getCuePoint(control - static_cast<int>(MidiControlType::Cue1)) >= 0 ? 1.0f : 0.0f;
+    
+    switch (controlType)
+    {
+        case MidiControlType::Seek:      return static_cast<float>(engine.getPositionNormalized());
+        case MidiControlType::PlayPause: return engine.isPlaying() ? 1.0f : 0.0f;
+        case MidiControlType::Stop:      return engine.isPlaying() ? 0.0f : 1.0f;
+        default:                         return -1.0f;  // Rewind and fast forward have no state
+    }
+}
+
+int MidiLearnManager::getFeedbackBytes(MidiSource source)
+{
+    switch (source)
+    {
+        case MidiSource::Controller14Bit: return 6;
+        case MidiSource::Nrpn:
+        case MidiSource::Rpn:             return 12;
+        default:                          return 3;
+    }
+}
+
+void MidiLearnManager::writeFeedbackMessages(const FeedbackTarget& target, int value, juce::MidiBuffer& output)
+{
+    const int channel = target.channel;
+    
+    switch (target.source)
+    {
+        case MidiSource::Controller:
+            output.addEvent(juce::MidiMessage::controllerEvent(channel, target.number, value), 0);
+            break;
+        
+        case MidiSource::Controller14Bit:
+            output.addEvent(juce::MidiMessage::controllerEvent(channel, target.number, value >> 7), 0);
+            output.addEvent(juce::MidiMessage::controllerEvent(channel, target.number + 32, value & 127), 0);
+            break;
+        
+        case MidiSource::Nrpn:
+        case MidiSource::Rpn:
+        {
+            const bool isRpn = target.source == MidiSource::Rpn;
+            output.addEvent(juce::MidiMessage::controllerEvent(channel, isRpn ? 101 : 99, target.number >> 7), 0);
+            output.addEvent(juce::MidiMessage::controllerEvent(channel, isRpn ? 100 : 98, target.number & 127), 0);
+            output.addEvent(juce::MidiMessage::controllerEvent(channel, 6, value >> 7), 0);
+            output.addEvent(juce::MidiMessage::controllerEvent(channel, 38, value & 127), 0);
+            break;
+        }
+        
+        case MidiSource::Note:
+            if (value > 0)
+                output.addEvent(juce::MidiMessage::noteOn(channel, target.number, static_cast<juce::uint8>(value)), 0);
+            else
+                output.addEvent(juce::MidiMessage::noteOff(channel, target.number), 0);
+            break;
+    }
+}
+
+void MidiLearnManager::publishDispatchTable()
+{
+    auto& table = dispatchTable.getWriteBuffer();
+    
+    for (auto& channel : table.controllers)
+        channel.fill({});
+    
+    for (auto& channel : table.notes)
+        channel.fill(-1);
+    
+    table.numParameters = 0;
+    
+    for (size_t i = 0; i < numControls; ++i)
+    {
+        const auto& mapping = mappings[i];
+        const auto control = static_cast<int8_t>(i);
+        
+        table.modes[i] = mapping.mode;
+        
+        // Omni mappings answer on channel 1
+        const bool hasFeedback = mapping.isMapped() && (mapping.mode == MidiValueMode::Absolute || mapping.source == MidiSource::Note);
+        table.feedback[i] = { mapping.source, hasFeedback ? mapping.ccNumber : -1, mapping.channel >= 1 ? mapping.channel : 1, mapping.curve };
+        
+        for (int step = 0; step <= curveTableSize; ++step)
+            table.curves[i][(size_t) step] = applyCurve(mapping.curve, static_cast<float>(step) / curveTableSize);
+        
+        if (!mapping.isMapped())
+            continue;
+        
+        if (isParameterSource(mapping.source))
+        {
+            table.parameters[(size_t) table.numParameters++] = { mapping.ccNumber, mapping.channel >= 1 ? mapping.channel - 1 : -1,
+                                                                 mapping.source == MidiSource::Rpn, control };
+            continue;
+        }
+        
+        // An omni mapping fills the CC's slot on every channel
+        const int firstChannel = mapping.channel >= 1 ? mapping.channel : 1;
+        const int lastChannel = mapping.channel >= 1 ? juce::jmin(mapping.channel, 16) : 16;
+        
+        for (int channel = firstChannel; channel <= lastChannel; ++channel)
+        {
+            auto& slots = table.controllers[(size_t) (channel - 1)];
             
-            // If we're learning, capture this CC
-            if (learning)
+            if (mapping.source == MidiSource::Note)
             {
-                setMapping(learningControlType, cc, channel);
-                learning = false;
-                
-                if (onMappingChanged)
-                {
-                    MidiControlType capturedType = learningControlType;
-                    int capturedCC = cc;
-                    juce::MessageManager::callAsync([this, capturedType, capturedCC]() {
-                        if (onMappingChanged)
-                            onMappingChanged(capturedType, capturedCC);
-                    });
-                }
-                continue;
+                table.notes[(size_t) (channel - 1)][(size_t) mapping.ccNumber] = control;
             }
-            
-            // Apply mapped CC values
-            for (const auto& mapping : mappings)
+            else if (mapping.source == MidiSource::Controller14Bit)
+            {
+                slots[(size_t) mapping.ccNumber] = { control, ControllerSlot::Msb };
+                slots[(size_t) mapping.ccNumber + 32] = { control, ControllerSlot::Lsb };
+            }
+            else
             {
-                if (mapping.ccNumber == cc && 
-                    (mapping.channel == -1 || mapping.channel == channel))
-                {
-                    switch (mapping.controlType)
-                    {
-                        case MidiControlType::Stem1Volume:
-                            engine.setTrackVolume(0, value);
-                            break;
-                        case MidiControlType::Stem2Volume:
-                            engine.setTrackVolume(1, value);
-                            break;
-                        case MidiControlType::Stem3Volume:
-                            engine.setTrackVolume(2, value);
-                            break;
-                        case MidiControlType::Stem4Volume:
-                            engine.setTrackVolume(3, value);
-                            break;
-                        case MidiControlType::Stem5Volume:
-                            engine.setTrackVolume(4, value);
-                            break;
-                        case MidiControlType::Stem6Volume:
-                            engine.setTrackVolume(5, value);
-                            break;
-                        case MidiControlType::PlayPause:
-                            if (value > 0.5f)
-                                engine.togglePlayPause();
-                            break;
-                        case MidiControlType::Stop:
-                            if (value > 0.5f)
-                                engine.stop();
-                            break;
-                        case MidiControlType::Rewind:
-                            if (value > 0.5f)
-                                engine.rewind();
-                            break;
-                        case MidiControlType::FastForward:
-                            if (value > 0.5f)
-                                engine.fastForward();
-                            break;
-                        default:
-                            break;
-                    }
-                }
+                slots[(size_t) mapping.ccNumber] = { control, ControllerSlot::Value };
             }
         }
     }
+    
+    dispatchTable.publish();
 }
 
-void MidiLearnManager::setMapping(MidiControlType controlType, int ccNumber, int channel)
+void MidiLearnManager::setMapping(MidiControlType controlType, int ccNumber, int channel, MidiSource source)
 {
+    juce::ScopedLock sl(lock);
+    
     int index = static_cast<int>(controlType);
-    if (index >= 0 && index < static_cast<int>(MidiControlType::NumControls))
+    if (index >= 0 && index < static_cast<int>(MidiControlType::NumControls) && isValidNumber(source, ccNumber))
     {
-        // Remove any other mapping using this CC (one CC per control)
+        auto& target = mappings[index];
+        target.source = source;
+        target.ccNumber = ccNumber;
+        target.channel = channel;
+        
+        // Remove any other mapping reading the same messages (one source per control)
         for (auto& mapping : mappings)
         {
-            if (mapping.ccNumber == ccNumber && mapping.controlType != controlType)
+            if (mapping.controlType != controlType && sharesSource(mapping, target))
             {
                 mapping.ccNumber = -1;
                 mapping.channel = -1;
             }
         }
         
-        mappings[index].ccNumber = ccNumber;
-        mappings[index].channel = channel;
+        publishDispatchTable();
+    }
+}
+
+void MidiLearnManager::setValueMode(MidiControlType controlType, MidiValueMode mode)
+{
+    juce::ScopedLock sl(lock);
+    
+    int index = static_cast<int>(controlType);
+    if (index >= 0 && index < static_cast<int>(MidiControlType::NumControls))
+    {
+        mappings[index].mode = mode;
+        publishDispatchTable();
+    }
+}
+
+void MidiLearnManager::setCurve(MidiControlType controlType, MidiCurve curve)
+{
+    juce::ScopedLock sl(lock);
+    
+    int index = static_cast<int>(controlType);
+    if (index >= 0 && index < static_cast<int>(MidiControlType::NumControls))
+    {
+        mappings[index].curve = curve;
+        publishDispatchTable();
     }
 }
 
 void MidiLearnManager::removeMapping(MidiControlType controlType)
 {
+    juce::ScopedLock sl(lock);
+    
     int index = static_cast<int>(controlType);
     if (index >= 0 && index < static_cast<int>(MidiControlType::NumControls))
     {
         mappings[index].ccNumber = -1;
         mappings[index].channel = -1;
+        publishDispatchTable();
     }
 }
 
-int MidiLearnManager::getMappedCC(MidiControlType controlType) const
+MidiMapping MidiLearnManager::getMapping(MidiControlType controlType) const
 {
+    juce::ScopedLock sl(lock);
+    
     int index = static_cast<int>(controlType);
     if (index >= 0 && index < static_cast<int>(MidiControlType::NumControls))
-        return mappings[index].ccNumber;
-    return -1;
+        return mappings[index];
+    return {};
+}
+
+juce::String MidiLearnManager::describeSource(const MidiMapping& mapping)
+{
+    if (!mapping.isMapped())
+        return {};
+    
+    switch (mapping.source)
+    {
+        case MidiSource::Controller14Bit: return juce::String(mapping.ccNumber) + "/" + juce::String(mapping.ccNumber + 32);
+        case MidiSource::Nrpn:            return "N" + juce::String(mapping.ccNumber);
+        case MidiSource::Rpn:             return "R" + juce::String(mapping.ccNumber);
+        case MidiSource::Note:            return "#" + juce::String(mapping.ccNumber);
+        default:                          return juce::String(mapping.ccNumber);
+    }
+}
+
+bool MidiLearnManager::parseSource(const juce::String& text, MidiSource& source, int& number)
+{
+    const auto trimmed = text.trim().toUpperCase();
+    if (trimmed.isEmpty())
+        return false;
+    
+    if (trimmed.startsWithChar('N') || trimmed.startsWithChar('R'))
+    {
+        source = trimmed.startsWithChar('N') ? MidiSource::Nrpn : MidiSource::Rpn;
+        number = trimmed.substring(1).getIntValue();
+        return trimmed.substring(1).containsOnly("0123456789") && number <= 16383;
+    }
+    
+    if (trimmed.startsWithChar('#'))
+    {
+        source = MidiSource::Note;
+        number = trimmed.substring(1).getIntValue();
+        return trimmed.substring(1).containsOnly("0123456789") && number <= 127;
+    }
+    
+    if (trimmed.containsChar('/'))
+    {
+        source = MidiSource::Controller14Bit;
+        number = trimmed.upToFirstOccurrenceOf("/", false, false).getIntValue();
+        return number <= 31;
+    }
+    
+    source = MidiSource::Controller;
+    number = trimmed.getIntValue();
+    return trimmed.containsOnly("0123456789") && number <= 127;
 }
 
 juce::ValueTree MidiLearnManager::getStateAsValueTree() const
 {
+    juce::ScopedLock sl(lock);
     juce::ValueTree state("MidiMappings");
+    state.setProperty("programChangeSelectsSong", programChangeSelectsSong.load(), nullptr);
     
     for (const auto& mapping : mappings)
     {
-        if (mapping.ccNumber >= 0)
+        // Keep a chosen mode or curve even while the control has no source
+        if (mapping.isMapped() || mapping.mode != MidiValueMode::Absolute || mapping.curve != MidiCurve::Linear)
         {
             juce::ValueTree mappingTree("Mapping");
             mappingTree.setProperty("controlType", static_cast<int>(mapping.controlType), nullptr);
             mappingTree.setProperty("ccNumber", mapping.ccNumber, nullptr);
             mappingTree.setProperty("channel", mapping.channel, nullptr);
+            mappingTree.setProperty("source", static_cast<int>(mapping.source), nullptr);
+            mappingTree.setProperty("mode", static_cast<int>(mapping.mode), nullptr);
+            mappingTree.setProperty("curve", static_cast<int>(mapping.curve), nullptr);
             state.addChild(mappingTree, -1, nullptr);
         }
     }
@@ -189,10 +798,9 @@ void MidiLearnManager::loadStateFromValueTree(const juce::ValueTree& state)
     
     // Reset all mappings
     for (auto& mapping : mappings)
-    {
-        mapping.ccNumber = -1;
-        mapping.channel = -1;
-    }
+        mapping = { mapping.controlType };
+    
+    programChangeSelectsSong = static_cast<bool>(state.getProperty("programChangeSelectsSong", false));
     
     for (int i = 0; i < state.getNumChildren(); ++i)
     {
@@ -201,14 +809,23 @@ void MidiLearnManager::loadStateFromValueTree(const juce::ValueTree& state)
         if (mappingTree.hasType("Mapping"))
         {
             int controlTypeInt = mappingTree.getProperty("controlType", -1);
-            int ccNumber = mappingTree.getProperty("ccNumber", -1);
-            int channel = mappingTree.getProperty("channel", -1);
             
-            if (controlTypeInt >= 0 && controlTypeInt < static_cast<int>(MidiControlType::NumControls) && ccNumber >= 0)
+            if (controlTypeInt >= 0 && controlTypeInt < static_cast<int>(MidiControlType::NumControls))
             {
-                mappings[controlTypeInt].ccNumber = ccNumber;
-                mappings[controlTypeInt].channel = channel;
+                // Mappings saved before 14-bit support are plain CCs, absolute and linear
+                auto& mapping = mappings[controlTypeInt];
+                mapping.ccNumber = mappingTree.getProperty("ccNumber", -1);
+                mapping.channel = mappingTree.getProperty("channel", -1);
+                mapping.source = static_cast<MidiSource>(juce::jlimit(0, 4, static_cast<int>(mappingTree.getProperty("source", 0))));
+                mapping.mode = static_cast<MidiValueMode>(juce::jlimit(0, 3, static_cast<int>(mappingTree.getProperty("mode", 0))));
+                mapping.curve = static_cast<MidiCurve>(juce::jlimit(0, 2, static_cast<int>(mappingTree.getProperty("curve", 0))));
+                
+                // A corrupt or hand-edited state mustn't index past the dispatch table
+                if (!isValidNumber(mapping.source, mapping.ccNumber) || mapping.channel > 16)
+                    mapping = { mapping.controlType };
             }
         }
     }
+    
+    publishDispatchTable();
 }
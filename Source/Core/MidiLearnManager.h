@@ -1,6 +1,7 @@
 #pragma once
 
 #include <JuceHeader.h>
+#include "TripleBuffer.h"
 
 class StemEngine;
 
@@ -16,14 +17,68 @@ enum class MidiControlType
     Stop,
     Rewind,
     FastForward,
+    Seek,
+    Stem1Mute,
+    Stem2Mute,
+    Stem3Mute,
+    Stem4Mute,
+    Stem5Mute,
+    Stem6Mute,
+    Stem1Solo,
+    Stem2Solo,
+    Stem3Solo,
+    Stem4Solo,
+    Stem5Solo,
+    Stem6Solo,
+    Cue1,
+    Cue2,
+    Cue3,
+    Cue4,
+    Cue5,
+    Cue6,
+    Cue7,
+    Cue8,
     NumControls
 };
 
+// Where a mapping's value comes from
+enum class MidiSource
+{
+    Controller = 0,     // 7-bit CC
+    Controller14Bit,    // CC 0-31 as MSB with CC + 32 as LSB
+    Nrpn,               // 14-bit parameter via CC 99/98, data entry CC 6/38
+    Rpn,                // Same via CC 101/100
+    Note                // Note-on, e.g. from a drum pad; acts as a button
+};
+
+// How a 7-bit controller value is read; the relative modes are the common
+// encodings of endless encoders, each step being one tick of the knob
+enum class MidiValueMode
+{
+    Absolute = 0,
+    RelativeTwosComplement,  // 1-63 up, 127-65 down
+    RelativeSignBit,         // 1-63 up, 65-127 down
+    RelativeBinaryOffset     // Above 64 up, below 64 down
+};
+
+// Response of absolute values, applied through a lookup table
+enum class MidiCurve
+{
+    Linear = 0,
+    Decibel,   // Fader taper over 60 dB
+    Squared    // Finer control near the bottom
+};
+
 struct MidiMapping
 {
     MidiControlType controlType { MidiControlType::Stem1Volume };
-    int ccNumber { -1 };
-    int channel { -1 };  // -1 means any channel
+    MidiSource source { MidiSource::Controller };
+    int ccNumber { -1 };  // CC (the MSB for 14-bit pairs), NRPN/RPN parameter or note number
+    int channel { -1 };   // -1 means any channel
+    MidiValueMode mode { MidiValueMode::Absolute };
+    MidiCurve curve { MidiCurve::Linear };
+    
+    bool isMapped() const { return ccNumber >= 0; }
 };
 
 class MidiLearnManager
@@ -34,14 +89,40 @@ public:
 
     void startLearning(MidiControlType controlType);
     void stopLearning();
-    bool isLearning() const { return learning; }
+    bool isLearning() const { return learning.load(); }
     MidiControlType getLearningControlType() const { return learningControlType; }
     
-    void processMidiMessages(const juce::MidiBuffer& midiMessages, StemEngine& engine);
+    // Audio thread, all wait-free and allocation-free. beginBlock picks up the latest
+    // mappings; isMapped says whether a message would change engine or parser state (one
+    // table lookup), so the engine only splits its render at those; handleMessage applies
+    // one, assembling 14-bit pairs and NRPN/RPN sequences across messages.
+    void beginBlock();
+    bool isMapped(const juce::MidiMessage& message) const;
+    void handleMessage(const juce::MidiMessage& message, StemEngine& engine);
     
-    void setMapping(MidiControlType controlType, int ccNumber, int channel = -1);
+    // Audio thread, after the block is rendered: writes the value of every mapped control
+    // that changed since it was last sent, so motorised faders and LEDs follow changes made
+    // anywhere. Values are coalesced to the latest one per control per block, and output
+    // is rate-limited so a song load can't flood a slow USB-MIDI device.
+    void writeFeedback(StemEngine& engine, int numSamples, double sampleRate, juce::MidiBuffer& output);
+    
+    // Sets where a control's value comes from, keeping its mode and curve
+    void setMapping(MidiControlType controlType, int ccNumber, int channel = -1,
+                    MidiSource source = MidiSource::Controller);
+    void setValueMode(MidiControlType controlType, MidiValueMode mode);
+    void setCurve(MidiControlType controlType, MidiCurve curve);
     void removeMapping(MidiControlType controlType);
-    int getMappedCC(MidiControlType controlType) const;
+    MidiMapping getMapping(MidiControlType controlType) const;
+    
+    // Short form shown and edited in settings: "7", "7/39" for a 14-bit pair,
+    // "N1234" for an NRPN, "R0" for an RPN, "#60" for a note. parseSource returns
+    // false on bad text.
+    static juce::String describeSource(const MidiMapping& mapping);
+    static bool parseSource(const juce::String& text, MidiSource& source, int& number);
+    
+    // Program change n selects song n of the song list
+    void setProgramChangeSelectsSong(bool shouldSelect) { programChangeSelectsSong = shouldSelect; }
+    bool getProgramChangeSelectsSong() const { return programChangeSelectsSong.load(); }
     
     juce::ValueTree getStateAsValueTree() const;
     void loadStateFromValueTree(const juce::ValueTree& state);
@@ -51,13 +132,132 @@ public:
     static juce::String getControlName(MidiControlType type);
     static constexpr int getNumControls() { return static_cast<int>(MidiControlType::NumControls); }
 
+    static constexpr float relativeVolumeStep = 1.0f / 128.0f;
+    static constexpr double relativeSeekSeconds = 0.1;
+    static constexpr double feedbackBytesPerSecond = 1000.0;   // A third of a DIN MIDI link
+    static constexpr double feedbackBurstBytes = 64.0;
+    static constexpr double feedbackIntervalSeconds = 0.02;    // Per control
+
 private:
-    std::array<MidiMapping, static_cast<size_t>(MidiControlType::NumControls)> mappings;
+    static constexpr size_t numControls = static_cast<size_t>(MidiControlType::NumControls);
+    static constexpr int curveTableSize = 1024;
+    
+    // What a CC does on a channel: feeds a control as a 7-bit value, or is one half
+    // of a 14-bit pair
+    struct ControllerSlot
+    {
+        enum Role : int8_t { Value, Msb, Lsb };
+        
+        int8_t control { -1 };
+        Role role { Value };
+    };
+    
+    struct ParameterSlot
+    {
+        int number;
+        int channel;  // 0-15, or -1 for any
+        bool isRpn;
+        int8_t control;
+    };
+    
+    // Where a control's value is sent back to; relative mappings get none
+    struct FeedbackTarget
+    {
+        MidiSource source { MidiSource::Controller };
+        int number { -1 };   // -1 if the control gets no feedback
+        int channel { 1 };
+        MidiCurve curve { MidiCurve::Linear };
+        
+        int getMaxValue() const { return source == MidiSource::Controller || source == MidiSource::Note ? 127 : 16383; }
+    };
+    
+    // Everything the audio thread needs, rebuilt whole whenever a mapping changes
+    struct DispatchTable
+    {
+        std::array<std::array<ControllerSlot, 128>, 16> controllers;
+        std::array<std::array<int8_t, 128>, 16> notes;   // Control for every [channel][note], or -1
+        std::array<ParameterSlot, numControls> parameters;
+        int numParameters { 0 };
+        std::array<MidiValueMode, numControls> modes;
+        std::array<std::array<float, curveTableSize + 1>, numControls> curves;
+        std::array<FeedbackTarget, numControls> feedback;
+    };
+    
+    // Per-channel state of multi-message sequences; only touched by the audio thread
+    struct ChannelState
+    {
+        std::array<uint8_t, 32> msb {};   // Last MSB of each 14-bit pair
+        int parameterMsb { 127 };
+        int parameterLsb { 127 };
+        bool parameterIsRpn { false };
+        uint8_t dataMsb { 0 };
+        int8_t parameterControl { -1 };   // Control the selected parameter feeds, if any
+        
+        // -1 once the null parameter (127/127) is selected
+        int getParameter() const { return parameterMsb == 127 && parameterLsb == 127 ? -1 : parameterMsb * 128 + parameterLsb; }
+        
+        // CC 99/98 (NRPN) or 101/100 (RPN); switching between the two starts a new number
+        void selectParameter(int cc, int value)
+        {
+            const bool isRpn = cc >= 100;
+            if (isRpn != parameterIsRpn)
+            {
+                parameterIsRpn = isRpn;
+                parameterMsb = 0;
+                parameterLsb = 0;
+            }
+            
+            (cc == 99 || cc == 101 ? parameterMsb : parameterLsb) = value;
+        }
+    };
+    
+    // CC that came in while learning, held back until we know whether its LSB follows
+    struct PendingLearn
+    {
+        int channel { -1 };
+        int cc { -1 };
+        int blocksWaited { 0 };
+    };
+    
+    // Rebuilds the table from mappings and hands it to the audio thread; lock must be held
+    void publishDispatchTable();
+    void resolveParameter(int channel);
+    bool handleParameterMessage(int channel, int cc, int value, StemEngine& engine);
+    void learnFrom(int channel, int cc, int value);
+    void finishLearning(MidiSource source, int number, int channel);
+    
+    float lookUpCurve(int control, float normalized) const;
+    void applyAbsolute(int control, float normalized, StemEngine& engine);
+    static void applyRelative(MidiControlType controlType, int steps, StemEngine& engine);
+    static void pressButton(MidiControlType controlType, StemEngine& engine);
+    static int decodeRelative(MidiValueMode mode, int value);
+    static float applyCurve(MidiCurve curve, float normalized);
+    static float invertCurve(MidiCurve curve, float value);
+    
+    // Engine value of a control from 0 to 1, or -1 for controls with nothing to show
+    static float getFeedbackValue(MidiControlType controlType, StemEngine& engine);
+    static int getFeedbackBytes(MidiSource source);
+    static void writeFeedbackMessages(const FeedbackTarget& target, int value, juce::MidiBuffer& output);
+    
+    std::array<MidiMapping, numControls> mappings;
+    
+    std::atomic<bool> learning { false };
+    std::atomic<MidiControlType> learningControlType { MidiControlType::Stem1Volume };
+    std::atomic<bool> programChangeSelectsSong { false };
+    
+    std::array<ChannelState, 16> channelStates;
+    PendingLearn pendingLearn;
     
-    bool learning { false };
-    MidiControlType learningControlType { MidiControlType::Stem1Volume };
+    // Feedback state, audio thread only
+    std::array<int, numControls> lastSentValues;     // -1 until sent
+    std::array<int64_t, numControls> lastSentTimes;  // On feedbackClock
+    int64_t feedbackClock { 0 };
+    double feedbackBudget { feedbackBurstBytes };    // Bytes that may be sent right now
+    size_t nextFeedbackControl { 0 };                // Where sending resumes after running out
     
+    // Serialises the (non-audio) threads that edit mappings, which keeps the table single-writer
     juce::CriticalSection lock;
+    TripleBuffer<DispatchTable> dispatchTable;
     
     JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(MidiLearnManager)
 };
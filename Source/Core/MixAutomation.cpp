@@ -0,0 +1,87 @@
+#include "MixAutomation.h"
+#include "LibraryIndex.h"
+
+namespace
+{
+    constexpr char automationMagic[4] = { 'S', 'P', 'M', 'A' };
+    constexpr int32_t automationVersion = 1;
+    
+    struct Header
+    {
+        char magic[4];
+        int32_t version;
+        double sampleRate;
+        int64_t numEvents;
+    };
+}
+
+void MixAutomation::sort()
+{
+    std::stable_sort(events.begin(), events.end(), [](const Event& a, const Event& b) { return a.position < b.position; });
+}
+
+juce::File MixAutomation::getFile(const juce::String& songKey)
+{
+    return LibraryIndex::getIndexFile().getSiblingFile("Automation")
+               .getChildFile(juce::String::toHexString(songKey.hashCode64()) + ".automation");
+}
+
+std::shared_ptr<const MixAutomation> MixAutomation::load(const juce::String& songKey)
+{
+    juce::FileInputStream input(getFile(songKey));
+    if (!input.openedOk())
+        return nullptr;
+    
+    Header header {};
+    if (input.read(&header, sizeof(header)) != (int) sizeof(header)
+        || std::memcmp(header.magic, automationMagic, sizeof(automationMagic)) != 0
+        || header.version != automationVersion || header.sampleRate <= 0.0
+        || header.numEvents <= 0 || header.numEvents * (int64_t) sizeof(Event) != input.getNumBytesRemaining())
+        return nullptr;
+    
+    auto automation = std::make_shared<MixAutomation>();
+    automation->sampleRate = header.sampleRate;
+    automation->events.resize((size_t) header.numEvents);
+    
+    const auto numBytes = automation->events.size() * sizeof(Event);
+    if ((size_t) input.read(automation->events.data(), numBytes) != numBytes)
+        return nullptr;
+    
+    // Anything that doesn't make sense is dropped rather than played
+    auto& events = automation->events;
+    events.erase(std::remove_if(events.begin(), events.end(), [](const Event& event)
+    {
+        return event.stem >= NUM_STEM_TYPES || event.parameter > Solo || event.position < 0;
+    }), events.end());
+    
+    automation->sort();
+    return automation;
+}
+
+bool MixAutomation::save(const juce::String& songKey, const MixAutomation& automation)
+{
+    auto file = getFile(songKey);
+    
+    if (automation.events.empty())
+        return file.deleteFile();
+    
+    file.getParentDirectory().createDirectory();
+    
+    Header header {};
+    std::memcpy(header.magic, automationMagic, sizeof(automationMagic));
+    header.version = automationVersion;
+    header.sampleRate = automation.sampleRate;
+    header.numEvents = static_cast<int64_t>(automation.events.size());
+    
+    // Written next to the old file and moved over it, so a failed save leaves it intact
+    juce::TemporaryFile temporary(file);
+    {
+        juce::FileOutputStream output(temporary.getFile());
+        if (!output.openedOk()
+            || !output.write(&header, sizeof(header))
+            || !output.write(automation.events.data(), automation.events.size() * sizeof(Event)))
+            return false;
+    }
+    
+    return temporary.overwriteTargetFileWithTemporary();
+}
@@ -0,0 +1,35 @@
+#pragma once
+
+#include <JuceHeader.h>
+#include "StemDetector.h"
+
+// Recorded mix moves of one song: every volume, mute and solo change in time order,
+// at sample positions of the rate it was recorded at. Files live in an "Automation"
+// folder next to the library index, one per song, and are written as-is in native
+// byte order.
+struct MixAutomation
+{
+    enum Parameter : uint8_t { Volume, Mute, Solo };
+    
+    struct Event
+    {
+        int64_t position;    // In samples at sampleRate
+        float value;         // Volume from 0 to 1, or 0/1 for mute and solo
+        uint8_t stem;
+        Parameter parameter;
+    };
+    
+    static_assert(sizeof(Event) == 16, "Events are written to disk as-is");
+    
+    double sampleRate { 44100.0 };
+    std::vector<Event> events;
+    
+    // Orders the events by position, keeping the order of events at the same position
+    void sort();
+    
+    // By DetectedSong::getKey(); returns nullptr if the song has no automation
+    static std::shared_ptr<const MixAutomation> load(const juce::String& songKey);
+    static bool save(const juce::String& songKey, const MixAutomation& automation);
+    
+    static juce::File getFile(const juce::String& songKey);
+};
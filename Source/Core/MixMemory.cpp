@@ -0,0 +1,174 @@
+#include "MixMemory.h"
+#include "LibraryIndex.h"
+
+namespace
+{
+    // Mixes are stored as space-separated lists, one value per stem
+    void writeMix(juce::XmlElement& element, const StemEngine::Mix& mix)
+    {
+        juce::StringArray volumes, muted, solo;
+        
+        for (int i = 0; i < NUM_STEM_TYPES; ++i)
+        {
+            volumes.add(juce::String(mix.volumes[(size_t) i], 3));
+            muted.add(mix.muted[(size_t) i] ? "1" : "0");
+            solo.add(mix.solo[(size_t) i] ? "1" : "0");
+        }
+        
+        element.setAttribute("volumes", volumes.joinIntoString(" "));
+        element.setAttribute("muted", muted.joinIntoString(" "));
+        element.setAttribute("solo", solo.joinIntoString(" "));
+    }
+    
+    StemEngine::Mix readMix(const juce::XmlElement& element)
+    {
+        StemEngine::Mix mix;
+        const auto volumes = juce::StringArray::fromTokens(element.getStringAttribute("volumes"), false);
+        const auto muted = juce::StringArray::fromTokens(element.getStringAttribute("muted"), false);
+        const auto solo = juce::StringArray::fromTokens(element.getStringAttribute("solo"), false);
+        
+        for (int i = 0; i < NUM_STEM_TYPES; ++i)
+        {
+            if (i < volumes.size())
+                mix.volumes[(size_t) i] = juce::jlimit(0.0f, 1.0f, volumes[i].getFloatValue());
+            
+            mix.muted[(size_t) i] = i < muted.size() && muted[i].getIntValue() != 0;
+            mix.solo[(size_t) i] = i < solo.size() && solo[i].getIntValue() != 0;
+        }
+        
+        return mix;
+    }
+}
+
+juce::File MixMemory::getFile()
+{
+    return LibraryIndex::getIndexFile().getSiblingFile("mixes.xml");
+}
+
+void MixMemory::load()
+{
+    auto xml = juce::XmlDocument::parse(getFile());
+    
+    if (xml == nullptr || !xml->hasTagName("MixMemory"))
+        return;
+    
+    songs.clear();
+    
+    for (auto* songElement : xml->getChildWithTagNameIterator("Song"))
+    {
+        Song song;
+        
+        if (auto* mixElement = songElement->getChildByName("Mix"))
+        {
+            song.settings.hasMix = true;
+            song.settings.mix = readMix(*mixElement);
+        }
+        
+        const auto cues = juce::StringArray::fromTokens(songElement->getStringAttribute("cues"), false);
+        for (int i = 0; i < juce::jmin(cues.size(), StemEngine::numCuePoints); ++i)
+            song.settings.cueSeconds[(size_t) i] = cues[i].getDoubleValue();
+        
+        for (auto* snapshotElement : songElement->getChildWithTagNameIterator("Snapshot"))
+            song.snapshots.push_back({ snapshotElement->getStringAttribute("name"), readMix(*snapshotElement) });
+        
+        songs[songElement->getStringAttribute("key")] = std::move(song);
+    }
+}
+
+void MixMemory::save()
+{
+    auto xml = std::make_unique<juce::XmlElement>("MixMemory");
+    
+    for (const auto& pair : songs)
+    {
+        const auto& song = pair.second;
+        auto* songElement = xml->createNewChildElement("Song");
+        songElement->setAttribute("key", pair.first);
+        
+        juce::StringArray cues;
+        for (double seconds : song.settings.cueSeconds)
+            cues.add(seconds >= 0.0 ? juce::String(seconds, 3) : juce::String("-1"));
+        songElement->setAttribute("cues", cues.joinIntoString(" "));
+        
+        if (song.settings.hasMix)
+            writeMix(*songElement->createNewChildElement("Mix"), song.settings.mix);
+        
+        for (const auto& snapshot : song.snapshots)
+        {
+            auto* snapshotElement = songElement->createNewChildElement("Snapshot");
+            snapshotElement->setAttribute("name", snapshot.name);
+            writeMix(*snapshotElement, snapshot.mix);
+        }
+    }
+    
+    xml->writeTo(getFile());
+}
+
+StemEngine::SongSettings MixMemory::getSettings(const juce::String& songKey) const
+{
+    auto found = songs.find(songKey);
+    return found != songs.end() ? found->second.settings : StemEngine::SongSettings();
+}
+
+void MixMemory::remember(const juce::String& songKey, const StemEngine::SongSettings& settings)
+{
+    auto& song = songs[songKey];
+    song.settings = settings;
+    song.settings.automation = nullptr;
+    save();
+}
+
+juce::StringArray MixMemory::getSnapshotNames(const juce::String& songKey) const
+{
+    juce::StringArray names;
+    
+    auto found = songs.find(songKey);
+    if (found != songs.end())
+        for (const auto& snapshot : found->second.snapshots)
+            names.add(snapshot.name);
+    
+    return names;
+}
+
+bool MixMemory::getSnapshot(const juce::String& songKey, const juce::String& name, StemEngine::Mix& mix) const
+{
+    auto found = songs.find(songKey);
+    if (found == songs.end())
+        return false;
+    
+    for (const auto& snapshot : found->second.snapshots)
+    {
+        if (snapshot.name == name)
+        {
+            mix = snapshot.mix;
+            return true;
+        }
+    }
+    
+    return false;
+}
+
+void MixMemory::saveSnapshot(const juce::String& songKey, const juce::String& name, const StemEngine::Mix& mix)
+{
+    auto& snapshots = songs[songKey].snapshots;
+    auto existing = std::find_if(snapshots.begin(), snapshots.end(), [&name](const Snapshot& s) { return s.name == name; });
+    
+    if (existing != snapshots.end())
+        existing->mix = mix;
+    else
+        snapshots.push_back({ name, mix });
+    
+    save();
+}
+
+void MixMemory::removeSnapshot(const juce::String& songKey, const juce::String& name)
+{
+    auto found = songs.find(songKey);
+    if (found == songs.end())
+        return;
+    
+    auto& snapshots = found->second.snapshots;
+    snapshots.erase(std::remove_if(snapshots.begin(), snapshots.end(), [&name](const Snapshot& s) { return s.name == name; }),
+                    snapshots.end());
+    save();
+}
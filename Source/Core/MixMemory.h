@@ -0,0 +1,49 @@
+#pragma once
+
+#include <JuceHeader.h>
+#include "StemEngine.h"
+#include <unordered_map>
+
+// Remembers each song's mix and cue points between sessions, plus named mix snapshots
+// per song. Kept in "mixes.xml" next to the library index and keyed by
+// DetectedSong::getKey(). Message thread only.
+class MixMemory
+{
+public:
+    MixMemory() = default;
+    ~MixMemory() = default;
+    
+    void load();
+    void save();
+    
+    // The song's remembered mix and cues; hasMix is false if it has none
+    StemEngine::SongSettings getSettings(const juce::String& songKey) const;
+    void remember(const juce::String& songKey, const StemEngine::SongSettings& settings);
+    
+    // Snapshots in the order they were first saved
+    juce::StringArray getSnapshotNames(const juce::String& songKey) const;
+    bool getSnapshot(const juce::String& songKey, const juce::String& name, StemEngine::Mix& mix) const;
+    
+    // Replaces a snapshot of the same name
+    void saveSnapshot(const juce::String& songKey, const juce::String& name, const StemEngine::Mix& mix);
+    void removeSnapshot(const juce::String& songKey, const juce::String& name);
+    
+    static juce::File getFile();
+
+private:
+    struct Snapshot
+    {
+        juce::String name;
+        StemEngine::Mix mix;
+    };
+    
+    struct Song
+    {
+        StemEngine::SongSettings settings;  // Without automation, which has its own files
+        std::vector<Snapshot> snapshots;
+    };
+    
+    std::unordered_map<juce::String, Song> songs;
+    
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(MixMemory)
+};
@@ -0,0 +1,107 @@
+#include "MixParameters.h"
+
+MixParameters::MixParameters(juce::AudioProcessorValueTreeState& state)
+{
+    for (int kind = 0; kind < numKinds; ++kind)
+    {
+        for (int stem = 0; stem < NUM_STEM_TYPES; ++stem)
+        {
+            auto& entry = entries[(size_t) (kind * NUM_STEM_TYPES + stem)];
+            const auto id = getParameterID(static_cast<Kind>(kind), stem);
+            
+            entry.parameter = state.getParameter(id);
+            entry.value = state.getRawParameterValue(id);
+            jassert(entry.parameter != nullptr && entry.value != nullptr);
+        }
+    }
+    
+    startTimerHz(30);
+}
+
+MixParameters::~MixParameters()
+{
+    stopTimer();
+}
+
+juce::String MixParameters::getParameterID(Kind kind, int stem)
+{
+    static const char* const prefixes[] = { "volume", "mute", "solo" };
+    return prefixes[kind] + juce::String(stem + 1);
+}
+
+juce::AudioProcessorValueTreeState::ParameterLayout MixParameters::createLayout()
+{
+    juce::AudioProcessorValueTreeState::ParameterLayout layout;
+    
+    for (int stem = 0; stem < NUM_STEM_TYPES; ++stem)
+    {
+        const auto name = StemDetector::getStemTypeName(stem);
+        
+        layout.add(std::make_unique<juce::AudioParameterFloat>(juce::ParameterID { getParameterID(Volume, stem), 1 },
+                                                               name + " Volume", 0.0f, 1.0f, 1.0f));
+        layout.add(std::make_unique<juce::AudioParameterBool>(juce::ParameterID { getParameterID(Mute, stem), 1 },
+                                                              name + " Mute", false));
+        layout.add(std::make_unique<juce::AudioParameterBool>(juce::ParameterID { getParameterID(Solo, stem), 1 },
+                                                              name + " Solo", false));
+    }
+    
+    return layout;
+}
+
+void MixParameters::applyHostChanges(StemEngine& engine)
+{
+    using Command = StemEngine::Command;
+    
+    for (int index = 0; index < numParameters; ++index)
+    {
+        auto& entry = entries[(size_t) index];
+        const float value = entry.value->load(std::memory_order_relaxed);
+        
+        if (value == entry.applied.load(std::memory_order_relaxed))
+            continue;
+        
+        entry.applied = value;
+        
+        const int stem = index % NUM_STEM_TYPES;
+        switch (index / NUM_STEM_TYPES)
+        {
+            case Volume: engine.applyCommand({ Command::Type::SetTrackVolume, stem, value }); break;
+            case Mute:   engine.applyCommand({ Command::Type::SetTrackMute, stem, value >= 0.5f ? 1.0 : 0.0 }); break;
+            case Solo:   engine.applyCommand({ Command::Type::SetTrackSolo, stem, value >= 0.5f ? 1.0 : 0.0 }); break;
+            default:     break;
+        }
+    }
+}
+
+void MixParameters::captureMix(StemEngine& engine)
+{
+    for (int stem = 0; stem < NUM_STEM_TYPES; ++stem)
+    {
+        const auto* track = engine.getTrack(stem);
+        
+        entries[(size_t) (Volume * NUM_STEM_TYPES + stem)].engineValue = track != nullptr ? track->getVolume() : -1.0f;
+        entries[(size_t) (Mute * NUM_STEM_TYPES + stem)].engineValue = track != nullptr ? (track->isMuted() ? 1.0f : 0.0f) : -1.0f;
+        entries[(size_t) (Solo * NUM_STEM_TYPES + stem)].engineValue = track != nullptr ? (track->isSolo() ? 1.0f : 0.0f) : -1.0f;
+    }
+}
+
+void MixParameters::timerCallback()
+{
+    for (auto& entry : entries)
+    {
+        const float engineValue = entry.engineValue;
+        const float hostValue = entry.value->load();
+        
+        // Nothing loaded, or the audio thread hasn't caught up with the host's own change yet
+        if (engineValue < 0.0f || hostValue != entry.applied.load())
+            continue;
+        
+        if (std::abs(engineValue - hostValue) < 1.0e-4f)
+            continue;
+        
+        // The audio thread sees this as a host change next block, which changes nothing
+        entry.parameter->beginChangeGesture();
+        entry.parameter->setValueNotifyingHost(entry.parameter->convertTo0to1(engineValue));
+        entry.parameter->endChangeGesture();
+    }
+}
@@ -0,0 +1,43 @@
+#pragma once
+
+#include <JuceHeader.h>
+#include "StemEngine.h"
+
+// Volume, mute and solo of every stem as host parameters, so they can be automated.
+// The engine's tracks stay the mixer state: changes the host makes are applied at the
+// start of each block, and changes made here (UI, MIDI) are reported back to the host
+// from the message thread. The audio thread reads the parameters through atomics cached
+// up front, never by ID.
+class MixParameters : private juce::Timer
+{
+public:
+    explicit MixParameters(juce::AudioProcessorValueTreeState& state);
+    ~MixParameters() override;
+    
+    static juce::AudioProcessorValueTreeState::ParameterLayout createLayout();
+    
+    // Audio thread, from within StemEngine::processBlock
+    void applyHostChanges(StemEngine& engine);
+    void captureMix(StemEngine& engine);
+
+private:
+    enum Kind { Volume, Mute, Solo, numKinds };
+    static constexpr int numParameters = numKinds * NUM_STEM_TYPES;
+    
+    static juce::String getParameterID(Kind kind, int stem);
+    
+    void timerCallback() override;
+    
+    struct Entry
+    {
+        juce::RangedAudioParameter* parameter { nullptr };
+        std::atomic<float>* value { nullptr };      // Plain value
+        std::atomic<float> applied { -1.0f };       // Last value handed to the engine
+        std::atomic<float> engineValue { -1.0f };   // Engine's value after the last block, -1 without a track
+    };
+    
+    // Indexed by kind * NUM_STEM_TYPES + stem
+    std::array<Entry, numParameters> entries;
+    
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(MixParameters)
+};
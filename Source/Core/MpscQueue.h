@@ -0,0 +1,80 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+
+// Bounded lock-free FIFO for any number of producers and one consumer. Producers
+// claim a slot with one compare-exchange and push fails rather than blocks when the
+// queue is full; pop never blocks. Each slot carries a sequence number that says
+// whether it is free, being written, or ready to read.
+template <typename T, size_t Capacity>
+class MpscQueue
+{
+public:
+    static_assert((Capacity & (Capacity - 1)) == 0, "Capacity must be a power of two");
+
+    MpscQueue()
+    {
+        for (size_t i = 0; i < Capacity; ++i)
+            slots[i].sequence.store(i, std::memory_order_relaxed);
+    }
+
+    // Any thread
+    bool push(const T& value)
+    {
+        size_t position = tail.load(std::memory_order_relaxed);
+
+        for (;;)
+        {
+            auto& slot = slots[position & mask];
+            const auto difference = static_cast<intptr_t>(slot.sequence.load(std::memory_order_acquire))
+                                  - static_cast<intptr_t>(position);
+
+            if (difference == 0)
+            {
+                if (tail.compare_exchange_weak(position, position + 1, std::memory_order_relaxed))
+                {
+                    slot.value = value;
+                    slot.sequence.store(position + 1, std::memory_order_release);
+                    return true;
+                }
+            }
+            else if (difference < 0)
+            {
+                return false;  // Full
+            }
+            else
+            {
+                position = tail.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    // Consumer thread only
+    bool pop(T& value)
+    {
+        auto& slot = slots[head & mask];
+
+        if (slot.sequence.load(std::memory_order_acquire) != head + 1)
+            return false;
+
+        value = slot.value;
+        slot.sequence.store(head + Capacity, std::memory_order_release);
+        ++head;
+        return true;
+    }
+
+private:
+    struct Slot
+    {
+        std::atomic<size_t> sequence { 0 };
+        T value {};
+    };
+
+    static constexpr size_t mask = Capacity - 1;
+
+    std::array<Slot, Capacity> slots;
+    alignas(64) std::atomic<size_t> tail { 0 };
+    alignas(64) size_t head { 0 };
+};
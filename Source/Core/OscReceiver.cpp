@@ -0,0 +1,226 @@
+#include "OscReceiver.h"
+
+namespace
+{
+    // Length of an OSC string including its terminator and padding, or -1 if it runs
+    // past the end
+    int getPaddedStringSize(const char* data, int size)
+    {
+        const auto* end = static_cast<const char*>(std::memchr(data, 0, (size_t) juce::jmax(0, size)));
+        if (end == nullptr)
+            return -1;
+        
+        const int padded = (static_cast<int>(end - data) + 4) & ~3;
+        return padded <= size ? padded : -1;
+    }
+    
+    bool startsWith(const char* text, const char* prefix, const char*& rest)
+    {
+        const size_t length = std::strlen(prefix);
+        if (std::strncmp(text, prefix, length) != 0)
+            return false;
+        
+        rest = text + length;
+        return true;
+    }
+}
+
+OscReceiver::OscReceiver(StemEngine& e)
+    : juce::Thread("OSC"), engine(e)
+{
+}
+
+OscReceiver::~OscReceiver()
+{
+    stop();
+}
+
+bool OscReceiver::start(int port)
+{
+    stop();
+    
+    socket = std::make_unique<juce::DatagramSocket>();
+    if (!socket->bindToPort(port, "127.0.0.1"))
+    {
+        socket.reset();
+        return false;
+    }
+    
+    // Show-control cues should land within a block or two
+    return startThread(juce::Thread::Priority::high);
+}
+
+void OscReceiver::stop()
+{
+    signalThreadShouldExit();
+    
+    if (socket != nullptr)
+        socket->shutdown();
+    
+    stopThread(1000);
+    socket.reset();
+}
+
+void OscReceiver::run()
+{
+    while (!threadShouldExit())
+    {
+        if (socket->waitUntilReady(true, 100) != 1)
+            continue;
+        
+        const int size = socket->read(packet.data(), maxPacketSize, false);
+        if (size < 0)
+            break;
+        
+        if (size > 0 && !handlePacket(packet.data(), size))
+            ++numRejected;
+    }
+}
+
+bool OscReceiver::handlePacket(const char* data, int size)
+{
+    // Everything in OSC is a multiple of 4 bytes
+    if (size < 4 || size % 4 != 0)
+        return false;
+    
+    if (size < 16 || std::memcmp(data, "#bundle", 8) != 0)
+        return handleMessage(data, size);
+    
+    // Time tag, then elements each preceded by their size
+    int offset = 16;
+    
+    while (offset + 4 <= size)
+    {
+        const int elementSize = static_cast<int>(juce::ByteOrder::bigEndianInt(data + offset));
+        offset += 4;
+        
+        if (elementSize <= 0 || elementSize > size - offset)
+            return false;
+        
+        if (!handlePacket(data + offset, elementSize))
+            ++numRejected;
+        
+        offset += elementSize;
+    }
+    
+    return offset == size;
+}
+
+bool OscReceiver::handleMessage(const char* data, int size)
+{
+    if (data[0] != '/')
+        return false;
+    
+    const int addressSize = getPaddedStringSize(data, size);
+    if (addressSize < 0)
+        return false;
+    
+    // Messages from old senders may have no type tags and so no arguments
+    bool hasArgument = false;
+    double argument = 0.0;
+    
+    if (addressSize < size && data[addressSize] == ',')
+    {
+        const char* tags = data + addressSize;
+        const int tagsSize = getPaddedStringSize(tags, size - addressSize);
+        if (tagsSize < 0)
+            return false;
+        
+        const char* arguments = tags + tagsSize;
+        const int argumentsSize = size - addressSize - tagsSize;
+        hasArgument = true;
+        
+        switch (tags[1])
+        {
+            case 'i':
+                if (argumentsSize < 4) return false;
+                argument = static_cast<double>(static_cast<int32_t>(juce::ByteOrder::bigEndianInt(arguments)));
+                break;
+            
+            case 'f':
+            {
+                if (argumentsSize < 4) return false;
+                const uint32_t bits = juce::ByteOrder::bigEndianInt(arguments);
+                float value;
+                std::memcpy(&value, &bits, sizeof(value));
+                argument = static_cast<double>(value);
+                break;
+            }
+            
+            case 'h':
+                if (argumentsSize < 8) return false;
+                argument = static_cast<double>(static_cast<int64_t>(juce::ByteOrder::bigEndianInt64(arguments)));
+                break;
+            
+            case 'd':
+            {
+                if (argumentsSize < 8) return false;
+                const uint64_t bits = juce::ByteOrder::bigEndianInt64(arguments);
+                std::memcpy(&argument, &bits, sizeof(argument));
+                break;
+            }
+            
+            case 'T': argument = 1.0; break;
+            case 'F': argument = 0.0; break;
+            default:  hasArgument = false; break;
+        }
+        
+        // A NaN would reach the mix unchanged, since no clamp catches it
+        if (hasArgument && !std::isfinite(argument))
+            return false;
+    }
+    
+    StemEngine::Command command;
+    // A flood that fills the queue is counted as rejected
+    if (!makeCommand(data, hasArgument, argument, command) || !engine.tryPost(command))
+        return false;
+    
+    ++numHandled;
+    return true;
+}
+
+bool OscReceiver::makeCommand(const char* address, bool hasArgument, double argument, StemEngine::Command& command) const
+{
+    using Type = StemEngine::Command::Type;
+    const char* rest = nullptr;
+    
+    if (startsWith(address, "/stem/", rest))
+    {
+        char* parameter = nullptr;
+        const long stem = std::strtol(rest, &parameter, 10);
+        if (parameter == rest || stem < 1 || stem > NUM_STEM_TYPES || !hasArgument)
+            return false;
+        
+        command.trackIndex = static_cast<int>(stem) - 1;
+        command.value = argument;
+        
+        if (std::strcmp(parameter, "/volume") == 0 && argument >= 0.0 && argument <= 1.0)
+            command.type = Type::SetTrackVolume;
+        else if (std::strcmp(parameter, "/mute") == 0)
+            command.type = Type::SetTrackMute;
+        else if (std::strcmp(parameter, "/solo") == 0)
+            command.type = Type::SetTrackSolo;
+        else
+            return false;
+        
+        if (command.type != Type::SetTrackVolume)
+            command.value = argument != 0.0 ? 1.0 : 0.0;
+        
+        return true;
+    }
+    
+    if (std::strcmp(address, "/transport/play") == 0)
+        command.type = hasArgument && argument == 0.0 ? Type::Pause : Type::Play;
+    else if (std::strcmp(address, "/transport/pause") == 0)
+        command.type = Type::Pause;
+    else if (std::strcmp(address, "/transport/stop") == 0)
+        command.type = Type::Stop;
+    else if (std::strcmp(address, "/song/select") == 0 && hasArgument && argument >= 0.0 && argument <= maxSongIndex)
+        command = { Type::SelectSong, -1, std::floor(argument) };
+    else if (std::strcmp(address, "/seek") == 0 && hasArgument && argument <= maxSeekSeconds)
+        command = { Type::SetPosition, -1, juce::jmax(0.0, argument) };
+    else
+        return false;
+    
+    return true;
+}
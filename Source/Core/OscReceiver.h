@@ -0,0 +1,60 @@
+#pragma once
+
+#include <JuceHeader.h>
+#include "StemEngine.h"
+
+// Turns OSC messages arriving on a local UDP port into engine commands, for show-control
+// systems. Packets are read into a fixed buffer and parsed in place on a dedicated thread,
+// so nothing is allocated per packet, and commands reach the audio thread through
+// StemEngine::post. Bundles are unpacked and applied on arrival, ignoring their time tags.
+//
+//   /stem/N/volume f     N from 1 to 6, volume from 0 to 1 (others are rejected)
+//   /stem/N/mute i       also /stem/N/solo; non-zero turns it on
+//   /transport/play      with an argument of 0 it pauses; also /transport/pause and /stop
+//   /song/select i       place in the song list, 0 = first
+//   /seek f              position in seconds
+//
+// Numeric arguments may be int32, int64, float32, float64, true or false.
+class OscReceiver : private juce::Thread
+{
+public:
+    explicit OscReceiver(StemEngine& engine);
+    ~OscReceiver() override;
+    
+    // Listens on 127.0.0.1:port, replacing any previous port; false if it can't be bound.
+    // Message thread only.
+    bool start(int port);
+    void stop();
+    
+    bool isListening() const { return isThreadRunning(); }
+    
+    // Messages turned into commands, and ones that weren't (unknown, malformed or the
+    // engine's queue was full)
+    uint64_t getNumHandled() const { return numHandled; }
+    uint64_t getNumRejected() const { return numRejected; }
+
+private:
+    void run() override;
+    
+    // A message or a bundle; returns false if it's malformed
+    bool handlePacket(const char* data, int size);
+    bool handleMessage(const char* data, int size);
+    
+    // The engine command for an address and its first argument
+    bool makeCommand(const char* address, bool hasArgument, double argument, StemEngine::Command& command) const;
+    
+    static constexpr int maxPacketSize = 8192;
+    
+    // Larger arguments are rejected, so the engine's conversions to int and to samples stay defined
+    static constexpr double maxSongIndex = std::numeric_limits<int>::max();
+    static constexpr double maxSeekSeconds = std::numeric_limits<int32_t>::max();
+    
+    StemEngine& engine;
+    std::unique_ptr<juce::DatagramSocket> socket;
+    std::array<char, maxPacketSize> packet {};
+    
+    std::atomic<uint64_t> numHandled { 0 };
+    std::atomic<uint64_t> numRejected { 0 };
+    
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(OscReceiver)
+};
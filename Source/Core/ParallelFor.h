@@ -0,0 +1,56 @@
+#pragma once
+
+#include <JuceHeader.h>
+#include <atomic>
+
+// Worker threads shared by every parallelFor, started on first use
+inline juce::ThreadPool& getParallelForPool()
+{
+    static juce::ThreadPool pool { juce::ThreadPoolOptions{}
+                                       .withThreadName("Parallel")
+                                       .withNumberOfThreadsToUse(juce::jmax(1, juce::SystemStats::getNumCpus() - 1)) };
+    return pool;
+}
+
+// Runs fn(0) .. fn(numItems - 1) across all CPU cores and returns once every item is done.
+// Items are handed out one at a time, so uneven item costs balance out. The calling thread
+// works through items too and only waits for items already taken, so this finishes even
+// while the shared pool is busy elsewhere.
+inline void parallelFor(int numItems, const std::function<void(int)>& fn)
+{
+    if (numItems <= 0)
+        return;
+    
+    // Helpers that start after the last item was taken find nothing to do, so what they
+    // share outlives this call
+    struct Work
+    {
+        std::function<void(int)> fn;
+        int numItems;
+        std::atomic<int> nextItem { 0 };
+        std::atomic<int> itemsLeft;
+        juce::WaitableEvent allDone;
+        
+        Work(const std::function<void(int)>& f, int n) : fn(f), numItems(n), itemsLeft(n) {}
+        
+        void run()
+        {
+            for (int i = nextItem++; i < numItems; i = nextItem++)
+            {
+                fn(i);
+                
+                if (--itemsLeft == 0)
+                    allDone.signal();
+            }
+        }
+    };
+    
+    auto work = std::make_shared<Work>(fn, numItems);
+    const int numHelpers = juce::jlimit(0, numItems - 1, getParallelForPool().getNumThreads());
+    
+    for (int h = 0; h < numHelpers; ++h)
+        getParallelForPool().addJob([work]() { work->run(); });
+    
+    work->run();
+    work->allDone.wait();
+}
@@ -0,0 +1,124 @@
+#include "PeakCache.h"
+
+namespace
+{
+    constexpr char peaksMagic[4] = { 'W', 'P', 'K', 'S' };
+    constexpr int peaksVersion = 2;  // 2: band energies added to each peak
+    
+    // Everything that has to match for a cache file to be used; written as-is
+    struct Header
+    {
+        char magic[4];
+        int32_t version;
+        int64_t fileSize;
+        int64_t modificationTime;
+        int64_t lengthInSamples;
+        double sampleRate;
+        int32_t firstChannel;
+        int32_t numChannels;
+        int32_t baseSamplesPerPeak;
+        int32_t numLevels;
+    };
+    
+    static_assert(sizeof(Header) % 8 == 0, "Peak data must stay aligned after the header");
+    
+    Header makeHeader(const juce::File& audioFile, int firstChannel, int numChannels,
+                      int64_t lengthInSamples, double sampleRate)
+    {
+        Header header {};
+        std::memcpy(header.magic, peaksMagic, sizeof(peaksMagic));
+        header.version = peaksVersion;
+        header.fileSize = audioFile.getSize();
+        header.modificationTime = audioFile.getLastModificationTime().toMilliseconds();
+        header.lengthInSamples = lengthInSamples;
+        header.sampleRate = sampleRate;
+        header.firstChannel = firstChannel;
+        header.numChannels = numChannels;
+        header.baseSamplesPerPeak = WaveformPeaks::baseSamplesPerPeak;
+        header.numLevels = WaveformPeaks::numLevels;
+        return header;
+    }
+    
+    std::shared_ptr<WaveformPeaks> loadFrom(const juce::File& cacheFile, const Header& expected)
+    {
+        if (!cacheFile.existsAsFile())
+            return nullptr;
+        
+        auto mapped = std::make_unique<juce::MemoryMappedFile>(cacheFile, juce::MemoryMappedFile::readOnly);
+        
+        if (mapped->getData() == nullptr || mapped->getSize() < sizeof(Header)
+            || std::memcmp(mapped->getData(), &expected, sizeof(Header)) != 0)
+            return nullptr;
+        
+        auto peaks = std::make_shared<WaveformPeaks>(expected.numChannels, expected.lengthInSamples, expected.sampleRate);
+        
+        if (!peaks->attachMappedData(std::move(mapped), sizeof(Header)))
+            return nullptr;
+        
+        return peaks;
+    }
+}
+
+juce::File PeakCache::getCacheDirectory()
+{
+    return juce::File::getSpecialLocation(juce::File::userApplicationDataDirectory)
+               .getChildFile("StemPlayer")
+               .getChildFile("PeakCache");
+}
+
+juce::File PeakCache::getSidecarFile(const juce::File& audioFile, int firstChannel)
+{
+    // Stems inside a container get one sidecar per channel pair
+    auto suffix = firstChannel > 0 ? ".ch" + juce::String(firstChannel) + ".peaks" : juce::String(".peaks");
+    return audioFile.getSiblingFile(audioFile.getFileName() + suffix);
+}
+
+juce::File PeakCache::getCacheFile(const juce::File& audioFile, int firstChannel)
+{
+    auto key = audioFile.getFullPathName() + "#" + juce::String(firstChannel);
+    return getCacheDirectory().getChildFile(juce::String::toHexString(key.hashCode64()) + ".peaks");
+}
+
+std::shared_ptr<WaveformPeaks> PeakCache::load(const juce::File& audioFile, int firstChannel,
+                                               int numChannels, int64_t lengthInSamples, double sampleRate)
+{
+    const auto expected = makeHeader(audioFile, firstChannel, numChannels, lengthInSamples, sampleRate);
+    
+    if (auto peaks = loadFrom(getSidecarFile(audioFile, firstChannel), expected))
+        return peaks;
+    
+    return loadFrom(getCacheFile(audioFile, firstChannel), expected);
+}
+
+bool PeakCache::save(const WaveformPeaks& peaks, const juce::File& audioFile, int firstChannel, bool useSidecar)
+{
+    if (!peaks.isComplete())
+        return false;
+    
+    auto cacheFile = useSidecar ? getSidecarFile(audioFile, firstChannel) : getCacheFile(audioFile, firstChannel);
+    
+    if (!cacheFile.getParentDirectory().createDirectory())
+        return false;
+    
+    const auto header = makeHeader(audioFile, firstChannel, peaks.getNumChannels(),
+                                   peaks.getLengthInSamples(), peaks.getSampleRate());
+    
+    // Written to a temporary file first so a reader never maps a half-written cache
+    juce::TemporaryFile temp(cacheFile);
+    
+    {
+        auto stream = temp.getFile().createOutputStream();
+        
+        if (stream == nullptr
+            || !stream->write(&header, sizeof(header))
+            || !stream->write(peaks.getData(), peaks.getDataSize()))
+            return false;
+        
+        stream->flush();
+        
+        if (!stream->getStatus().wasOk())
+            return false;
+    }
+    
+    return temp.overwriteTargetFileWithTemporary();
+}
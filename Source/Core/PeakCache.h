@@ -0,0 +1,25 @@
+#pragma once
+
+#include <JuceHeader.h>
+#include "WaveformPeaks.h"
+
+// Stores finished peak pyramids on disk so a song's waveforms show up instantly the
+// next time it is loaded. Files live in the application data folder, or next to the
+// audio as "<file>.peaks" sidecars when enabled. Each file records the audio file's
+// size and modification time and is ignored once either changes.
+//
+// Peaks are stored in native byte order and mapped straight into memory on load.
+class PeakCache
+{
+public:
+    // Returns nullptr if there is no valid cache file for this stem. Sidecars are
+    // checked first whatever the setting, so sidecars shipped with a library are used.
+    static std::shared_ptr<WaveformPeaks> load(const juce::File& audioFile, int firstChannel,
+                                               int numChannels, int64_t lengthInSamples, double sampleRate);
+    
+    static bool save(const WaveformPeaks& peaks, const juce::File& audioFile, int firstChannel, bool useSidecar);
+    
+    static juce::File getSidecarFile(const juce::File& audioFile, int firstChannel);
+    static juce::File getCacheFile(const juce::File& audioFile, int firstChannel);
+    static juce::File getCacheDirectory();
+};
@@ -0,0 +1,198 @@
+#include "SongCatalog.h"
+#include <cstring>
+
+SongCatalog::SongCatalog()
+{
+    formatNames.add({});
+    warnings.add({});
+    durationLabels.add({});
+    
+    // "N stems: ..." for every combination of found stems, so rows never build it
+    for (int mask = 0; mask < (1 << NUM_STEM_TYPES); ++mask)
+    {
+        juce::StringArray names;
+        for (int i = 0; i < NUM_STEM_TYPES; ++i)
+        {
+            if ((mask & (1 << i)) != 0)
+                names.add(StemDetector::getStemTypeName(i));
+        }
+        stemLabels[(size_t) mask] = juce::String(names.size()) + " stems: " + names.joinIntoString(", ");
+    }
+}
+
+uint32_t SongCatalog::addText(const juce::String& text)
+{
+    auto offset = static_cast<uint32_t>(textArena.size());
+    auto utf8 = text.toRawUTF8();
+    textArena.insert(textArena.end(), utf8, utf8 + text.getNumBytesAsUTF8() + 1);
+    return offset;
+}
+
+uint16_t SongCatalog::intern(juce::StringArray& table, std::unordered_map<juce::String, uint16_t>& lookup,
+                             const juce::String& text)
+{
+    if (text.isEmpty())
+        return 0;
+    
+    auto it = lookup.find(text);
+    if (it != lookup.end())
+        return it->second;
+    
+    // Table 0 slots are reserved for "none"; past 65535 distinct strings fall back to it
+    if (table.size() > 0xffff)
+        return 0;
+    
+    auto index = static_cast<uint16_t>(table.size());
+    table.add(text);
+    lookup[text] = index;
+    return index;
+}
+
+uint32_t SongCatalog::internDirectory(const juce::File& directory)
+{
+    auto path = directory.getFullPathName();
+    auto it = directoryLookup.find(path);
+    
+    if (it == directoryLookup.end())
+    {
+        it = directoryLookup.emplace(path, static_cast<uint32_t>(directories.size())).first;
+        directories.add(path);
+    }
+    
+    return it->second;
+}
+
+void SongCatalog::addSong(const DetectedSong& song)
+{
+    Entry entry;
+    entry.name = song.songName;
+    entry.sortKey = addText(song.songName.toLowerCase());
+    entry.firstStem = static_cast<uint32_t>(stems.size());
+    entry.stemMask = 0;
+    entry.directory = 0;
+    entry.container = song.isContainer();
+    
+    // Container stems all share one file name
+    entry.containerFile = 0;
+    if (entry.container)
+    {
+        entry.directory = internDirectory(song.containerFile.getParentDirectory());
+        entry.containerFile = addText(song.containerFile.getFileName());
+    }
+    
+    for (int i = 0; i < NUM_STEM_TYPES; ++i)
+    {
+        if (!song.stemFound[i])
+            continue;
+        
+        // All stems of a song share a folder in practice; the first one decides
+        if (entry.stemMask == 0 && !entry.container)
+            entry.directory = internDirectory(song.stemFiles[i].getParentDirectory());
+        
+        const auto& info = song.stemInfo[i];
+        StemRecord record;
+        record.fileName = entry.container ? entry.containerFile : addText(song.stemFiles[i].getFileName());
+        record.sampleRate = static_cast<uint32_t>(info.sampleRate);
+        record.lengthInSamples = info.lengthInSamples;
+        record.numChannels = static_cast<uint8_t>(juce::jlimit(0, 255, info.numChannels));
+        record.valid = info.valid;
+        record.formatName = intern(formatNames, formatLookup, info.formatName);
+        stems.push_back(record);
+        
+        entry.stemMask = static_cast<uint8_t>(entry.stemMask | (1 << i));
+    }
+    
+    entry.warning = intern(warnings, warningLookup, song.getFormatWarning());
+    
+    int totalSeconds = static_cast<int>(song.getDurationInSeconds() + 0.5);
+    if (totalSeconds > 0)
+        entry.durationLabel = intern(durationLabels, durationLookup,
+                                     juce::String(totalSeconds / 60) + ":" + juce::String(totalSeconds % 60).paddedLeft('0', 2));
+    else
+        entry.durationLabel = 0;
+    
+    entries.push_back(std::move(entry));
+}
+
+void SongCatalog::finishBuilding()
+{
+    std::stable_sort(entries.begin(), entries.end(), [this](const Entry& a, const Entry& b) {
+        return std::strcmp(textArena.data() + a.sortKey, textArena.data() + b.sortKey) < 0;
+    });
+    
+    directoryLookup = {};
+    formatLookup = {};
+    warningLookup = {};
+    durationLookup = {};
+    
+    entries.shrink_to_fit();
+    stems.shrink_to_fit();
+    textArena.shrink_to_fit();
+}
+
+DetectedSong SongCatalog::getSong(int index) const
+{
+    DetectedSong song;
+    
+    if (index < 0 || index >= size())
+        return song;
+    
+    const auto& entry = entries[(size_t) index];
+    juce::File directory(directories[(int) entry.directory]);
+    
+    song.songName = entry.name;
+    song.probed = true;
+    
+    if (entry.container)
+        song.containerFile = directory.getChildFile(juce::String::fromUTF8(textArena.data() + entry.containerFile));
+    
+    auto stemIndex = entry.firstStem;
+    for (int i = 0; i < NUM_STEM_TYPES; ++i)
+    {
+        if ((entry.stemMask & (1 << i)) == 0)
+            continue;
+        
+        const auto& record = stems[stemIndex++];
+        song.stemFound[i] = true;
+        song.stemFiles[i] = directory.getChildFile(juce::String::fromUTF8(textArena.data() + record.fileName));
+        
+        auto& info = song.stemInfo[i];
+        info.valid = record.valid;
+        info.formatName = formatNames[record.formatName];
+        info.sampleRate = record.sampleRate;
+        info.lengthInSamples = record.lengthInSamples;
+        info.numChannels = record.numChannels;
+    }
+    
+    return song;
+}
+
+size_t SongCatalog::getMemoryUsage() const
+{
+    // Approximate heap cost of a juce::String: header plus UTF-8 payload
+    auto stringBytes = [](const juce::String& s) -> size_t {
+        return s.isEmpty() ? 0 : 16 + s.getNumBytesAsUTF8() + 1;
+    };
+    auto tableBytes = [&](const juce::StringArray& table) {
+        size_t total = static_cast<size_t>(table.size()) * sizeof(juce::String);
+        for (const auto& s : table)
+            total += stringBytes(s);
+        return total;
+    };
+    
+    size_t total = sizeof(*this);
+    total += entries.capacity() * sizeof(Entry);
+    total += stems.capacity() * sizeof(StemRecord);
+    total += textArena.capacity();
+    
+    for (const auto& entry : entries)
+        total += stringBytes(entry.name);
+    
+    total += tableBytes(directories) + tableBytes(formatNames)
+           + tableBytes(warnings) + tableBytes(durationLabels);
+    
+    for (const auto& label : stemLabels)
+        total += stringBytes(label);
+    
+    return total;
+}
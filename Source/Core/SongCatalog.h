@@ -0,0 +1,82 @@
+#pragma once
+
+#include <JuceHeader.h>
+#include "StemDetector.h"
+#include <unordered_map>
+
+// Compact list of scanned songs. Directories and format names are interned, stem file
+// names and case-folded sort keys live in one text arena, and the strings the song
+// list draws are built once at add time. Build it, call finishBuilding(), then share
+// it read-only; getSong() expands an entry back into a DetectedSong for loading.
+class SongCatalog
+{
+public:
+    SongCatalog();
+    ~SongCatalog() = default;
+
+    void addSong(const DetectedSong& song);
+    
+    // Sorts by the case-folded name and releases build-time lookup tables
+    void finishBuilding();
+    
+    int size() const { return static_cast<int>(entries.size()); }
+    bool isEmpty() const { return entries.empty(); }
+    
+    const juce::String& getName(int index) const { return entries[(size_t) index].name; }
+    const juce::String& getStemLabel(int index) const { return stemLabels[entries[(size_t) index].stemMask]; }
+    const juce::String& getWarning(int index) const { return warnings[entries[(size_t) index].warning]; }
+    const juce::String& getDurationLabel(int index) const { return durationLabels[entries[(size_t) index].durationLabel]; }
+    const juce::String& getDirectory(int index) const { return directories[(int) entries[(size_t) index].directory]; }
+    uint8_t getStemMask(int index) const { return entries[(size_t) index].stemMask; }
+    const char* getSortKey(int index) const { return textArena.data() + entries[(size_t) index].sortKey; }
+    
+    DetectedSong getSong(int index) const;
+    
+    size_t getMemoryUsage() const;
+    size_t getBytesPerSong() const { return entries.empty() ? 0 : getMemoryUsage() / entries.size(); }
+
+private:
+    struct Entry
+    {
+        juce::String name;
+        uint32_t sortKey;        // Arena offset of the case-folded name
+        uint32_t directory;      // Index into directories
+        uint32_t firstStem;      // Index of the first of this song's records in stems
+        uint32_t containerFile;  // Arena offset of the container file name, if container
+        uint16_t warning;        // Index into warnings, 0 = none
+        uint16_t durationLabel;  // Index into durationLabels, 0 = unknown
+        uint8_t stemMask;        // Bit i set if stem type i was found
+        bool container;          // Every stem comes from one multichannel file
+    };
+    
+    struct StemRecord
+    {
+        int64_t lengthInSamples;
+        uint32_t fileName;       // Arena offset of the file name within the song's directory
+        uint32_t sampleRate;
+        uint16_t formatName;     // Index into formatNames, 0 if unknown
+        uint8_t numChannels;
+        bool valid;
+    };
+    
+    uint32_t addText(const juce::String& text);
+    uint32_t internDirectory(const juce::File& directory);
+    static uint16_t intern(juce::StringArray& table, std::unordered_map<juce::String, uint16_t>& lookup,
+                           const juce::String& text);
+    
+    std::vector<Entry> entries;
+    std::vector<StemRecord> stems;      // One per found stem, in stem type order per song
+    std::vector<char> textArena;        // Null-terminated UTF-8
+    
+    juce::StringArray directories;
+    juce::StringArray formatNames;
+    juce::StringArray warnings;
+    juce::StringArray durationLabels;
+    std::array<juce::String, 1 << NUM_STEM_TYPES> stemLabels;
+    
+    // Only needed while building
+    std::unordered_map<juce::String, uint32_t> directoryLookup;
+    std::unordered_map<juce::String, uint16_t> formatLookup, warningLookup, durationLookup;
+    
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(SongCatalog)
+};
@@ -0,0 +1,114 @@
+#include "SongSearchIndex.h"
+
+void SongSearchIndex::clear()
+{
+    postings.clear();
+    songNames.clear();
+    scores.clear();
+}
+
+std::string SongSearchIndex::normalise(const juce::String& text)
+{
+    // Lower-case, with every run of non-alphanumeric characters collapsed into a
+    // single space and a leading space so that word starts form their own grams
+    std::string result(1, ' ');
+    result.reserve(static_cast<size_t>(text.length()) + 1);
+    
+    for (auto ptr = text.getCharPointer(); !ptr.isEmpty(); ++ptr)
+    {
+        auto c = juce::CharacterFunctions::toLowerCase(*ptr);
+        
+        if (juce::CharacterFunctions::isLetterOrDigit(c) && c < 128)
+            result += static_cast<char>(c);
+        else if (c >= 128)
+            result += static_cast<char>(0x80 | (c & 0x7f));  // Folded into one byte, good enough for grams
+        else if (result.back() != ' ')
+            result += ' ';
+    }
+    
+    return result;
+}
+
+void SongSearchIndex::collectGrams(const std::string& text, std::vector<uint32_t>& grams)
+{
+    grams.clear();
+    
+    auto byte = [&text](size_t i) { return static_cast<uint32_t>(static_cast<uint8_t>(text[i])); };
+    
+    for (size_t i = 0; i + 1 < text.size(); ++i)
+    {
+        // Word-start bigram, so single-character queries still hit the index
+        if (byte(i) == ' ')
+            grams.push_back((byte(i) << 8) | byte(i + 1));
+        
+        if (i + 2 < text.size())
+            grams.push_back(0x1000000u | (byte(i) << 16) | (byte(i + 1) << 8) | byte(i + 2));
+    }
+    
+    std::sort(grams.begin(), grams.end());
+    grams.erase(std::unique(grams.begin(), grams.end()), grams.end());
+}
+
+void SongSearchIndex::addSong(const juce::String& name, const juce::String& folder)
+{
+    const int songId = getNumSongs();
+    
+    auto normalisedName = normalise(name);
+    
+    std::vector<uint32_t> grams;
+    collectGrams(normalisedName + normalise(folder), grams);
+    
+    for (auto gram : grams)
+        postings[gram].push_back(songId);
+    
+    songNames.push_back(std::move(normalisedName));
+}
+
+void SongSearchIndex::search(const juce::String& query, std::vector<int>& results) const
+{
+    results.clear();
+    
+    auto normalisedQuery = normalise(query.trim());
+    if (normalisedQuery.size() < 2)
+        return;
+    
+    std::vector<uint32_t> grams;
+    collectGrams(normalisedQuery, grams);
+    
+    const int numGrams = juce::jmin(static_cast<int>(grams.size()), 255);
+    const int minScore = juce::jmax(1, numGrams - numGrams / 3);
+    
+    scores.assign(songNames.size(), 0);
+    
+    for (int g = 0; g < numGrams; ++g)
+    {
+        auto it = postings.find(grams[(size_t) g]);
+        if (it != postings.end())
+        {
+            for (int songId : it->second)
+                ++scores[(size_t) songId];
+        }
+    }
+    
+    // Rank = grams matched, doubled, plus one if the name contains the query verbatim.
+    // Bucketing by rank keeps the sort linear and preserves insertion order within a rank.
+    const int numRanks = numGrams * 2 + 2;
+    std::vector<std::vector<int>> buckets(static_cast<size_t>(numRanks));
+    auto needle = normalisedQuery.substr(1);
+    
+    for (size_t songId = 0; songId < scores.size(); ++songId)
+    {
+        const int score = scores[songId];
+        if (score < minScore)
+            continue;
+        
+        int rank = score * 2;
+        if (score == numGrams && songNames[songId].find(needle) != std::string::npos)
+            ++rank;
+        
+        buckets[(size_t) rank].push_back(static_cast<int>(songId));
+    }
+    
+    for (int rank = numRanks - 1; rank >= 0; --rank)
+        results.insert(results.end(), buckets[(size_t) rank].begin(), buckets[(size_t) rank].end());
+}
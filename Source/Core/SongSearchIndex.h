@@ -0,0 +1,34 @@
+#pragma once
+
+#include <JuceHeader.h>
+#include <unordered_map>
+
+// In-memory trigram index over song names and folder paths for as-you-type search.
+// Songs are identified by the order they were added, so results can index straight
+// into the caller's song list without copying any song records.
+class SongSearchIndex
+{
+public:
+    SongSearchIndex() = default;
+    ~SongSearchIndex() = default;
+
+    void clear();
+    
+    // Appends one song; its id is the number of songs added before it
+    void addSong(const juce::String& name, const juce::String& folder);
+    int getNumSongs() const { return static_cast<int>(songNames.size()); }
+    
+    // Fills results with matching song ids, best match first and in insertion order
+    // within equally ranked matches. Tolerates about one typo per three query characters.
+    void search(const juce::String& query, std::vector<int>& results) const;
+
+private:
+    static std::string normalise(const juce::String& text);
+    static void collectGrams(const std::string& text, std::vector<uint32_t>& grams);
+    
+    std::unordered_map<uint32_t, std::vector<int>> postings;  // Gram -> ascending song ids
+    std::vector<std::string> songNames;                        // Normalised, for substring ranking
+    mutable std::vector<uint8_t> scores;                       // Scratch space reused by search()
+    
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(SongSearchIndex)
+};
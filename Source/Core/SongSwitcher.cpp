@@ -0,0 +1,200 @@
+#include "SongSwitcher.h"
+
+SongSwitcher::SongSwitcher(StemEngine& e, MixMemory& memory)
+    : engine(e), mixMemory(memory)
+{
+    // Switches and requests come from the audio thread, which can't call back here
+    startTimerHz(20);
+}
+
+SongSwitcher::~SongSwitcher()
+{
+    stopTimer();
+    stopAutomationRecording();
+    rememberSong(false);
+}
+
+void SongSwitcher::setCatalog(std::shared_ptr<const SongCatalog> newCatalog)
+{
+    catalog = std::move(newCatalog);
+    prepareNextStandby();
+}
+
+void SongSwitcher::loadSong(int songIndex)
+{
+    if (catalog == nullptr || songIndex < 0 || songIndex >= catalog->size())
+        return;
+    
+    // A take belongs to the song it was recorded on
+    stopAutomationRecording();
+    rememberSong(false);
+    
+    const auto song = catalog->getSong(songIndex);
+    currentSong = { songIndex, song.getKey() };
+    engine.loadSong(song, songIndex, getSettings(currentSong.key));
+    
+    if (onSongChanged)
+        onSongChanged(engine.getCurrentSongName());
+    
+    prepareNextStandby();
+}
+
+void SongSwitcher::timerCallback()
+{
+    const int switches = engine.getStandbySwitchCount();
+    if (switches != handledSwitches)
+    {
+        handledSwitches = switches;
+        
+        // The standby song is playing now, and the standby slot holds the one it replaced
+        std::swap(currentSong, standbySong);
+        stopAutomationRecording();
+        rememberSong(true);
+        
+        // The screen moves to the new song's tracks before the previous ones are closed
+        engine.finishStandbySwitch([this]() {
+            if (onSongChanged)
+                onSongChanged(engine.getCurrentSongName());
+        });
+        
+        prepareNextStandby();
+    }
+    
+    const int request = engine.takeSongRequest();
+    if (request >= 0)
+        loadSong(request);
+}
+
+void SongSwitcher::prepareNextStandby()
+{
+    SongRef next;
+    DetectedSong song;
+    
+    // With nothing playing yet, the first song is next
+    if (catalog != nullptr && !catalog->isEmpty())
+    {
+        next.id = (engine.getCurrentSongId() + 1) % catalog->size();
+        song = catalog->getSong(next.id);
+        next.key = song.getKey();
+    }
+    
+    // A rescan can put another song at the standby song's place in the list
+    const bool onStandby = next.id == engine.getStandbySongId() && next.key == standbySong.key;
+    
+    if (next.id < 0 || next.id == engine.getCurrentSongId() || onStandby)
+    {
+        // Whatever is being opened isn't wanted any more
+        preparingSong = {};
+        ++standbyGeneration;
+        return;
+    }
+    
+    if (next.id == preparingSong.id && next.key == preparingSong.key)
+        return;
+    
+    preparingSong = next;
+    const int generation = ++standbyGeneration;
+    
+    // Opening and decoding the first block of every stem takes a while
+    standbyPool.addJob([&engine = engine, safeThis = juce::WeakReference<SongSwitcher>(this), generation,
+                        song, id = next.id, settings = getSettings(next.key)]() {
+        auto prepared = engine.openStandby(song, id, settings);
+        
+        juce::MessageManager::callAsync([safeThis, generation, prepared]() {
+            if (safeThis != nullptr)
+                safeThis->standbyOpened(generation, prepared);
+        });
+    });
+}
+
+void SongSwitcher::standbyOpened(int generation, std::shared_ptr<StemEngine::PreparedSong> prepared)
+{
+    // A newer song was asked for meanwhile
+    if (generation != standbyGeneration)
+        return;
+    
+    const auto opened = preparingSong;
+    preparingSong = {};
+    
+    if (engine.setStandby(std::move(prepared)))
+        standbySong = opened;
+}
+
+void SongSwitcher::startAutomationRecording()
+{
+    if (engine.getCurrentSongId() >= 0)
+        engine.startAutomationRecording();
+}
+
+void SongSwitcher::stopAutomationRecording()
+{
+    int songId = -1;
+    auto take = engine.stopAutomationRecording(songId);
+    const auto key = getKey(songId);
+    
+    if (take == nullptr || key.isEmpty())
+        return;
+    
+    MixAutomation::save(key, *take);
+    
+    // Another song may be playing by now; the take is loaded with its own song next time
+    if (songId == engine.getCurrentSongId())
+        engine.setAutomation(std::move(take));
+}
+
+void SongSwitcher::rememberSong(bool retired)
+{
+    int songId = -1;
+    const auto settings = engine.getSongSettings(retired, songId);
+    const auto key = getKey(songId);
+    
+    if (key.isNotEmpty())
+        mixMemory.remember(key, settings);
+}
+
+StemEngine::SongSettings SongSwitcher::getSettings(const juce::String& songKey) const
+{
+    auto settings = mixMemory.getSettings(songKey);
+    settings.automation = MixAutomation::load(songKey);
+    return settings;
+}
+
+juce::String SongSwitcher::getKey(int songId) const
+{
+    if (songId < 0)
+        return {};
+    
+    if (songId == currentSong.id)
+        return currentSong.key;
+    
+    return songId == standbySong.id ? standbySong.key : juce::String();
+}
+
+juce::StringArray SongSwitcher::getMixSnapshotNames() const
+{
+    return mixMemory.getSnapshotNames(getKey(engine.getCurrentSongId()));
+}
+
+void SongSwitcher::saveMixSnapshot(const juce::String& name)
+{
+    int songId = -1;
+    const auto settings = engine.getSongSettings(false, songId);
+    const auto key = getKey(songId);
+    
+    if (key.isNotEmpty() && name.isNotEmpty())
+        mixMemory.saveSnapshot(key, name, settings.mix);
+}
+
+void SongSwitcher::recallMixSnapshot(const juce::String& name)
+{
+    StemEngine::Mix mix;
+    if (mixMemory.getSnapshot(getKey(engine.getCurrentSongId()), name, mix))
+        engine.recallMix(mix, snapshotCrossfadeSeconds);
+}
+
+void SongSwitcher::removeMixSnapshot(const juce::String& name)
+{
+    const auto key = getKey(engine.getCurrentSongId());
+    if (key.isNotEmpty())
+        mixMemory.removeSnapshot(key, name);
+}
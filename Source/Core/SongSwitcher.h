@@ -0,0 +1,81 @@
+#pragma once
+
+#include <JuceHeader.h>
+#include "StemEngine.h"
+#include "SongCatalog.h"
+#include "MixMemory.h"
+
+// Selects songs from the scanned list by their place in it, for the song list and MIDI
+// program changes alike. The song after the playing one is kept open on standby, so
+// stepping through a set list switches within one audio block. It's opened on a background
+// thread; any other song is opened on the message thread, with the audio thread only
+// waiting for the swap. Each song is loaded with the mix and cues it was left
+// with and its recorded mix automation. Message thread only.
+class SongSwitcher : private juce::Timer
+{
+public:
+    SongSwitcher(StemEngine& engine, MixMemory& mixMemory);
+    ~SongSwitcher() override;
+    
+    void setCatalog(std::shared_ptr<const SongCatalog> newCatalog);
+    
+    // Loads the song at songIndex right away
+    void loadSong(int songIndex);
+    
+    // Records the playing song's mix moves until stopped, or until another song plays;
+    // the take then replaces the song's automation and is saved
+    void startAutomationRecording();
+    void stopAutomationRecording();
+    
+    // Named mixes of the playing song; recalling one crossfades to it
+    juce::StringArray getMixSnapshotNames() const;
+    void saveMixSnapshot(const juce::String& name);
+    void recallMixSnapshot(const juce::String& name);
+    void removeMixSnapshot(const juce::String& name);
+    
+    static constexpr double snapshotCrossfadeSeconds = 0.05;
+    
+    // Called whenever the playing song has changed, however it was selected
+    std::function<void(const juce::String& songName)> onSongChanged;
+
+private:
+    void timerCallback() override;
+    
+    // Opens the song after the playing one on standbyPool, unless it's already there
+    void prepareNextStandby();
+    void standbyOpened(int generation, std::shared_ptr<StemEngine::PreparedSong> prepared);
+    
+    // Saves the mix and cues of the playing song, or with retired, of the one a standby
+    // switch has just replaced
+    void rememberSong(bool retired);
+    
+    StemEngine::SongSettings getSettings(const juce::String& songKey) const;
+    
+    // Key of the current or standby song with this id, empty if neither
+    juce::String getKey(int songId) const;
+    
+    struct SongRef
+    {
+        int id { -1 };
+        juce::String key;
+    };
+    
+    StemEngine& engine;
+    MixMemory& mixMemory;
+    std::shared_ptr<const SongCatalog> catalog;
+    
+    // What the engine has; the catalog may have been replaced by a rescan since
+    SongRef currentSong;
+    SongRef standbySong;
+    int handledSwitches { 0 };
+    
+    // Song being opened for standby; results of older requests are dropped
+    SongRef preparingSong;
+    int standbyGeneration { 0 };
+    
+    // Last member, so a song still being opened is finished before the rest goes
+    juce::ThreadPool standbyPool { juce::ThreadPoolOptions{}.withThreadName("Standby song").withNumberOfThreadsToUse(1) };
+    
+    JUCE_DECLARE_WEAK_REFERENCEABLE(SongSwitcher)
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(SongSwitcher)
+};
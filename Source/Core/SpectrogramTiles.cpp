@@ -0,0 +1,312 @@
+#include "SpectrogramTiles.h"
+#include "StemPack.h"
+
+namespace
+{
+    constexpr double minFrequency = 30.0;
+    constexpr double maxFrequency = 16000.0;
+    constexpr float floorDb = -100.0f;
+    
+    // Dark to bright map for magnitudes from floorDb to 0 dB
+    const std::array<juce::Colour, 256>& getColourMap()
+    {
+        static const auto colourMap = []
+        {
+            juce::ColourGradient gradient(juce::Colour(0xff000004), 0.0f, 0.0f, juce::Colour(0xfffcfdbf), 1.0f, 0.0f, false);
+            gradient.addColour(0.25, juce::Colour(0xff3b0f70));
+            gradient.addColour(0.5, juce::Colour(0xff8c2981));
+            gradient.addColour(0.75, juce::Colour(0xfffe9f6d));
+            
+            std::array<juce::Colour, 256> colours;
+            for (size_t i = 0; i < colours.size(); ++i)
+                colours[i] = gradient.getColourAtPosition(static_cast<double>(i) / 255.0);
+            
+            return colours;
+        }();
+        
+        return colourMap;
+    }
+}
+
+bool SpectrogramTiles::Key::operator<(const Key& other) const
+{
+    return std::tie(path, firstChannel, level, index) < std::tie(other.path, other.firstChannel, other.level, other.index);
+}
+
+// Reads the stem's frames for one tile, mixes them to mono and renders the image
+class SpectrogramTiles::TileJob : public juce::ThreadPoolJob
+{
+public:
+    TileJob(SpectrogramTiles& t, Key k, int channels)
+        : juce::ThreadPoolJob("Spectrogram tile"), owner(t), key(std::move(k)), numStemChannels(channels)
+    {
+    }
+    
+    JobStatus runJob() override
+    {
+        // Scrolled past before its turn came
+        if (!owner.isStillWanted(key))
+            return jobHasFinished;
+        
+        // However the job ends, the tile is no longer queued, so asking again queues it anew
+        const juce::ScopeGuard unqueue { [this] { owner.removePending(key); } };
+        
+        auto reader = owner.takeReader(key.path);
+        if (reader == nullptr)
+            return jobHasFinished;
+        
+        // Handed back for the next tile of this file, however the job ends
+        const juce::ScopeGuard giveBack { [&] { owner.returnReader(key.path, std::move(reader)); } };
+        
+        const int hop = getHop(key.level);
+        const int64_t tileStart = static_cast<int64_t>(key.index) * getSamplesPerTile(key.level);
+        
+        // Consecutive windows overlap at fine levels, so read the whole span once;
+        // at coarse levels read just each frame's window
+        std::vector<float> mono;
+        const bool readWholeSpan = hop < fftSize;
+        if (readWholeSpan)
+            readMono(*reader, tileStart + hop / 2 - fftSize / 2, (tileColumns - 1) * hop + fftSize, mono);
+        
+        juce::dsp::FFT fft(fftOrder);
+        juce::dsp::WindowingFunction<float> window(fftSize, juce::dsp::WindowingFunction<float>::hann, false);
+        std::vector<float> fftData(2 * fftSize);
+        
+        const auto rowBins = getRowBins(reader->sampleRate);
+        const auto& colourMap = getColourMap();
+        const float fullScale = fftSize / 4.0f;  // Hann-windowed full-scale sine
+        
+        // Software image, so it can be drawn into off the message thread
+        juce::Image image(juce::Image::ARGB, tileColumns, tileRows, false, juce::SoftwareImageType());
+        {
+            juce::Image::BitmapData pixels(image, juce::Image::BitmapData::writeOnly);
+            
+            for (int x = 0; x < tileColumns; ++x)
+            {
+                if (shouldExit())
+                    return jobHasFinished;
+                
+                if (readWholeSpan)
+                    std::copy_n(mono.begin() + x * hop, fftSize, fftData.begin());
+                else
+                {
+                    readMono(*reader, tileStart + static_cast<int64_t>(x) * hop + hop / 2 - fftSize / 2, fftSize, mono);
+                    std::copy_n(mono.begin(), fftSize, fftData.begin());
+                }
+                
+                std::fill(fftData.begin() + fftSize, fftData.end(), 0.0f);
+                window.multiplyWithWindowingTable(fftData.data(), fftSize);
+                fft.performFrequencyOnlyForwardTransform(fftData.data(), true);
+                
+                for (int row = 0; row < tileRows; ++row)
+                {
+                    const auto first = fftData.begin() + rowBins[(size_t) row];
+                    const float magnitude = *std::max_element(first, fftData.begin() + rowBins[(size_t) row + 1]);
+                    const float db = juce::Decibels::gainToDecibels(magnitude / fullScale, floorDb);
+                    const int colour = juce::jlimit(0, 255, juce::roundToInt((1.0f - db / floorDb) * 255.0f));
+                    
+                    // Highest frequencies at the top
+                    pixels.setPixelColour(x, tileRows - 1 - row, colourMap[(size_t) colour]);
+                }
+            }
+        }
+        
+        owner.addTile(key, image);
+        return jobHasFinished;
+    }
+
+private:
+    // Mono mix of the stem's channels; frames outside the file are silent
+    void readMono(juce::AudioFormatReader& reader, int64_t start, int numSamples, std::vector<float>& dest)
+    {
+        dest.assign((size_t) numSamples, 0.0f);
+        
+        const int64_t readStart = juce::jmax<int64_t>(0, start);
+        const int64_t readEnd = juce::jmin(reader.lengthInSamples, start + numSamples);
+        if (readEnd <= readStart)
+            return;
+        
+        const int count = static_cast<int>(readEnd - readStart);
+        const int numChannels = juce::jmin(key.firstChannel + numStemChannels, static_cast<int>(reader.numChannels));
+        buffer.setSize(numChannels, count, false, false, true);
+        reader.read(buffer.getArrayOfWritePointers(), numChannels, readStart, count);
+        
+        float* out = dest.data() + (readStart - start);
+        const float gain = 1.0f / static_cast<float>(numStemChannels);
+        
+        for (int ch = 0; ch < numStemChannels; ++ch)
+            juce::FloatVectorOperations::addWithMultiply(out, buffer.getReadPointer(juce::jmin(key.firstChannel + ch, numChannels - 1)),
+                                                         gain, count);
+    }
+    
+    // FFT bins [rowBins[r], rowBins[r + 1]) feed row r; rows are spaced logarithmically
+    static std::vector<int> getRowBins(double sampleRate)
+    {
+        const double top = juce::jmin(maxFrequency, sampleRate * 0.5);
+        const double binWidth = sampleRate / fftSize;
+        std::vector<int> bins((size_t) tileRows + 1);
+        
+        for (int row = 0; row <= tileRows; ++row)
+        {
+            const double frequency = minFrequency * std::pow(top / minFrequency, static_cast<double>(row) / tileRows);
+            bins[(size_t) row] = juce::jlimit(1, fftSize / 2 - 1, static_cast<int>(frequency / binWidth));
+        }
+        
+        // Low rows are narrower than a bin; each still needs one to show
+        for (int row = 0; row < tileRows; ++row)
+            bins[(size_t) row + 1] = juce::jmax(bins[(size_t) row + 1], bins[(size_t) row] + 1);
+        
+        return bins;
+    }
+    
+    SpectrogramTiles& owner;
+    const Key key;
+    const int numStemChannels;
+    juce::AudioBuffer<float> buffer;
+    
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(TileJob)
+};
+
+SpectrogramTiles::SpectrogramTiles(size_t maximumTiles)
+    : maxTiles(juce::jmax<size_t>(1, maximumTiles))
+{
+    formatManager.registerBasicFormats();
+}
+
+SpectrogramTiles::~SpectrogramTiles()
+{
+    pool.removeAllJobs(true, 5000);
+    idleReaders.clear();
+}
+
+int SpectrogramTiles::chooseLevel(double samplesPerPixel)
+{
+    int level = 0;
+    
+    while (level + 1 < numLevels && getHop(level + 1) <= samplesPerPixel)
+        ++level;
+    
+    return level;
+}
+
+juce::Image SpectrogramTiles::getTile(const StemTrack& track, int level, int index)
+{
+    Key key { track.getFile().getFullPathName(), track.getFirstChannel(), level, index };
+    const juce::ScopedLock sl(lock);
+    
+    auto found = tiles.find(key);
+    if (found != tiles.end())
+    {
+        recentlyUsed.splice(recentlyUsed.begin(), recentlyUsed, found->second.position);
+        return found->second.image;
+    }
+    
+    // A file that couldn't be opened isn't tried again on every frame
+    auto failed = failedPaths.find(key.path);
+    if (failed != failedPaths.end())
+    {
+        if (juce::Time::getMillisecondCounter() - failed->second < failedRetryMs)
+            return {};
+        
+        failedPaths.erase(failed);
+    }
+    
+    auto [request, isNew] = pending.insert_or_assign(key, juce::Time::getMillisecondCounter());
+    if (isNew)
+        pool.addJob(new TileJob(*this, request->first, track.getNumChannels()), true);
+    
+    return {};
+}
+
+void SpectrogramTiles::addTile(const Key& key, const juce::Image& image)
+{
+    const juce::ScopedLock sl(lock);
+    
+    pending.erase(key);
+    
+    auto found = tiles.find(key);
+    if (found != tiles.end())
+    {
+        found->second.image = image;
+        recentlyUsed.splice(recentlyUsed.begin(), recentlyUsed, found->second.position);
+    }
+    else
+    {
+        recentlyUsed.push_front(key);
+        tiles[key] = { image, recentlyUsed.begin() };
+    }
+    
+    while (tiles.size() > maxTiles)
+    {
+        tiles.erase(recentlyUsed.back());
+        recentlyUsed.pop_back();
+    }
+    
+    ++version;
+}
+
+std::unique_ptr<juce::AudioFormatReader> SpectrogramTiles::takeReader(const juce::String& path)
+{
+    {
+        const juce::ScopedLock sl(lock);
+        
+        for (auto it = idleReaders.begin(); it != idleReaders.end(); ++it)
+        {
+            if (it->first == path)
+            {
+                auto reader = std::move(it->second);
+                idleReaders.erase(it);
+                return reader;
+            }
+        }
+    }
+    
+    // Opening reads the header, so it happens outside the lock
+    std::unique_ptr<juce::AudioFormatReader> reader(StemPack::createReaderFor(formatManager, juce::File(path)));
+    
+    if (reader == nullptr)
+    {
+        const juce::ScopedLock sl(lock);
+        failedPaths[path] = juce::Time::getMillisecondCounter();
+    }
+    
+    return reader;
+}
+
+void SpectrogramTiles::returnReader(const juce::String& path, std::unique_ptr<juce::AudioFormatReader> reader)
+{
+    std::unique_ptr<juce::AudioFormatReader> evicted;
+    
+    {
+        const juce::ScopedLock sl(lock);
+        idleReaders.emplace_front(path, std::move(reader));
+        
+        if (idleReaders.size() > maxIdleReaders)
+        {
+            evicted = std::move(idleReaders.back().second);
+            idleReaders.pop_back();
+        }
+    }
+}
+
+void SpectrogramTiles::removePending(const Key& key)
+{
+    const juce::ScopedLock sl(lock);
+    pending.erase(key);
+}
+
+bool SpectrogramTiles::isStillWanted(const Key& key)
+{
+    const juce::ScopedLock sl(lock);
+    
+    auto request = pending.find(key);
+    if (request == pending.end())
+        return false;
+    
+    if (juce::Time::getMillisecondCounter() - request->second < requestTimeoutMs)
+        return true;
+    
+    // Asking for it again queues a new job
+    pending.erase(request);
+    return false;
+}
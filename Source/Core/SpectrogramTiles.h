@@ -0,0 +1,88 @@
+#pragma once
+
+#include <JuceHeader.h>
+#include <list>
+#include <map>
+#include "StemTrack.h"
+
+// Spectrogram images of stems, computed on a background pool in fixed-size tiles
+// of tileColumns FFT frames by tileRows log-spaced frequency rows. Each zoom level
+// doubles the hop between frames, so zooming within a level and scrolling reuse
+// tiles that have already been computed. Tiles are kept in a bounded LRU store
+// shared by every stem; nothing here runs on the audio thread.
+class SpectrogramTiles
+{
+public:
+    static constexpr int fftOrder = 11;
+    static constexpr int fftSize = 1 << fftOrder;
+    static constexpr int tileColumns = 256;
+    static constexpr int tileRows = 256;
+    static constexpr int baseHop = 256;
+    static constexpr int numLevels = 8;
+    
+    explicit SpectrogramTiles(size_t maxTiles);
+    ~SpectrogramTiles();
+    
+    static int getHop(int level) { return baseHop << level; }
+    static int64_t getSamplesPerTile(int level) { return static_cast<int64_t>(tileColumns) * getHop(level); }
+    
+    // Coarsest level that still has at least one frame per pixel
+    static int chooseLevel(double samplesPerPixel);
+    
+    // Returns the tile if it has been computed, otherwise a null image. Missing tiles
+    // are queued; a queued tile that stops being asked for is dropped before it runs.
+    juce::Image getTile(const StemTrack& track, int level, int index);
+    
+    // Bumped every time a tile is added, so views know when to redraw
+    int getVersion() const { return version.load(); }
+
+private:
+    struct Key
+    {
+        juce::String path;
+        int firstChannel;
+        int level;
+        int index;
+        
+        bool operator<(const Key& other) const;
+    };
+    
+    struct Entry
+    {
+        juce::Image image;
+        std::list<Key>::iterator position;
+    };
+    
+    class TileJob;
+    
+    void addTile(const Key& key, const juce::Image& image);
+    // Readers are reused between tiles of a file; one reader serves one job at a time.
+    // Returns nullptr if the file can't be opened, which holds off its tiles for a while.
+    std::unique_ptr<juce::AudioFormatReader> takeReader(const juce::String& path);
+    void returnReader(const juce::String& path, std::unique_ptr<juce::AudioFormatReader> reader);
+    
+    void removePending(const Key& key);
+    bool isStillWanted(const Key& key);
+    
+    static constexpr juce::uint32 requestTimeoutMs = 1000;
+    static constexpr juce::uint32 failedRetryMs = 5000;
+    static constexpr size_t maxIdleReaders = 16;
+    
+    const size_t maxTiles;
+    
+    juce::CriticalSection lock;
+    std::map<Key, Entry> tiles;
+    std::list<Key> recentlyUsed;                 // Most recent first
+    std::map<Key, juce::uint32> pending;         // Time each queued tile was last asked for
+    std::map<juce::String, juce::uint32> failedPaths;  // Time each unopenable file last failed
+    
+    juce::AudioFormatManager formatManager;      // Shared by every job; only read once set up
+    std::list<std::pair<juce::String, std::unique_ptr<juce::AudioFormatReader>>> idleReaders;  // Most recent first
+    std::atomic<int> version { 0 };
+    
+    juce::ThreadPool pool { juce::ThreadPoolOptions{}
+                                .withThreadName("Spectrogram")
+                                .withDesiredThreadPriority(juce::Thread::Priority::low) };
+    
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(SpectrogramTiles)
+};
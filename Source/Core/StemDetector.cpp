@@ -1,6 +1,80 @@
 #include "StemDetector.h"
 #include <regex>
 
+juce::String DetectedSong::getKey() const
+{
+    if (isContainer())
+        return containerFile.getFullPathName();
+    
+    for (int i = 0; i < NUM_STEM_TYPES; ++i)
+        if (stemFound[i])
+            return stemFiles[i].getParentDirectory().getChildFile(songName).getFullPathName();
+    
+    return songName;
+}
+
+double DetectedSong::getDurationInSeconds() const
+{
+    double duration = 0.0;
+    for (int i = 0; i < NUM_STEM_TYPES; ++i)
+    {
+        if (stemFound[i] && stemInfo[i].valid)
+            duration = juce::jmax(duration, stemInfo[i].getLengthInSeconds());
+    }
+    return duration;
+}
+
+juce::String DetectedSong::getFormatWarning() const
+{
+    if (!probed)
+        return {};
+    
+    if (isContainer() && std::find(stemFound.begin(), stemFound.end(), true) == stemFound.end())
+        return "Unreadable stem container";
+    
+    juce::StringArray unreadable;
+    double firstSampleRate = 0.0;
+    double shortest = 0.0, longest = 0.0;
+    bool sampleRatesDiffer = false;
+    
+    for (int i = 0; i < NUM_STEM_TYPES; ++i)
+    {
+        if (!stemFound[i])
+            continue;
+        
+        const auto& info = stemInfo[i];
+        if (!info.valid)
+        {
+            unreadable.add(StemDetector::getStemTypeName(i));
+            continue;
+        }
+        
+        if (firstSampleRate <= 0.0)
+        {
+            firstSampleRate = info.sampleRate;
+            shortest = longest = info.getLengthInSeconds();
+        }
+        else
+        {
+            sampleRatesDiffer = sampleRatesDiffer || info.sampleRate != firstSampleRate;
+            shortest = juce::jmin(shortest, info.getLengthInSeconds());
+            longest = juce::jmax(longest, info.getLengthInSeconds());
+        }
+    }
+    
+    if (!unreadable.isEmpty())
+        return "Unreadable: " + unreadable.joinIntoString(", ");
+    
+    if (sampleRatesDiffer)
+        return "Sample rates differ";
+    
+    // Allow a little slack for encoder padding
+    if (longest - shortest > 1.0)
+        return "Lengths differ by " + juce::String(longest - shortest, 1) + "s";
+    
+    return {};
+}
+
 StemDetector::StemDetector()
 {
     regexPatterns = getDefaultPatterns();
@@ -11,6 +85,8 @@ StemDetector::StemDetector()
     audioExtensions.add(".flac");
     audioExtensions.add(".ogg");
     audioExtensions.add(".m4a");
+    audioExtensions.add(".mp4");
+    audioExtensions.add(".stempack");
 }
 
 std::array<juce::String, NUM_STEM_TYPES> StemDetector::getDefaultPatterns()
@@ -52,6 +128,50 @@ juce::String StemDetector::getStemTypeName(int index)
     return "Unknown";
 }
 
+bool StemDetector::isContainerFile(const juce::File& file)
+{
+    if (file.hasFileExtension("stempack"))
+        return true;
+    
+    auto name = file.getFileNameWithoutExtension().toLowerCase();
+    return name.endsWith(".stem") || name.endsWith(".stems");
+}
+
+std::array<int, NUM_STEM_TYPES> StemDetector::getContainerChannelLayout(int numChannels, int stemMask)
+{
+    std::array<int, NUM_STEM_TYPES> layout;
+    layout.fill(-1);
+    
+    if (stemMask != 0)
+    {
+        int channel = 0;
+        for (int i = 0; i < NUM_STEM_TYPES && channel < numChannels; ++i)
+        {
+            if ((stemMask & (1 << i)) != 0)
+            {
+                layout[(size_t) i] = channel;
+                channel += 2;
+            }
+        }
+        return layout;
+    }
+    
+    const int numPairs = juce::jmin(NUM_STEM_TYPES, numChannels / 2);
+    
+    if (numPairs <= 1)
+    {
+        if (numChannels > 0)
+            layout[static_cast<int>(StemType::Other)] = 0;
+        return layout;
+    }
+    
+    for (int pair = 0; pair < numPairs - 1; ++pair)
+        layout[(size_t) pair] = pair * 2;
+    
+    layout[static_cast<int>(StemType::Other)] = (numPairs - 1) * 2;
+    return layout;
+}
+
 void StemDetector::setPatterns(const std::array<juce::String, NUM_STEM_TYPES>& patterns)
 {
     regexPatterns = patterns;
@@ -146,6 +266,28 @@ juce::Array<DetectedSong> StemDetector::scanDirectory(const juce::File& director
             continue;
         
         juce::String filename = file.getFileName();
+        
+        if (isContainerFile(file))
+        {
+            // Strip ".stem"/".stems" as well as the extension
+            juce::String songName = file.getFileNameWithoutExtension();
+            if (!file.hasFileExtension("stempack"))
+                songName = songName.upToLastOccurrenceOf(".", false, false);
+            songName = songName.trim();
+            
+            if (songName.isNotEmpty())
+            {
+                auto& song = songMap[songName];
+                song.songName = songName;
+                song.containerFile = file;
+            }
+            continue;
+        }
+        
+        // Plain .mp4 files are only considered as stem containers
+        if (file.hasFileExtension("mp4"))
+            continue;
+        
         StemType stemType = detectStemType(filename);
         juce::String songName = extractSongName(filename, stemType);
         
@@ -174,15 +316,25 @@ juce::Array<DetectedSong> StemDetector::scanDirectory(const juce::File& director
             }
         }
         
+        // Only the master mix of a .stem.mp4 can be decoded, so loose stems of the same
+        // name win over it
+        if (hasAnyStem && pair.second.isContainer() && pair.second.containerFile.hasFileExtension("mp4"))
+            pair.second.containerFile = juce::File();
+        
+        // Any other container or stem pack supersedes loose stems of the same name; its
+        // stems are filled in from the channel layout once the file has been probed
+        if (pair.second.isContainer())
+        {
+            pair.second.stemFound.fill(false);
+            pair.second.stemFiles.fill(juce::File());
+            songs.add(std::move(pair.second));
+            continue;
+        }
+        
         if (hasAnyStem)
             songs.add(std::move(pair.second));
     }
     
-    // Sort by song name
-    std::sort(songs.begin(), songs.end(), 
-              [](const DetectedSong& a, const DetectedSong& b) {
-                  return a.songName.compareIgnoreCase(b.songName) < 0;
-              });
-    
+    // Not sorted here: SongCatalog sorts by its precomputed case-folded keys
     return songs;
 }
@@ -23,11 +23,40 @@ struct StemRegexPattern
     juce::String regex;  // Regex pattern to match this stem type
 };
 
+// Audio header information probed from a stem file during library scanning
+struct StemFileInfo
+{
+    juce::String formatName;      // Name of the AudioFormat that opened the file
+    double sampleRate { 0.0 };
+    int64_t lengthInSamples { 0 };
+    int numChannels { 0 };
+    int stemMask { 0 };           // Stem types held by a .stempack file, 0 for other formats
+    bool valid { false };         // false if no format could open the file
+    
+    double getLengthInSeconds() const { return sampleRate > 0.0 ? (double) lengthInSamples / sampleRate : 0.0; }
+};
+
 struct DetectedSong
 {
     juce::String songName;
     std::array<juce::File, NUM_STEM_TYPES> stemFiles;  // Fixed order: Vocals, Drums, Bass, Guitar, Piano, Other
     std::array<bool, NUM_STEM_TYPES> stemFound { false, false, false, false, false, false };
+    
+    // Set when all stems come from one multichannel file (e.g. "Song.stem.wav").
+    // LibraryIndex::probeSongs then fills stemFound/stemFiles/stemInfo from its channel layout.
+    juce::File containerFile;
+    
+    // Filled in by LibraryIndex::probeSongs
+    std::array<StemFileInfo, NUM_STEM_TYPES> stemInfo;
+    bool probed { false };
+    
+    bool isContainer() const { return containerFile != juce::File(); }
+    
+    // Identifies the song across scans: its container, or its folder and name
+    juce::String getKey() const;
+    
+    double getDurationInSeconds() const;
+    juce::String getFormatWarning() const;  // Empty if all stems open and match
 };
 
 class StemDetector
@@ -44,6 +73,17 @@ public:
     static std::array<juce::String, NUM_STEM_TYPES> getDefaultPatterns();
     static juce::String getStemTypeName(StemType type);
     static juce::String getStemTypeName(int index);
+    
+    // Files named "<song>.stem.<ext>" or "<song>.stems.<ext>" and stem packs
+    // ("<song>.stempack") hold every stem of a song
+    static bool isContainerFile(const juce::File& file);
+    
+    // First channel of each stem in a container with the given channel count, or -1.
+    // Stems are stereo pairs: 12 channels hold all six stem types in order, fewer pairs
+    // hold the leading types with the last pair as Other (so 8 channels = Vocals, Drums,
+    // Bass, Other). Files of one or two channels are a single Other stem.
+    // A non-zero stemMask (stem packs) names the stem types of the pairs explicitly.
+    static std::array<int, NUM_STEM_TYPES> getContainerChannelLayout(int numChannels, int stemMask = 0);
 
 private:
     StemType detectStemType(const juce::String& filename) const;
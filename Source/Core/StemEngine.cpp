@@ -1,8 +1,14 @@
 #include "StemEngine.h"
+#include "MidiLearnManager.h"
+#include "MixParameters.h"
+#include "WaveformBuilder.h"
 
 StemEngine::StemEngine()
 {
     formatManager.registerBasicFormats();
+    
+    for (auto& cue : cuePoints)
+        cue = -1;
 }
 
 StemEngine::~StemEngine()
@@ -12,31 +18,205 @@ StemEngine::~StemEngine()
 
 void StemEngine::prepareToPlay(double sampleRate, int samplesPerBlock)
 {
+    juce::ScopedLock sl(processLock);
+    
     currentSampleRate = sampleRate;
     currentBlockSize = samplesPerBlock;
     
-    for (int i = 0; i < NUM_STEM_TYPES; ++i)
+    for (auto& gain : trackGains)
+        gain.reset(sampleRate, gainRampSeconds);
+    
+    for (auto& source : sources)
+        source->prepareToPlay(sampleRate, samplesPerBlock);
+    
+    for (auto& source : standby.sources)
+        source->prepareToPlay(sampleRate, samplesPerBlock);
+    
+    updateTotalLength();
+}
+
+void StemEngine::releaseResources()
+{
+    for (auto& source : sources)
+        source->releaseResources();
+    
+    for (auto& source : standby.sources)
+        source->releaseResources();
+}
+
+void StemEngine::updateTotalLength()
+{
+    int64_t length = 0;
+    
+    for (const auto& source : sources)
+        length = juce::jmax(length, source->getTotalLengthInSamples());
+    
+    totalLengthInSamples = length;
+}
+
+void StemEngine::processBlock(juce::AudioBuffer<float>& buffer, juce::MidiBuffer& midiMessages,
+                              MidiLearnManager& midiLearn, MixParameters& mixParameters)
+{
+    juce::ScopedLock sl(processLock);
+    
+    std::array<float, NUM_STEM_TYPES> levels {};
+    const int numSamples = buffer.getNumSamples();
+    const int64_t blockEnd = sampleClock + numSamples;
+    int rendered = 0;
+    
+    auto renderUpTo = [&](int sample)
     {
-        if (tracks[i] != nullptr)
-            tracks[i]->prepareToPlay(sampleRate, samplesPerBlock);
+        sample = juce::jlimit(rendered, numSamples, sample);
+        if (sample > rendered)
+        {
+            renderBlock(buffer, rendered, sample - rendered, levels);
+            rendered = sample;
+        }
+    };
+    
+    buffer.clear();
+    midiLearn.beginBlock();
+    takePostedCommands();
+    
+    // Before anything posted for this block, so a change made in the UI meanwhile wins
+    mixParameters.applyHostChanges(*this);
+    
+    // Next automation event within the block, as a sample offset; numSamples if none
+    auto nextAutomationSample = [&]
+    {
+        if (!playing || automation == nullptr || automationMode != AutomationMode::Read)
+            return numSamples;
+        
+        syncAutomationCursor();
+        if (automationCursor >= automation->events.size())
+            return numSamples;
+        
+        const int64_t offset = getAutomationPosition(automationCursor) - currentPosition;
+        return offset < numSamples - rendered ? rendered + static_cast<int>(offset) : numSamples;
+    };
+    
+    // Split the render only where a due command, automation or a mapped MIDI event changes
+    // something; a block with none of them is rendered in one go
+    auto midiEvent = midiMessages.begin();
+    
+    for (;;)
+    {
+        while (midiEvent != midiMessages.end() && !midiLearn.isMapped((*midiEvent).getMessage()))
+            ++midiEvent;
+        
+        const bool commandDue = numScheduledCommands > 0 && scheduledCommands[0].sampleTime < blockEnd;
+        const bool midiDue = midiEvent != midiMessages.end();
+        const int automationSample = nextAutomationSample();
+        const bool automationDue = automationSample < numSamples;
+        
+        if (!commandDue && !midiDue && !automationDue)
+            break;
+        
+        const int commandSample = commandDue ? static_cast<int>(juce::jmax<int64_t>(0, scheduledCommands[0].sampleTime - sampleClock))
+                                             : numSamples;
+        const int midiSample = midiDue ? (*midiEvent).samplePosition : numSamples;
+        
+        // Posted commands go first when they fall on the same sample as MIDI, then automation,
+        // so a live move made at that sample has the last word
+        if (commandDue && commandSample <= midiSample && commandSample <= automationSample)
+        {
+            renderUpTo(commandSample);
+            applyCommand(scheduledCommands[0]);
+            removeFirstScheduledCommand();
+        }
+        else if (automationDue && automationSample <= midiSample)
+        {
+            renderUpTo(automationSample);
+            applyDueAutomation();
+        }
+        else
+        {
+            renderUpTo(midiSample);
+            midiLearn.handleMessage((*midiEvent).getMessage(), *this);
+            ++midiEvent;
+        }
     }
+    
+    renderUpTo(numSamples);
+    sampleClock = blockEnd;
+    
+    if (crossfadeRemaining > 0)
+    {
+        crossfadeRemaining -= numSamples;
+        if (crossfadeRemaining <= 0)
+            setGainRamp(gainRampSeconds);
+    }
+    publishState(levels);
+    mixParameters.captureMix(*this);
+    
+    midiMessages.clear();
+    midiLearn.writeFeedback(*this, numSamples, currentSampleRate, midiMessages);
 }
 
-void StemEngine::releaseResources()
+void StemEngine::takePostedCommands()
 {
-    for (int i = 0; i < NUM_STEM_TYPES; ++i)
+    Command command;
+    
+    while (postedCommands.pop(command))
     {
-        if (tracks[i] != nullptr)
-            tracks[i]->releaseResources();
+        if (command.sampleTime < sampleClock)
+            command.sampleTime = sampleClock;
+        
+        // Nowhere left to keep it; better late than lost
+        if (numScheduledCommands == maxScheduledCommands)
+        {
+            applyCommand(command);
+            continue;
+        }
+        
+        // Insert after everything due at the same time or earlier, keeping posting order
+        int index = numScheduledCommands;
+        while (index > 0 && scheduledCommands[(size_t) index - 1].sampleTime > command.sampleTime)
+        {
+            scheduledCommands[(size_t) index] = scheduledCommands[(size_t) index - 1];
+            --index;
+        }
+        
+        scheduledCommands[(size_t) index] = command;
+        ++numScheduledCommands;
     }
 }
 
-void StemEngine::processBlock(juce::AudioBuffer<float>& buffer)
+void StemEngine::removeFirstScheduledCommand()
 {
-    juce::ScopedLock sl(processLock);
+    std::move(scheduledCommands.begin() + 1, scheduledCommands.begin() + numScheduledCommands, scheduledCommands.begin());
+    --numScheduledCommands;
+}
+
+void StemEngine::publishState(const std::array<float, NUM_STEM_TYPES>& levels)
+{
+    auto& state = stateBuffer.getWriteBuffer();
     
-    buffer.clear();
+    state.version = ++stateVersion;
+    state.sampleTime = sampleClock;
+    state.playing = playing;
+    state.positionInSamples = currentPosition;
+    state.totalLengthInSamples = totalLengthInSamples;
+    state.sampleRate = currentSampleRate;
+    state.levels = levels;
     
+    for (int i = 0; i < numCuePoints; ++i)
+        state.cuePoints[(size_t) i] = cuePoints[(size_t) i];
+    
+    for (int i = 0; i < NUM_STEM_TYPES; ++i)
+    {
+        const auto* track = tracks[i].get();
+        state.volumes[i] = track != nullptr ? track->getVolume() : 0.0f;
+        state.muted[i] = track != nullptr && track->isMuted();
+        state.solo[i] = track != nullptr && track->isSolo();
+    }
+    
+    stateBuffer.publish();
+}
+
+void StemEngine::renderBlock(juce::AudioBuffer<float>& buffer, int startSample, int numSamples,
+                             std::array<float, NUM_STEM_TYPES>& levels)
+{
     bool hasAnyTrack = false;
     for (int i = 0; i < NUM_STEM_TYPES; ++i)
     {
@@ -70,150 +250,569 @@ void StemEngine::processBlock(juce::AudioBuffer<float>& buffer)
         }
     }
     
-    // Temporary buffer for each track
-    juce::AudioBuffer<float> trackBuffer(buffer.getNumChannels(), buffer.getNumSamples());
-    
     for (int i = 0; i < NUM_STEM_TYPES; ++i)
     {
-        if (tracks[i] == nullptr || !tracks[i]->isLoaded())
+        if (tracks[i] == nullptr)
             continue;
         
-        // Skip if another track is soloed and this one isn't
-        if (anySolo && !tracks[i]->isSolo())
+        // Silent when muted, or when another track is soloed and this one isn't
+        const bool audible = !tracks[i]->isMuted() && (!anySolo || tracks[i]->isSolo());
+        auto& gain = trackGains[(size_t) i];
+        gain.setTargetValue(audible ? tracks[i]->getVolume() : 0.0f);
+        
+        if (!gain.isSmoothing() && gain.getTargetValue() == 0.0f)
             continue;
         
-        trackBuffer.clear();
-        tracks[i]->getNextAudioBlock(trackBuffer, pos);
+        // Tracks sharing a container read the same decoded block
+        const auto& trackBlock = tracks[i]->readBlock(pos, numSamples);
+        const float startGain = gain.getCurrentValue();
+        const float endGain = gain.skip(numSamples);
         
-        // Mix into main buffer
+        // Mix into main buffer, mono stems feed every output channel
         for (int ch = 0; ch < buffer.getNumChannels(); ++ch)
         {
-            buffer.addFrom(ch, 0, trackBuffer, 
-                          ch < trackBuffer.getNumChannels() ? ch : 0,
-                          0, buffer.getNumSamples());
+            buffer.addFromWithRamp(ch, startSample,
+                                   trackBlock.getReadPointer(juce::jmin(ch, trackBlock.getNumChannels() - 1)),
+                                   numSamples, startGain, endGain);
         }
+        
+        levels[(size_t) i] = juce::jmax(levels[(size_t) i], trackBlock.getMagnitude(0, numSamples) * juce::jmax(startGain, endGain));
     }
     
     // Advance position
-    currentPosition = pos + buffer.getNumSamples();
+    currentPosition = pos + numSamples;
 }
 
-void StemEngine::loadSong(const juce::String& name, const std::array<juce::File, NUM_STEM_TYPES>& stemFiles,
-                          const std::array<bool, NUM_STEM_TYPES>& stemFound)
+void StemEngine::loadSong(const DetectedSong& song, int songId, const SongSettings& settings)
 {
-    juce::ScopedLock sl(processLock);
+    // Builders of the previous song stop between segments; don't make the audio thread wait on them
+    waveformPool.removeAllJobs(true, 5000);
     
-    stop();
-    unloadSong();
+    // Files are opened and peaks mapped before taking the lock, so the audio thread
+    // only waits for the swap
+    std::vector<std::shared_ptr<StemSource>> songSources;
+    TrackArray songTracks;
+    openSong(song, songSources, songTracks);
+    
+    std::array<int64_t, numCuePoints> songCues;
+    applySettings(settings, songTracks, songCues);
+    
+    for (auto& source : songSources)
+        source->prepareToPlay(currentSampleRate, currentBlockSize);
+    
+    {
+        juce::ScopedLock sl(processLock);
+        
+        playing = false;
+        currentPosition = 0;
+        currentSongName = song.songName;
+        currentSongId = songId;
+        sources.swap(songSources);
+        tracks.swap(songTracks);
+        automation = settings.automation;
+        automationCursor = 0;
+        
+        for (int i = 0; i < numCuePoints; ++i)
+            cuePoints[(size_t) i] = songCues[(size_t) i];
+        
+        for (int i = 0; i < NUM_STEM_TYPES; ++i)
+            trackLoaded[i] = tracks[i] != nullptr;
+        
+        updateTotalLength();
+        publishLoadedTracks();
+        publishState({});
+    }
     
-    currentSongName = name;
+    // The previous song is closed here, outside the lock
+    songTracks = {};
+    songSources.clear();
+    
+    startWaveformBuilds();
+}
+
+void StemEngine::openSong(const DetectedSong& song, std::vector<std::shared_ptr<StemSource>>& songSources, TrackArray& songTracks)
+{
+    // A container is opened once and every stem reads its channel pair from it
+    std::shared_ptr<StemSource> containerSource;
+    std::array<int, NUM_STEM_TYPES> containerLayout {};
+    
+    if (song.isContainer())
+    {
+        const StemFileInfo* probedInfo = nullptr;
+        for (int i = 0; i < NUM_STEM_TYPES && probedInfo == nullptr; ++i)
+            if (song.probed && song.stemFound[i])
+                probedInfo = &song.stemInfo[i];
+        
+        auto source = std::make_shared<StemSource>(song.containerFile);
+        if (source->open(formatManager, probedInfo))
+        {
+            containerLayout = StemDetector::getContainerChannelLayout(source->getNumChannels(), source->getStemMask());
+            containerSource = source;
+            songSources.push_back(source);
+        }
+    }
     
     for (int i = 0; i < NUM_STEM_TYPES; ++i)
     {
-        trackLoaded[i] = false;
-        tracks[i].reset();
+        songTracks[i].reset();
         
-        if (stemFound[i] && stemFiles[i].existsAsFile())
+        // Use fixed stem type name
+        juce::String stemType = StemDetector::getStemTypeName(i);
+        
+        if (containerSource != nullptr)
+        {
+            if (containerLayout[i] >= 0)
+            {
+                const int numChannels = juce::jmin(2, containerSource->getNumChannels() - containerLayout[i]);
+                songTracks[i] = std::make_unique<StemTrack>(containerSource, containerLayout[i], numChannels, stemType);
+            }
+        }
+        else if (song.stemFound[i] && song.stemFiles[i].existsAsFile())
         {
-            // Use fixed stem type name
-            juce::String stemType = StemDetector::getStemTypeName(i);
+            // Stems the library scan already found unreadable are not worth another attempt
+            if (song.probed && !song.stemInfo[i].valid)
+                continue;
             
-            auto track = std::make_unique<StemTrack>(stemFiles[i], stemType);
+            auto source = std::make_shared<StemSource>(song.stemFiles[i]);
             
-            if (track->loadFile(formatManager))
+            if (source->open(formatManager, song.probed ? &song.stemInfo[i] : nullptr))
             {
-                track->prepareToPlay(currentSampleRate, currentBlockSize);
-                
-                // Update total length
-                int64_t trackLength = track->getTotalLengthInSamples();
-                if (trackLength > totalLengthInSamples)
-                    totalLengthInSamples = trackLength;
-                
-                tracks[i] = std::move(track);
-                trackLoaded[i] = true;
+                songTracks[i] = std::make_unique<StemTrack>(source, 0, source->getNumChannels(), stemType);
+                songSources.push_back(source);
             }
         }
+        
+        if (songTracks[i] != nullptr)
+            songTracks[i]->createPeaks();
+    }
+}
+
+struct StemEngine::PreparedSong
+{
+    StandbySong song;
+};
+
+std::shared_ptr<StemEngine::PreparedSong> StemEngine::openStandby(const DetectedSong& song, int songId, const SongSettings& settings)
+{
+    double sampleRate = 0.0;
+    int blockSize = 0;
+    
+    {
+        juce::ScopedLock sl(processLock);
+        sampleRate = currentSampleRate;
+        blockSize = currentBlockSize;
+    }
+    
+    auto result = std::make_shared<PreparedSong>();
+    auto& prepared = result->song;
+    prepared.name = song.songName;
+    prepared.id = songId;
+    prepared.automation = settings.automation;
+    openSong(song, prepared.sources, prepared.tracks);
+    applySettings(settings, prepared.tracks, prepared.cuePoints);
+    
+    // Decoding the first block now warms the decoders and the disk cache, so the
+    // switch itself only swaps pointers
+    for (auto& source : prepared.sources)
+    {
+        source->prepareToPlay(sampleRate, blockSize);
+        source->readBlock(0, blockSize);
+        prepared.totalLengthInSamples = juce::jmax(prepared.totalLengthInSamples, source->getTotalLengthInSamples());
+    }
+    
+    prepared.ready = true;
+    return result;
+}
+
+bool StemEngine::setStandby(std::shared_ptr<PreparedSong> prepared)
+{
+    if (prepared == nullptr)
+        return false;
+    
+    {
+        juce::ScopedLock sl(processLock);
+        
+        // The previous song may still be on screen until the switch is finished
+        if (standby.retired)
+            return false;
+        
+        std::swap(standby, prepared->song);
+        standbySongId = standby.id;
+    }
+    
+    // The previous standby song is closed along with prepared, outside the lock
+    return true;
+}
+
+bool StemEngine::prepareStandby(const DetectedSong& song, int songId, const SongSettings& settings)
+{
+    return setStandby(openStandby(song, songId, settings));
+}
+
+void StemEngine::finishStandbySwitch(const std::function<void()>& tracksChanged)
+{
+    StandbySong previous;
+    
+    {
+        juce::ScopedLock sl(processLock);
+        
+        if (!standby.retired)
+            return;
+        
+        std::swap(standby, previous);
+        standbySongId = -1;
+        publishLoadedTracks();
+    }
+    
+    // The previous song's tracks stay open until the message thread has moved off them
+    if (tracksChanged != nullptr)
+        tracksChanged();
+    
+    // The builders of the song that was playing may still be running, and the new song's
+    // peaks may need building
+    waveformPool.removeAllJobs(true, 5000);
+    startWaveformBuilds();
+}
+
+void StemEngine::applySettings(const SongSettings& settings, TrackArray& songTracks,
+                               std::array<int64_t, numCuePoints>& songCues) const
+{
+    for (int i = 0; i < numCuePoints; ++i)
+    {
+        const double seconds = settings.cueSeconds[(size_t) i];
+        songCues[(size_t) i] = seconds >= 0.0 ? static_cast<int64_t>(seconds * currentSampleRate) : -1;
+    }
+    
+    if (!settings.hasMix)
+        return;
+    
+    for (int i = 0; i < NUM_STEM_TYPES; ++i)
+    {
+        if (auto& track = songTracks[(size_t) i])
+        {
+            track->setVolume(settings.mix.volumes[(size_t) i]);
+            track->setMuted(settings.mix.muted[(size_t) i]);
+            track->setSolo(settings.mix.solo[(size_t) i]);
+        }
+    }
+}
+
+StemEngine::SongSettings StemEngine::getSongSettings(bool retired, int& songId)
+{
+    juce::ScopedLock sl(processLock);
+    
+    SongSettings settings;
+    const auto& songTracks = retired ? standby.tracks : tracks;
+    songId = retired ? (standby.retired ? standby.id : -1) : currentSongId.load();
+    
+    if (songId < 0)
+        return settings;
+    
+    for (int i = 0; i < numCuePoints; ++i)
+    {
+        const int64_t cue = retired ? standby.cuePoints[(size_t) i] : cuePoints[(size_t) i].load();
+        settings.cueSeconds[(size_t) i] = cue >= 0 && currentSampleRate > 0 ? static_cast<double>(cue) / currentSampleRate : -1.0;
+    }
+    
+    for (int i = 0; i < NUM_STEM_TYPES; ++i)
+    {
+        if (const auto& track = songTracks[(size_t) i])
+        {
+            settings.mix.volumes[(size_t) i] = track->getVolume();
+            settings.mix.muted[(size_t) i] = track->isMuted();
+            settings.mix.solo[(size_t) i] = track->isSolo();
+        }
+    }
+    
+    settings.hasMix = true;
+    settings.automation = retired ? standby.automation : automation;
+    return settings;
+}
+
+void StemEngine::recallMix(const Mix& mix, double crossfadeSeconds)
+{
+    recalledMix.getWriteBuffer() = mix;
+    recalledMix.publish();
+    post({ Command::Type::RecallMix, -1, crossfadeSeconds });
+}
+
+void StemEngine::setGainRamp(double seconds)
+{
+    for (auto& gain : trackGains)
+    {
+        const float current = gain.getCurrentValue();
+        gain.reset(currentSampleRate, seconds);
+        gain.setCurrentAndTargetValue(current);
+    }
+}
+
+void StemEngine::switchToStandby()
+{
+    // Only moves pointers, so it's safe on the audio thread
+    currentSongName.swapWith(standby.name);
+    sources.swap(standby.sources);
+    tracks.swap(standby.tracks);
+    
+    for (int i = 0; i < NUM_STEM_TYPES; ++i)
+        trackLoaded[i] = tracks[i] != nullptr;
+    
+    for (int i = 0; i < numCuePoints; ++i)
+    {
+        const int64_t cue = cuePoints[(size_t) i];
+        cuePoints[(size_t) i] = standby.cuePoints[(size_t) i];
+        standby.cuePoints[(size_t) i] = cue;
+    }
+    
+    automation.swap(standby.automation);
+    automationCursor = 0;
+    
+    const int64_t length = standby.totalLengthInSamples;
+    standby.totalLengthInSamples = totalLengthInSamples;
+    totalLengthInSamples = length;
+    
+    const int id = standby.id;
+    standby.id = currentSongId;
+    currentSongId = id;
+    
+    // Holds the previous song until the message thread has let go of its tracks
+    standby.ready = false;
+    standby.retired = true;
+    currentPosition = 0;
+    ++standbySwitches;
+}
+
+void StemEngine::startWaveformBuilds()
+{
+    // Stems sharing a container are summarised from a single decode of it
+    std::vector<std::shared_ptr<WaveformBuilder::Build>> builds;
+    
+    for (const auto& source : sources)
+    {
+        std::vector<WaveformBuilder::Target> targets;
+        
+        for (const auto& track : tracks)
+        {
+            // Peaks mapped from the cache need no decoding at all
+            if (track != nullptr && &track->getSource() == source.get() && !track->getPeaks()->isComplete())
+                targets.push_back({ track->getPeaks(), track->getFirstChannel() });
+        }
+        
+        if (!targets.empty())
+            builds.push_back(std::make_shared<WaveformBuilder::Build>(source->getFile(), std::move(targets), peakSidecars));
     }
+    
+    if (builds.empty())
+        return;
+    
+    // Spread the pool over the files so a single container still uses every thread
+    const int jobsPerBuild = juce::jmax(1, waveformPool.getNumThreads() / static_cast<int>(builds.size()));
+    
+    for (const auto& build : builds)
+        for (int i = 0; i < juce::jmin(jobsPerBuild, build->numSegments); ++i)
+            waveformPool.addJob(new WaveformBuilder(build, waveformFocus), true);
+}
+
+void StemEngine::setWaveformFocus(double playhead, juce::Range<double> visibleRange)
+{
+    waveformFocus->playhead.store(playhead, std::memory_order_relaxed);
+    waveformFocus->visibleStart.store(visibleRange.getStart(), std::memory_order_relaxed);
+    waveformFocus->visibleEnd.store(visibleRange.getEnd(), std::memory_order_relaxed);
 }
 
 void StemEngine::unloadSong()
 {
+    waveformPool.removeAllJobs(true, 5000);
+    
     juce::ScopedLock sl(processLock);
     
     playing = false;
     currentPosition = 0;
     totalLengthInSamples = 0;
     currentSongName.clear();
+    currentSongId = -1;
+    automation.reset();
+    automationCursor = 0;
+    
+    for (auto& cue : cuePoints)
+        cue = -1;
     
     for (int i = 0; i < NUM_STEM_TYPES; ++i)
     {
         tracks[i].reset();
         trackLoaded[i] = false;
     }
+    
+    sources.clear();
+    publishLoadedTracks();
+    publishState({});
 }
 
-void StemEngine::play()
+bool StemEngine::post(const Command& command)
 {
-    bool hasAnyTrack = false;
-    for (int i = 0; i < NUM_STEM_TYPES; ++i)
+    const bool posted = tryPost(command);
+    jassert(posted);  // The audio thread isn't keeping up, or isn't running
+    return posted;
+}
+
+void StemEngine::applyCommand(const Command& command)
+{
+    switch (command.type)
     {
-        if (trackLoaded[i])
+        case Command::Type::Play:
+            if (std::any_of(trackLoaded.begin(), trackLoaded.end(), [](bool loaded) { return loaded; }))
+                playing = true;
+            break;
+        
+        case Command::Type::Pause:
+            playing = false;
+            break;
+        
+        case Command::Type::Stop:
+            playing = false;
+            currentPosition = 0;
+            break;
+        
+        case Command::Type::TogglePlayPause:
+            applyCommand({ playing ? Command::Type::Pause : Command::Type::Play });
+            break;
+        
+        case Command::Type::Rewind:
+            applyCommand({ Command::Type::SetPosition, -1, juce::jmax(0.0, getPositionInSeconds() - seekAmountSeconds) });
+            break;
+        
+        case Command::Type::FastForward:
+            applyCommand({ Command::Type::SetPosition, -1,
+                           juce::jmin(getTotalLengthInSeconds(), getPositionInSeconds() + seekAmountSeconds) });
+            break;
+        
+        case Command::Type::SetPosition:
+            if (currentSampleRate > 0)
+            {
+                int64_t newPos = static_cast<int64_t>(command.value * currentSampleRate);
+                currentPosition = juce::jlimit<int64_t>(0, totalLengthInSamples, newPos);
+            }
+            break;
+        
+        case Command::Type::SetPositionNormalized:
+            currentPosition = static_cast<int64_t>(juce::jlimit(0.0, 1.0, command.value) * totalLengthInSamples);
+            break;
+        
+        case Command::Type::SetTrackVolume:
+            if (auto* track = getTrack(command.trackIndex))
+                track->setVolume(static_cast<float>(command.value));
+            recordAutomation(command.trackIndex, MixAutomation::Volume);
+            break;
+        
+        case Command::Type::SetTrackMute:
+            if (auto* track = getTrack(command.trackIndex))
+                track->setMuted(command.value >= 0.5);
+            recordAutomation(command.trackIndex, MixAutomation::Mute);
+            break;
+        
+        case Command::Type::SetTrackSolo:
+            if (auto* track = getTrack(command.trackIndex))
+                track->setSolo(command.value >= 0.5);
+            recordAutomation(command.trackIndex, MixAutomation::Solo);
+            break;
+        
+        case Command::Type::ToggleMute:
+            if (auto* track = getTrack(command.trackIndex))
+                track->setMuted(!track->isMuted());
+            recordAutomation(command.trackIndex, MixAutomation::Mute);
+            break;
+        
+        case Command::Type::ToggleSolo:
+            if (auto* track = getTrack(command.trackIndex))
+                track->setSolo(!track->isSolo());
+            recordAutomation(command.trackIndex, MixAutomation::Solo);
+            break;
+        
+        case Command::Type::TriggerCue:
         {
-            hasAnyTrack = true;
+            const int cue = static_cast<int>(command.value);
+            if (cue < 0 || cue >= numCuePoints)
+                break;
+            
+            // Like a hot cue: an empty one is set to where we are
+            const int64_t cuePosition = cuePoints[(size_t) cue];
+            if (cuePosition < 0)
+                cuePoints[(size_t) cue] = currentPosition.load();
+            else
+                currentPosition = juce::jmin(cuePosition, totalLengthInSamples.load());
+            break;
+        }
+        
+        case Command::Type::RecallMix:
+        {
+            recalledMix.update();
+            const auto& mix = recalledMix.getReadBuffer();
+            
+            // The mix is linear in the gains, so ramping every stem's gain at once crossfades
+            // between the two mixes
+            setGainRamp(command.value);
+            crossfadeRemaining = static_cast<int>(command.value * currentSampleRate);
+            
+            for (int i = 0; i < NUM_STEM_TYPES; ++i)
+            {
+                applyCommand({ Command::Type::SetTrackVolume, i, mix.volumes[(size_t) i] });
+                applyCommand({ Command::Type::SetTrackMute, i, mix.muted[(size_t) i] ? 1.0 : 0.0 });
+                applyCommand({ Command::Type::SetTrackSolo, i, mix.solo[(size_t) i] ? 1.0 : 0.0 });
+            }
+            break;
+        }
+        
+        case Command::Type::SelectSong:
+        {
+            const int songId = static_cast<int>(command.value);
+            
+            // Anything else has to be opened first, which the message thread does
+            if (standby.ready && standby.id == songId)
+                switchToStandby();
+            else if (songId != currentSongId)
+                requestedSong = songId;
             break;
         }
     }
-    
-    if (hasAnyTrack)
-        playing = true;
+}
+
+void StemEngine::play()
+{
+    post({ Command::Type::Play });
 }
 
 void StemEngine::pause()
 {
-    playing = false;
+    post({ Command::Type::Pause });
 }
 
 void StemEngine::stop()
 {
-    playing = false;
-    currentPosition = 0;
+    post({ Command::Type::Stop });
 }
 
 void StemEngine::togglePlayPause()
 {
-    if (playing)
-        pause();
-    else
-        play();
+    post({ Command::Type::TogglePlayPause });
 }
 
 void StemEngine::rewind()
 {
-    double currentPos = getPositionInSeconds();
-    setPosition(juce::jmax(0.0, currentPos - seekAmountSeconds));
+    post({ Command::Type::Rewind });
 }
 
 void StemEngine::fastForward()
 {
-    double currentPos = getPositionInSeconds();
-    double totalLength = getTotalLengthInSeconds();
-    setPosition(juce::jmin(totalLength, currentPos + seekAmountSeconds));
+    post({ Command::Type::FastForward });
 }
 
 void StemEngine::setPosition(double positionInSeconds)
 {
-    if (currentSampleRate > 0)
-    {
-        int64_t newPos = static_cast<int64_t>(positionInSeconds * currentSampleRate);
-        currentPosition = juce::jlimit<int64_t>(0, totalLengthInSamples, newPos);
-    }
+    post({ Command::Type::SetPosition, -1, positionInSeconds });
 }
 
 void StemEngine::setPositionNormalized(double normalizedPosition)
 {
-    double clampedPos = juce::jlimit(0.0, 1.0, normalizedPosition);
-    int64_t newPos = static_cast<int64_t>(clampedPos * totalLengthInSamples);
-    currentPosition = newPos;
+    post({ Command::Type::SetPositionNormalized, -1, normalizedPosition });
 }
 
 double StemEngine::getPositionInSeconds() const
@@ -237,6 +836,12 @@ double StemEngine::getTotalLengthInSeconds() const
     return 0.0;
 }
 
+void StemEngine::getState(State& state)
+{
+    stateBuffer.update();
+    state = stateBuffer.getReadBuffer();
+}
+
 StemTrack* StemEngine::getTrack(int index)
 {
     if (index >= 0 && index < NUM_STEM_TYPES)
@@ -244,17 +849,29 @@ StemTrack* StemEngine::getTrack(int index)
     return nullptr;
 }
 
-bool StemEngine::isTrackLoaded(int index) const
+StemTrack* StemEngine::getLoadedTrack(int index) const
 {
     if (index >= 0 && index < NUM_STEM_TYPES)
-        return trackLoaded[index];
-    return false;
+        return loadedTracks[(size_t) index];
+    return nullptr;
+}
+
+bool StemEngine::isTrackLoaded(int index) const
+{
+    return getLoadedTrack(index) != nullptr;
+}
+
+void StemEngine::publishLoadedTracks()
+{
+    loadedSongName = currentSongName;
+    
+    for (int i = 0; i < NUM_STEM_TYPES; ++i)
+        loadedTracks[(size_t) i] = tracks[(size_t) i].get();
 }
 
 void StemEngine::setTrackVolume(int trackIndex, float volume)
 {
-    if (auto* track = getTrack(trackIndex))
-        track->setVolume(volume);
+    post({ Command::Type::SetTrackVolume, trackIndex, volume });
 }
 
 float StemEngine::getTrackVolume(int trackIndex) const
@@ -269,3 +886,170 @@ void StemEngine::updateSoloState()
     // This method can be called to refresh solo state if needed
     // The actual solo logic is in processBlock
 }
+
+void StemEngine::setAutomationPlayback(bool shouldPlay)
+{
+    auto expected = shouldPlay ? AutomationMode::Off : AutomationMode::Read;
+    automationMode.compare_exchange_strong(expected, shouldPlay ? AutomationMode::Read : AutomationMode::Off);
+}
+
+void StemEngine::setAutomation(std::shared_ptr<const MixAutomation> newAutomation)
+{
+    {
+        juce::ScopedLock sl(processLock);
+        automation.swap(newAutomation);
+        automationCursor = 0;
+    }
+    
+    // The previous automation is released here, outside the lock
+}
+
+void StemEngine::startAutomationRecording()
+{
+    std::vector<MixAutomation::Event> events;
+    events.reserve(maxRecordedEvents);
+    
+    juce::ScopedLock sl(processLock);
+    
+    recordedEvents.swap(events);
+    recordingSongId = currentSongId;
+    automationMode = AutomationMode::Write;
+    
+    // The take starts from the mix as it is now
+    for (int i = 0; i < NUM_STEM_TYPES; ++i)
+    {
+        recordAutomation(i, MixAutomation::Volume);
+        recordAutomation(i, MixAutomation::Mute);
+        recordAutomation(i, MixAutomation::Solo);
+    }
+}
+
+std::shared_ptr<MixAutomation> StemEngine::stopAutomationRecording(int& songId)
+{
+    auto take = std::make_shared<MixAutomation>();
+    
+    {
+        juce::ScopedLock sl(processLock);
+        
+        songId = recordingSongId;
+        if (automationMode != AutomationMode::Write)
+            return nullptr;
+        
+        take->events.swap(recordedEvents);
+        take->sampleRate = currentSampleRate;
+        recordingSongId = -1;
+        automationMode = AutomationMode::Read;
+    }
+    
+    // Moves made after seeking back come later in the take than they play
+    take->events.shrink_to_fit();
+    take->sort();
+    return take;
+}
+
+void StemEngine::recordAutomation(int stem, MixAutomation::Parameter parameter)
+{
+    const auto* track = getTrack(stem);
+    if (automationMode != AutomationMode::Write || track == nullptr || currentSongId != recordingSongId)
+        return;
+    
+    float value = track->getVolume();
+    if (parameter == MixAutomation::Mute)
+        value = track->isMuted() ? 1.0f : 0.0f;
+    else if (parameter == MixAutomation::Solo)
+        value = track->isSolo() ? 1.0f : 0.0f;
+    
+    const int64_t position = currentPosition;
+    
+    // A fader sends many values at one position while stopped; only the last counts
+    if (!recordedEvents.empty())
+    {
+        auto& last = recordedEvents.back();
+        if (last.position == position && last.stem == stem && last.parameter == parameter)
+        {
+            last.value = value;
+            return;
+        }
+    }
+    
+    // Never grows past what was reserved
+    if (recordedEvents.size() < recordedEvents.capacity())
+        recordedEvents.push_back({ position, value, static_cast<uint8_t>(stem), parameter });
+}
+
+int64_t StemEngine::getAutomationPosition(size_t index) const
+{
+    const int64_t position = automation->events[index].position;
+    
+    if (automation->sampleRate == currentSampleRate)
+        return position;
+    
+    return static_cast<int64_t>(static_cast<double>(position) * currentSampleRate / automation->sampleRate);
+}
+
+void StemEngine::syncAutomationCursor()
+{
+    const auto& events = automation->events;
+    const int64_t position = currentPosition;
+    
+    const bool behind = automationCursor < events.size() && getAutomationPosition(automationCursor) < position;
+    // Events at the position itself have just been applied, so only a later one means a jump back
+    const bool ahead = automationCursor > 0 && getAutomationPosition(automationCursor - 1) > position;
+    
+    if (!behind && !ahead)
+        return;
+    
+    size_t first = 0;
+    size_t count = events.size();
+    
+    while (count > 0)
+    {
+        const size_t step = count / 2;
+        if (getAutomationPosition(first + step) < position)
+        {
+            first += step + 1;
+            count -= step + 1;
+        }
+        else
+        {
+            count = step;
+        }
+    }
+    
+    automationCursor = first;
+    
+    // Latest value of each parameter before the new position, walking back from it
+    std::array<bool, 3 * NUM_STEM_TYPES> found {};
+    int remaining = static_cast<int>(found.size());
+    
+    for (size_t i = automationCursor; i-- > 0 && remaining > 0;)
+    {
+        const auto& event = events[i];
+        auto& seen = found[(size_t) event.parameter * NUM_STEM_TYPES + event.stem];
+        if (seen)
+            continue;
+        
+        seen = true;
+        --remaining;
+        applyAutomationEvent(event);
+    }
+}
+
+void StemEngine::applyDueAutomation()
+{
+    const auto& events = automation->events;
+    const int64_t position = currentPosition;
+    
+    while (automationCursor < events.size() && getAutomationPosition(automationCursor) <= position)
+        applyAutomationEvent(events[automationCursor++]);
+}
+
+void StemEngine::applyAutomationEvent(const MixAutomation::Event& event)
+{
+    switch (event.parameter)
+    {
+        case MixAutomation::Volume: applyCommand({ Command::Type::SetTrackVolume, event.stem, event.value }); break;
+        case MixAutomation::Mute:   applyCommand({ Command::Type::SetTrackMute, event.stem, event.value }); break;
+        case MixAutomation::Solo:   applyCommand({ Command::Type::SetTrackSolo, event.stem, event.value }); break;
+    }
+}
@@ -3,21 +3,172 @@
 #include <JuceHeader.h>
 #include "StemTrack.h"
 #include "StemDetector.h"
+#include "TripleBuffer.h"
+#include "MpscQueue.h"
+#include "WaveformBuilder.h"
+#include "MixAutomation.h"
+
+class MidiLearnManager;
+class MixParameters;
 
 class StemEngine
 {
 public:
+    static constexpr int numCuePoints = 8;
+    
+    // Everything the UI shows about the engine. Published by the audio thread once per
+    // block and read by the UI once per frame, so all values belong to the same block.
+    struct State
+    {
+        uint64_t version { 0 };         // Block counter; unchanged means nothing new
+        int64_t sampleTime { 0 };       // Engine sample clock at the end of the block
+        bool playing { false };
+        int64_t positionInSamples { 0 };
+        int64_t totalLengthInSamples { 0 };
+        double sampleRate { 44100.0 };
+        std::array<float, NUM_STEM_TYPES> volumes {};
+        std::array<bool, NUM_STEM_TYPES> muted {};
+        std::array<bool, NUM_STEM_TYPES> solo {};
+        std::array<float, NUM_STEM_TYPES> levels {};    // Peak level of the last block, after gain
+        std::array<int64_t, numCuePoints> cuePoints {}; // In samples, -1 if not set
+        
+        double getPositionInSeconds() const { return sampleRate > 0.0 ? static_cast<double>(positionInSamples) / sampleRate : 0.0; }
+        double getTotalLengthInSeconds() const { return sampleRate > 0.0 ? static_cast<double>(totalLengthInSamples) / sampleRate : 0.0; }
+        double getPositionNormalized() const { return totalLengthInSamples > 0 ? static_cast<double>(positionInSamples) / static_cast<double>(totalLengthInSamples) : 0.0; }
+    };
+    
+    // A transport or mixer change. Posted from any thread and applied by the audio thread
+    // in posting order, at sampleTime on the engine sample clock (see State::sampleTime)
+    // or at the start of the next block if that has already passed.
+    struct Command
+    {
+        enum class Type : uint8_t
+        {
+            Play,
+            Pause,
+            Stop,
+            TogglePlayPause,
+            Rewind,
+            FastForward,
+            SetPosition,            // value in seconds
+            SetPositionNormalized,  // value from 0 to 1
+            SetTrackVolume,         // trackIndex, value
+            SetTrackMute,           // trackIndex, value 0 or 1
+            SetTrackSolo,           // trackIndex, value 0 or 1
+            ToggleMute,             // trackIndex
+            ToggleSolo,             // trackIndex
+            TriggerCue,             // value is the cue number; jumps to it, or sets it if unset
+            RecallMix,              // value is the crossfade in seconds; see recallMix
+            SelectSong              // value is the song id; instant if it's the standby song
+        };
+        
+        Type type { Type::Play };
+        int trackIndex { -1 };
+        double value { 0.0 };
+        int64_t sampleTime { -1 };
+    };
+    
+    // Volume, mute and solo of every stem
+    struct Mix
+    {
+        std::array<float, NUM_STEM_TYPES> volumes { 1.0f, 1.0f, 1.0f, 1.0f, 1.0f, 1.0f };
+        std::array<bool, NUM_STEM_TYPES> muted {};
+        std::array<bool, NUM_STEM_TYPES> solo {};
+    };
+    
+    // A song's own settings: applied along with it as it's loaded, and read back when it's left
+    struct SongSettings
+    {
+        bool hasMix { false };  // Otherwise the default mix
+        Mix mix;
+        std::array<double, numCuePoints> cueSeconds { -1.0, -1.0, -1.0, -1.0, -1.0, -1.0, -1.0, -1.0 };  // -1 if not set
+        std::shared_ptr<const MixAutomation> automation;
+    };
+    
     StemEngine();
     ~StemEngine();
 
     void prepareToPlay(double sampleRate, int samplesPerBlock);
     void releaseResources();
-    void processBlock(juce::AudioBuffer<float>& buffer);
+    // Applies mapped MIDI and automation at the exact sample of each event by splitting the render there;
+    // a block without such events is rendered in one go. The MIDI is then replaced by
+    // feedback for the controller, written while the tracks can't change under it.
+    // Host parameter changes apply at the start of the block.
+    void processBlock(juce::AudioBuffer<float>& buffer, juce::MidiBuffer& midiMessages,
+                      MidiLearnManager& midiLearn, MixParameters& mixParameters);
     
-    void loadSong(const juce::String& name, const std::array<juce::File, NUM_STEM_TYPES>& stemFiles,
-                  const std::array<bool, NUM_STEM_TYPES>& stemFound);
+    // Opens the song and replaces the current one. Playback stops, but the audio thread
+    // only waits for the swap, not for the files. songId is the caller's number for it
+    // (e.g. its place in the song list).
+    void loadSong(const DetectedSong& song, int songId, const SongSettings& settings);
     void unloadSong();
     
+    // A song opened by openStandby, not yet handed to the engine
+    struct PreparedSong;
+    
+    // Opens a song and reads its first block without touching the playing one, so a SelectSong
+    // command for songId can later switch to it within a block. Any thread; it's slow.
+    std::shared_ptr<PreparedSong> openStandby(const DetectedSong& song, int songId, const SongSettings& settings);
+    
+    // Makes a prepared song the standby song, replacing any previous one. Returns false,
+    // leaving the standby slot as it was, while a standby switch is waiting for
+    // finishStandbySwitch.
+    bool setStandby(std::shared_ptr<PreparedSong> prepared);
+    
+    // Both of the above in one go
+    bool prepareStandby(const DetectedSong& song, int songId, const SongSettings& settings);
+    int getStandbySongId() const { return standbySongId; }
+    int getCurrentSongId() const { return currentSongId; }
+    
+    // Counts switches to the standby song. Once it changes, the message thread should call
+    // finishStandbySwitch, which hands it the new song's tracks and name, calls tracksChanged
+    // so it can let go of the previous song's tracks, and then closes the previous song.
+    int getStandbySwitchCount() const { return standbySwitches; }
+    void finishStandbySwitch(const std::function<void()>& tracksChanged);
+    
+    // Mix and cues of the current song or, with retired, of the song a standby switch replaced
+    // until finishStandbySwitch. songId is set to which song it is, -1 if there is none.
+    SongSettings getSongSettings(bool retired, int& songId);
+    
+    // Replaces the whole mix at once at the start of the next block, crossfading from the
+    // current one. Message thread only.
+    void recallMix(const Mix& mix, double crossfadeSeconds);
+    
+    // Song asked for with SelectSong that wasn't the standby song, or -1; clears the request
+    int takeSongRequest() { return requestedSong.exchange(-1); }
+    
+    // Mix automation of the current song. Read plays it back, sample-accurately and from
+    // wherever playback starts; Write records every volume, mute and solo change (from
+    // the UI, MIDI or the host) at the position it was made.
+    enum class AutomationMode { Off, Read, Write };
+    AutomationMode getAutomationMode() const { return automationMode; }
+    
+    // Switches between Off and Read; ignored while recording
+    void setAutomationPlayback(bool shouldPlay);
+    
+    // Replaces the current song's automation
+    void setAutomation(std::shared_ptr<const MixAutomation> newAutomation);
+    
+    // Starts recording, beginning with the mix as it is now. Changes stop being recorded
+    // once another song plays.
+    void startAutomationRecording();
+    
+    // Ends recording and switches to Read; returns the sorted take, or nullptr if nothing
+    // was being recorded, and the id of the song it belongs to
+    std::shared_ptr<MixAutomation> stopAutomationRecording(int& songId);
+    
+    // Queues a command without blocking; returns false if the queue is full
+    bool post(const Command& command);
+    
+    // Same, for senders that can outrun the audio thread (e.g. OSC), where a full queue
+    // is expected under load rather than a bug
+    bool tryPost(const Command& command) { return postedCommands.push(command); }
+    
+    // Applies a command immediately. Audio thread only, from within processBlock
+    // (e.g. for MIDI, which is already timed to the sample)
+    void applyCommand(const Command& command);
+    
+    // Shorthands that post a command
     void play();
     void pause();
     void stop();
@@ -35,34 +186,148 @@ public:
     double getPositionNormalized() const;
     double getTotalLengthInSeconds() const;
     
-    const juce::String& getCurrentSongName() const { return currentSongName; }
+    // Message thread; only changes with loadSong, unloadSong and finishStandbySwitch
+    juce::String getCurrentSongName() const { return loadedSongName; }
+    
+    // Latest published state. Wait-free; only one thread (the frame scheduler) may call it.
+    void getState(State& state);
     
     static constexpr int getNumTracks() { return NUM_STEM_TYPES; }
+    
+    // Tracks of the playing song. Audio thread only, from within processBlock, since a
+    // standby switch swaps them there.
     StemTrack* getTrack(int index);
+    
+    // Tracks as handed to the message thread. Like getCurrentSongName, they only change with
+    // loadSong, unloadSong and finishStandbySwitch.
+    StemTrack* getLoadedTrack(int index) const;
     bool isTrackLoaded(int index) const;
     
     void setTrackVolume(int trackIndex, float volume);
     float getTrackVolume(int trackIndex) const;
     
+    // Position of a cue in samples, or -1 if it isn't set
+    int64_t getCuePoint(int index) const { return index >= 0 && index < numCuePoints ? cuePoints[(size_t) index].load() : -1; }
+    
     void updateSoloState();
+    
+    // Write finished waveform peaks next to the stems instead of the application cache
+    void setPeakSidecars(bool shouldUseSidecars) { peakSidecars = shouldUseSidecars; }
+    
+    // Playhead and visible window (normalised) that waveform building works outwards from
+    void setWaveformFocus(double playhead, juce::Range<double> visibleRange);
 
 private:
+    using TrackArray = std::array<std::unique_ptr<StemTrack>, NUM_STEM_TYPES>;
+    
     juce::AudioFormatManager formatManager;
     
+    void updateTotalLength();
+    // Mixes numSamples from the current position into the buffer at startSample and advances
+    void renderBlock(juce::AudioBuffer<float>& buffer, int startSample, int numSamples,
+                     std::array<float, NUM_STEM_TYPES>& levels);
+    
+    // For a song that isn't playing yet
+    void applySettings(const SongSettings& settings, TrackArray& songTracks, std::array<int64_t, numCuePoints>& songCues) const;
+    
+    // Ramp length for gain changes from now on, continuing from the current gains
+    void setGainRamp(double seconds);
+    
+    // Only called with processLock held, which keeps it to one writer at a time
+    void publishState(const std::array<float, NUM_STEM_TYPES>& levels);
+    
+    // Moves posted commands into scheduledCommands, ordered by time; audio thread only
+    void takePostedCommands();
+    void removeFirstScheduledCommand();
+    void startWaveformBuilds();
+    
+    // Opens the song's files into the given sources and tracks and maps their cached peaks
+    void openSong(const DetectedSong& song, std::vector<std::shared_ptr<StemSource>>& songSources, TrackArray& songTracks);
+    
+    // Swaps the standby song in; audio thread, with processLock held
+    void switchToStandby();
+    
+    // Copies the playing song's name and tracks for the message thread; with processLock held
+    void publishLoadedTracks();
+    
+    // Audio thread, with processLock held. The cursor is moved with a search only after
+    // the position has jumped, and the mix is then brought to where the automation has it.
+    void syncAutomationCursor();
+    int64_t getAutomationPosition(size_t index) const;
+    void applyDueAutomation();
+    void applyAutomationEvent(const MixAutomation::Event& event);
+    void recordAutomation(int stem, MixAutomation::Parameter parameter);
+    
     juce::String currentSongName;
-    std::array<std::unique_ptr<StemTrack>, NUM_STEM_TYPES> tracks;
+    std::vector<std::shared_ptr<StemSource>> sources;  // One per opened file
+    TrackArray tracks;
     std::array<bool, NUM_STEM_TYPES> trackLoaded { false, false, false, false, false, false };
     
+    // What the message thread sees of the song, never touched by the audio thread
+    juce::String loadedSongName;
+    std::array<StemTrack*, NUM_STEM_TYPES> loadedTracks {};
+    std::array<std::atomic<int64_t>, numCuePoints> cuePoints;
+    std::atomic<int> currentSongId { -1 };
+    
+    // Song opened ahead of time. After a switch it holds the previous song (retired)
+    // until finishStandbySwitch; ready says whether it can be switched to.
+    struct StandbySong
+    {
+        juce::String name;
+        int id { -1 };
+        std::vector<std::shared_ptr<StemSource>> sources;
+        TrackArray tracks;
+        int64_t totalLengthInSamples { 0 };
+        std::array<int64_t, numCuePoints> cuePoints {};
+        std::shared_ptr<const MixAutomation> automation;
+        bool ready { false };
+        bool retired { false };
+    };
+    
+    StandbySong standby;
+    std::atomic<int> standbySongId { -1 };
+    std::atomic<int> standbySwitches { 0 };
+    std::atomic<int> requestedSong { -1 };
+    
+    std::atomic<AutomationMode> automationMode { AutomationMode::Read };
+    std::shared_ptr<const MixAutomation> automation;
+    size_t automationCursor { 0 };                      // First event not applied yet
+    std::vector<MixAutomation::Event> recordedEvents;   // Reserved before recording starts
+    int recordingSongId { -1 };
+    static constexpr size_t maxRecordedEvents = 1 << 18;
+    
     std::atomic<bool> playing { false };
     std::atomic<int64_t> currentPosition { 0 };
-    int64_t totalLengthInSamples { 0 };
+    std::atomic<int64_t> totalLengthInSamples { 0 };
     
-    double currentSampleRate { 44100.0 };
+    std::atomic<double> currentSampleRate { 44100.0 };
     int currentBlockSize { 512 };
     double seekAmountSeconds { 5.0 };
     
+    // Gain of each stem including mute and solo, ramped so changes don't click
+    static constexpr double gainRampSeconds = 0.02;
+    std::array<juce::SmoothedValue<float>, NUM_STEM_TYPES> trackGains;
+    int crossfadeRemaining { 0 };  // Samples until gain changes get the usual ramp again
+    TripleBuffer<Mix> recalledMix;
+    bool peakSidecars { false };
+    
     juce::CriticalSection processLock;
     
+    TripleBuffer<State> stateBuffer;
+    uint64_t stateVersion { 0 };
+    
+    MpscQueue<Command, 1024> postedCommands;
+    static constexpr int maxScheduledCommands = 256;
+    std::array<Command, maxScheduledCommands> scheduledCommands;
+    int numScheduledCommands { 0 };
+    int64_t sampleClock { 0 };  // Samples rendered since the engine was created
+    
+    // Builds peak pyramids for the loaded song; all files at once, several jobs each
+    std::shared_ptr<WaveformFocus> waveformFocus { std::make_shared<WaveformFocus>() };
+    juce::ThreadPool waveformPool { juce::ThreadPoolOptions{}
+                                        .withThreadName("Waveforms")
+                                        .withDesiredThreadPriority(juce::Thread::Priority::low) };
+    
     JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(StemEngine)
 };
 
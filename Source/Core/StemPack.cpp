@@ -0,0 +1,661 @@
+#include "StemPack.h"
+#include "ParallelFor.h"
+
+namespace
+{
+    constexpr char packMagic[4] = { 'S', 'T', 'P', 'K' };
+    constexpr int packVersion = 1;
+    constexpr int channelsPerStem = 2;
+    constexpr int headerSize = 4 + 4 + 8 + 4 + 4 + 8 + 4 + 8;
+    constexpr int indexEntrySize = 8 + 4;
+    
+    int getNumChannelsForMask(int stemMask)
+    {
+        return juce::countNumberOfBits(static_cast<juce::uint32>(stemMask)) * channelsPerStem;
+    }
+    
+    int getBytesPerSample(StemPack::Codec codec)
+    {
+        return codec == StemPack::Codec::Float ? 4 : 3;
+    }
+    
+    // Decodes blocks ahead of playback for every pack reader with read-ahead on
+    juce::TimeSliceThread& getReadAheadThread()
+    {
+        struct ReadAheadThread : juce::TimeSliceThread
+        {
+            ReadAheadThread() : juce::TimeSliceThread("Stem pack read-ahead") { startThread(juce::Thread::Priority::high); }
+        };
+        
+        static ReadAheadThread thread;
+        return thread;
+    }
+}
+
+bool StemPack::isStemPackFile(const juce::File& file)
+{
+    return file.hasFileExtension(fileExtension);
+}
+
+juce::AudioFormatReader* StemPack::createReaderFor(juce::AudioFormatManager& formatManager, const juce::File& file)
+{
+    if (isStemPackFile(file))
+        return StemPackReader::open(file).release();
+    
+    return formatManager.createReaderFor(file);
+}
+
+// StemPackReader implementation
+std::unique_ptr<StemPackReader> StemPackReader::open(const juce::File& file)
+{
+    auto stream = file.createInputStream();
+    
+    if (stream == nullptr)
+        return nullptr;
+    
+    std::unique_ptr<StemPackReader> reader(new StemPackReader(stream.release(), file));
+    
+    if (!reader->readHeader())
+        return nullptr;
+    
+    return reader;
+}
+
+StemPackReader::StemPackReader(juce::InputStream* stream, const juce::File& f)
+    : juce::AudioFormatReader(stream, StemPack::formatName),
+      file(f)
+{
+}
+
+StemPackReader::~StemPackReader()
+{
+    // Waits for a decode in progress to finish
+    if (readAhead)
+        getReadAheadThread().removeTimeSliceClient(this);
+}
+
+bool StemPackReader::readHeader()
+{
+    char magic[4];
+    if (input->read(magic, 4) != 4 || std::memcmp(magic, packMagic, 4) != 0)
+        return false;
+    
+    if (input->readInt() != packVersion)
+        return false;
+    
+    sampleRate = input->readDouble();
+    stemMask = static_cast<juce::uint8>(input->readByte());
+    const int storedChannelsPerStem = input->readByte();
+    const int storedCodec = input->readByte();
+    input->readByte();
+    blockFrames = input->readInt();
+    lengthInSamples = input->readInt64();
+    const int numBlocks = input->readInt();
+    const juce::int64 indexOffset = input->readInt64();
+    
+    if (sampleRate <= 0.0 || stemMask <= 0 || stemMask >= (1 << NUM_STEM_TYPES)
+        || storedChannelsPerStem != channelsPerStem
+        || storedCodec > static_cast<int>(StemPack::Codec::Float)
+        || blockFrames < 256 || blockFrames > (1 << 20)
+        || lengthInSamples <= 0
+        || numBlocks != static_cast<int>((lengthInSamples + blockFrames - 1) / blockFrames)
+        || indexOffset < headerSize
+        || indexOffset + static_cast<juce::int64>(numBlocks) * indexEntrySize > input->getTotalLength())
+        return false;
+    
+    codec = static_cast<StemPack::Codec>(storedCodec);
+    numChannels = static_cast<unsigned int>(getNumChannelsForMask(stemMask));
+    bitsPerSample = 32;
+    usesFloatingPointData = true;
+    
+    // The whole seek index is kept in memory so any seek is a single lookup
+    if (!input->setPosition(indexOffset))
+        return false;
+    
+    index.resize(static_cast<size_t>(numBlocks));
+    
+    for (auto& entry : index)
+    {
+        entry.offset = input->readInt64();
+        entry.size = static_cast<uint32_t>(input->readInt());
+        
+        if (entry.offset < headerSize || entry.offset + entry.size > indexOffset)
+            return false;
+        
+        largestBlock = juce::jmax(largestBlock, entry.size);
+    }
+    
+    allocate(blocks[0]);
+    return true;
+}
+
+void StemPackReader::allocate(Block& block) const
+{
+    block.raw.malloc(largestBlock);
+    block.decoded.malloc(static_cast<size_t>(blockFrames) * numChannels * static_cast<size_t>(getBytesPerSample(codec)));
+    block.samples.setSize(static_cast<int>(numChannels), blockFrames);
+}
+
+void StemPackReader::setReadAhead()
+{
+    jassert(!readAhead);
+    
+    // The background thread reads through its own stream, so it never moves the reader's
+    aheadInput = file.createInputStream();
+    
+    if (aheadInput == nullptr)
+        return;
+    
+    allocate(blocks[1]);
+    loadBlock(*input, 0, blocks[0]);
+    readAhead = true;
+    
+    requestBlock(1);
+    getReadAheadThread().addTimeSliceClient(this);
+}
+
+void StemPackReader::requestBlock(int blockIndex)
+{
+    if (blockIndex >= static_cast<int>(index.size()))
+        return;
+    
+    // Only the reading thread requests; the background thread only moves requested on
+    // to decoding and decoding on to ready, so a decode in progress is never disturbed
+    aheadBlock.store(blockIndex);
+    
+    int state = aheadState.load();
+    while (state != aheadDecoding && !aheadState.compare_exchange_weak(state, aheadRequested))
+    {
+    }
+}
+
+int StemPackReader::useTimeSlice()
+{
+    int state = aheadRequested;
+    if (!aheadState.compare_exchange_strong(state, aheadDecoding))
+        return 5;
+    
+    auto& block = blocks[1 - current.load()];
+    
+    if (!loadBlock(*aheadInput, aheadBlock.load(), block))
+        block.index = -1;
+    
+    aheadState.store(aheadReady);
+    return 0;
+}
+
+bool StemPackReader::loadBlock(juce::InputStream& stream, int blockIndex, Block& block)
+{
+    block.index = -1;
+    
+    const auto& entry = index[(size_t) blockIndex];
+    const int numFrames = static_cast<int>(juce::jmin(static_cast<juce::int64>(blockFrames),
+                                                      lengthInSamples - static_cast<juce::int64>(blockIndex) * blockFrames));
+    const int bytesPerSample = getBytesPerSample(codec);
+    const int bytesPerChannel = numFrames * bytesPerSample;
+    const int expectedSize = bytesPerChannel * static_cast<int>(numChannels);
+    
+    // One sequential read returns every stem for this stretch of time
+    if (!stream.setPosition(entry.offset)
+        || stream.read(block.raw.getData(), static_cast<int>(entry.size)) != static_cast<int>(entry.size))
+        return false;
+    
+    const uint8_t* bytes = block.raw.getData();
+    const bool deltaCoded = codec == StemPack::Codec::Deflate;
+    
+    if (deltaCoded)
+    {
+        juce::MemoryInputStream compressed(block.raw.getData(), entry.size, false);
+        juce::GZIPDecompressorInputStream decompressor(compressed);
+        
+        if (decompressor.read(block.decoded.getData(), expectedSize) != expectedSize)
+            return false;
+        
+        bytes = block.decoded.getData();
+    }
+    else if (static_cast<int>(entry.size) != expectedSize)
+    {
+        return false;
+    }
+    
+    if (codec == StemPack::Codec::Float)
+    {
+        for (int ch = 0; ch < static_cast<int>(numChannels); ++ch)
+        {
+            const uint8_t* src = bytes + ch * bytesPerChannel;
+            float* dest = block.samples.getWritePointer(ch);
+            
+            for (int i = 0; i < numFrames; ++i, src += bytesPerSample)
+            {
+                const uint32_t bits = juce::ByteOrder::littleEndianInt(src);
+                std::memcpy(dest + i, &bits, sizeof(float));
+            }
+        }
+        
+        block.index = blockIndex;
+        return true;
+    }
+    
+    constexpr float scale = 1.0f / 8388608.0f;
+    
+    for (int ch = 0; ch < static_cast<int>(numChannels); ++ch)
+    {
+        const uint8_t* src = bytes + ch * bytesPerChannel;
+        float* dest = block.samples.getWritePointer(ch);
+        uint32_t previous = 0;
+        
+        for (int i = 0; i < numFrames; ++i, src += bytesPerSample)
+        {
+            uint32_t value = static_cast<uint32_t>(src[0]) | (static_cast<uint32_t>(src[1]) << 8)
+                             | (static_cast<uint32_t>(src[2]) << 16);
+            
+            if (deltaCoded)
+            {
+                value = (value + previous) & 0xffffff;
+                previous = value;
+            }
+            
+            // Sign-extend the 24-bit value
+            dest[i] = static_cast<float>(static_cast<int32_t>(value ^ 0x800000) - 0x800000) * scale;
+        }
+    }
+    
+    block.index = blockIndex;
+    return true;
+}
+
+bool StemPackReader::readSamples(int* const* destChannels, int numDestChannels, int startOffsetInDestBuffer,
+                                 juce::int64 startSampleInFile, int numSamples)
+{
+    while (numSamples > 0)
+    {
+        if (startSampleInFile >= lengthInSamples)
+        {
+            for (int ch = 0; ch < numDestChannels; ++ch)
+                if (destChannels[ch] != nullptr)
+                    juce::zeromem(destChannels[ch] + startOffsetInDestBuffer, static_cast<size_t>(numSamples) * sizeof(float));
+            break;
+        }
+        
+        const int blockIndex = static_cast<int>(startSampleInFile / blockFrames);
+        const int offsetInBlock = static_cast<int>(startSampleInFile - static_cast<juce::int64>(blockIndex) * blockFrames);
+        const int chunk = static_cast<int>(juce::jmin(static_cast<juce::int64>(numSamples),
+                                                      static_cast<juce::int64>(blockFrames - offsetInBlock),
+                                                      lengthInSamples - startSampleInFile));
+        const Block* block = &blocks[current.load()];
+        
+        if (block->index != blockIndex)
+        {
+            if (!readAhead)
+            {
+                if (!loadBlock(*input, blockIndex, blocks[current.load()]))
+                    return false;
+            }
+            else if (aheadState.load() == aheadReady && blocks[1 - current.load()].index == blockIndex)
+            {
+                current.store(1 - current.load());
+                block = &blocks[current.load()];
+                aheadState.store(aheadIdle);
+                requestBlock(blockIndex + 1);
+            }
+            else
+            {
+                block = nullptr;
+                requestBlock(blockIndex);
+            }
+        }
+        
+        for (int ch = 0; ch < numDestChannels; ++ch)
+        {
+            if (destChannels[ch] == nullptr)
+                continue;
+            
+            auto* dest = reinterpret_cast<float*>(destChannels[ch]) + startOffsetInDestBuffer;
+            
+            if (block != nullptr && ch < static_cast<int>(numChannels))
+                std::memcpy(dest, block->samples.getReadPointer(ch, offsetInBlock), static_cast<size_t>(chunk) * sizeof(float));
+            else
+                juce::zeromem(dest, static_cast<size_t>(chunk) * sizeof(float));
+        }
+        
+        startOffsetInDestBuffer += chunk;
+        startSampleInFile += chunk;
+        numSamples -= chunk;
+    }
+    
+    return true;
+}
+
+// StemPackWriter implementation
+StemPackWriter::StemPackWriter(const juce::File& destination, double rate, int mask,
+                               StemPack::Codec c, int frames)
+    : tempFile(destination),
+      sampleRate(rate), stemMask(mask), numChannels(getNumChannelsForMask(mask)),
+      codec(c), blockFrames(frames)
+{
+    jassert(stemMask > 0 && stemMask < (1 << NUM_STEM_TYPES));
+    
+    stream = tempFile.getFile().createOutputStream();
+    
+    if (stream == nullptr || !stream->openedOk())
+    {
+        stream.reset();
+        return;
+    }
+    
+    pending.setSize(numChannels, blockFrames);
+    
+    // Placeholder header, rewritten by finish() once the totals are known
+    stream->setPosition(0);
+    stream->write(packMagic, 4);
+    stream->writeInt(packVersion);
+    stream->writeDouble(sampleRate);
+    stream->writeByte(static_cast<char>(stemMask));
+    stream->writeByte(static_cast<char>(channelsPerStem));
+    stream->writeByte(static_cast<char>(codec));
+    stream->writeByte(0);
+    stream->writeInt(blockFrames);
+    stream->writeInt64(0);
+    stream->writeInt(0);
+    stream->writeInt64(0);
+}
+
+StemPackWriter::~StemPackWriter()
+{
+}
+
+bool StemPackWriter::write(const float* const* channels, int numFrames)
+{
+    if (stream == nullptr)
+        return false;
+    
+    int offset = 0;
+    
+    while (offset < numFrames)
+    {
+        const int chunk = juce::jmin(numFrames - offset, blockFrames - pendingFrames);
+        
+        for (int ch = 0; ch < numChannels; ++ch)
+            pending.copyFrom(ch, pendingFrames, channels[ch] + offset, chunk);
+        
+        pendingFrames += chunk;
+        offset += chunk;
+        
+        if (pendingFrames == blockFrames && !flushBlock())
+            return false;
+    }
+    
+    return true;
+}
+
+bool StemPackWriter::flushBlock()
+{
+    if (pendingFrames == 0)
+        return true;
+    
+    const bool deltaCoded = codec == StemPack::Codec::Deflate;
+    const int bytesPerSample = getBytesPerSample(codec);
+    const size_t bytesPerChannel = static_cast<size_t>(pendingFrames) * static_cast<size_t>(bytesPerSample);
+    encoded.setSize(bytesPerChannel * static_cast<size_t>(numChannels), false);
+    
+    auto* dest = static_cast<uint8_t*>(encoded.getData());
+    
+    for (int ch = 0; ch < numChannels; ++ch)
+    {
+        const float* src = pending.getReadPointer(ch);
+        uint32_t previous = 0;
+        
+        for (int i = 0; i < pendingFrames; ++i, dest += bytesPerSample)
+        {
+            if (codec == StemPack::Codec::Float)
+            {
+                uint32_t bits;
+                std::memcpy(&bits, src + i, sizeof(float));
+                
+                for (int b = 0; b < 4; ++b)
+                    dest[b] = static_cast<uint8_t>(bits >> (8 * b));
+                
+                continue;
+            }
+            
+            // Same scale as the reader, so integer sources of up to 24 bits round-trip exactly
+            auto value = static_cast<uint32_t>(juce::jlimit(-8388608, 8388607, juce::roundToInt(src[i] * 8388608.0f))) & 0xffffff;
+            
+            if (deltaCoded)
+            {
+                const uint32_t residual = (value - previous) & 0xffffff;
+                previous = value;
+                value = residual;
+            }
+            
+            dest[0] = static_cast<uint8_t>(value);
+            dest[1] = static_cast<uint8_t>(value >> 8);
+            dest[2] = static_cast<uint8_t>(value >> 16);
+        }
+    }
+    
+    const auto offset = stream->getPosition();
+    size_t size = encoded.getSize();
+    
+    if (deltaCoded)
+    {
+        juce::MemoryOutputStream compressed;
+        {
+            juce::GZIPCompressorOutputStream zipper(compressed);
+            zipper.write(encoded.getData(), encoded.getSize());
+            zipper.flush();
+        }
+        
+        size = compressed.getDataSize();
+        if (!stream->write(compressed.getData(), size))
+            return false;
+    }
+    else if (!stream->write(encoded.getData(), size))
+    {
+        return false;
+    }
+    
+    index.emplace_back(offset, static_cast<uint32_t>(size));
+    totalFrames += pendingFrames;
+    pendingFrames = 0;
+    return true;
+}
+
+bool StemPackWriter::finish()
+{
+    if (stream == nullptr || !flushBlock() || totalFrames == 0)
+        return false;
+    
+    const auto indexOffset = stream->getPosition();
+    
+    for (const auto& entry : index)
+    {
+        stream->writeInt64(entry.first);
+        stream->writeInt(static_cast<int>(entry.second));
+    }
+    
+    // Fill in the totals left blank in the header
+    stream->setPosition(4 + 4 + 8 + 4 + 4);
+    stream->writeInt64(totalFrames);
+    stream->writeInt(static_cast<int>(index.size()));
+    stream->writeInt64(indexOffset);
+    stream->flush();
+    
+    const bool ok = stream->getStatus().wasOk();
+    stream.reset();
+    
+    return ok && tempFile.overwriteTargetFileWithTemporary();
+}
+
+// StemPackConverter implementation
+juce::File StemPackConverter::getDestinationFor(const DetectedSong& song)
+{
+    for (int i = 0; i < NUM_STEM_TYPES; ++i)
+    {
+        if (song.stemFound[i])
+            return song.stemFiles[i].getParentDirectory()
+                       .getChildFile(juce::File::createLegalFileName(song.songName) + StemPack::fileExtension);
+    }
+    
+    return {};
+}
+
+bool StemPackConverter::convertSong(const DetectedSong& song, const juce::File& destination,
+                                    StemPack::Codec codec, juce::String& error)
+{
+    if (song.isContainer())
+    {
+        error = "Already a single file";
+        return false;
+    }
+    
+    juce::AudioFormatManager formatManager;
+    formatManager.registerBasicFormats();
+    
+    struct StemInput
+    {
+        std::unique_ptr<juce::AudioFormatReader> reader;
+        std::unique_ptr<juce::AudioFormatReaderSource> readerSource;
+        std::unique_ptr<juce::ResamplingAudioSource> resampler;
+    };
+    
+    std::vector<StemInput> inputs;
+    int stemMask = 0;
+    double sampleRate = 0.0;
+    
+    for (int i = 0; i < NUM_STEM_TYPES; ++i)
+    {
+        if (!song.stemFound[i])
+            continue;
+        
+        StemInput input;
+        input.reader.reset(formatManager.createReaderFor(song.stemFiles[i]));
+        
+        if (input.reader == nullptr || input.reader->sampleRate <= 0.0)
+        {
+            error = "Unreadable: " + StemDetector::getStemTypeName(i);
+            return false;
+        }
+        
+        // 24-bit integers would lose detail of float or wider sources (MP3 and Ogg decode to
+        // float too) and clip anything above 0 dBFS, so those songs are packed as floats
+        if (input.reader->usesFloatingPointData || input.reader->bitsPerSample > 24)
+            codec = StemPack::Codec::Float;
+        
+        stemMask |= 1 << i;
+        sampleRate = juce::jmax(sampleRate, input.reader->sampleRate);
+        inputs.push_back(std::move(input));
+    }
+    
+    if (inputs.empty())
+    {
+        error = "No stems";
+        return false;
+    }
+    
+    StemPackWriter writer(destination, sampleRate, stemMask, codec);
+    if (!writer.isOpen())
+    {
+        error = "Can't write " + destination.getFileName();
+        return false;
+    }
+    
+    const int chunkSize = StemPack::defaultBlockFrames;
+    int64_t totalFrames = 0;
+    
+    // Stems at a lower rate are resampled up to the highest one; matching stems are copied as is
+    for (auto& input : inputs)
+    {
+        const double ratio = input.reader->sampleRate / sampleRate;
+        totalFrames = juce::jmax(totalFrames, static_cast<int64_t>(static_cast<double>(input.reader->lengthInSamples) / ratio));
+        
+        if (input.reader->sampleRate != sampleRate)
+        {
+            input.readerSource = std::make_unique<juce::AudioFormatReaderSource>(input.reader.get(), false);
+            input.resampler = std::make_unique<juce::ResamplingAudioSource>(input.readerSource.get(), false, channelsPerStem);
+            input.resampler->setResamplingRatio(ratio);
+            input.resampler->prepareToPlay(chunkSize, sampleRate);
+        }
+    }
+    
+    juce::AudioBuffer<float> buffer(writer.getNumChannels(), chunkSize);
+    
+    for (int64_t position = 0; position < totalFrames; position += chunkSize)
+    {
+        const int numFrames = static_cast<int>(juce::jmin(static_cast<int64_t>(chunkSize), totalFrames - position));
+        
+        for (size_t k = 0; k < inputs.size(); ++k)
+        {
+            auto& input = inputs[k];
+            float* pair[channelsPerStem] = { buffer.getWritePointer(static_cast<int>(k) * 2),
+                                             buffer.getWritePointer(static_cast<int>(k) * 2 + 1) };
+            
+            if (input.resampler != nullptr)
+            {
+                juce::AudioBuffer<float> view(pair, channelsPerStem, numFrames);
+                input.resampler->getNextAudioBlock(juce::AudioSourceChannelInfo(&view, 0, numFrames));
+                continue;
+            }
+            
+            // Mono stems are stored as a stereo pair
+            const int readerChannels = juce::jmin(channelsPerStem, static_cast<int>(input.reader->numChannels));
+            input.reader->read(pair, readerChannels, position, numFrames);
+            
+            if (readerChannels == 1)
+                std::memcpy(pair[1], pair[0], static_cast<size_t>(numFrames) * sizeof(float));
+        }
+        
+        if (!writer.write(buffer.getArrayOfReadPointers(), numFrames))
+        {
+            error = "Write failed";
+            return false;
+        }
+    }
+    
+    if (!writer.finish())
+    {
+        error = "Write failed";
+        return false;
+    }
+    
+    return true;
+}
+
+int StemPackConverter::convertSongs(const juce::Array<DetectedSong>& songs, StemPack::Codec codec,
+                                    std::function<bool()> shouldStop,
+                                    std::function<void(int, int)> progress,
+                                    juce::StringArray& failures)
+{
+    juce::CriticalSection failuresLock;
+
+    std::vector<int> looseSongs;
+    for (int i = 0; i < songs.size(); ++i)
+        if (!songs.getReference(i).isContainer())
+            looseSongs.push_back(i);
+    
+    const int total = static_cast<int>(looseSongs.size());
+    std::atomic<int> finished { 0 };
+    std::atomic<int> packed { 0 };
+    
+    // Each song is independent, so whole songs are packed in parallel
+    parallelFor(total, [&](int item) {
+        if (shouldStop == nullptr || !shouldStop())
+        {
+            const auto& song = songs.getReference(looseSongs[(size_t) item]);
+            juce::String error;
+            
+            if (convertSong(song, getDestinationFor(song), codec, error))
+                ++packed;
+            else
+            {
+                const juce::ScopedLock sl(failuresLock);
+                failures.add(song.songName + ": " + error);
+            }
+        }
+        
+        if (progress != nullptr)
+            progress(++finished, total);
+    });
+    
+    return packed;
+}
@@ -0,0 +1,154 @@
+#pragma once
+
+#include <JuceHeader.h>
+#include "StemDetector.h"
+
+// Native single-file stem format (".stempack"). All stems of a song are stored as
+// 24-bit stereo pairs (samples scaled by 2^23), or 32-bit floats for float sources,
+// grouped into fixed-size time blocks that hold every channel, so one sequential read
+// returns all stems for a time window. A seek index at the
+// end of the file maps block numbers to file offsets.
+//
+// Layout (little endian):
+//   header   "STPK", uint32 version, double sampleRate, uint8 stemMask, uint8 channelsPerStem,
+//            uint8 codec, uint8 reserved, uint32 blockFrames, int64 totalFrames,
+//            uint32 numBlocks, int64 indexOffset
+//   blocks   per block: every channel's frames one after another (planar)
+//   index    per block: int64 offset, uint32 size
+namespace StemPack
+{
+    static constexpr const char* fileExtension = ".stempack";
+    static constexpr const char* formatName = "Stem Pack";
+    static constexpr int defaultBlockFrames = 32768;
+    
+    enum class Codec : uint8_t
+    {
+        PCM = 0,        // Raw 24-bit samples, cheapest to decode
+        Deflate = 1,    // Delta-coded 24-bit samples, zlib-compressed; lossless
+        Float = 2       // Raw 32-bit float samples, for sources 24-bit integers can't hold
+    };
+    
+    bool isStemPackFile(const juce::File& file);
+    
+    // Opens .stempack files with StemPackReader and anything else with the format manager
+    juce::AudioFormatReader* createReaderFor(juce::AudioFormatManager& formatManager, const juce::File& file);
+}
+
+class StemPackReader : public juce::AudioFormatReader,
+                       private juce::TimeSliceClient
+{
+public:
+    // Returns nullptr if the file is not a valid stem pack
+    static std::unique_ptr<StemPackReader> open(const juce::File& file);
+    
+    ~StemPackReader() override;
+    
+    // For playback: the block after the one being read is decoded ahead on a shared
+    // background thread, so reads only copy frames that are already decoded. A read
+    // that lands on a block which isn't ready yet (after a seek) returns silence and
+    // queues that block. Call once, before reading starts; decodes the first block.
+    void setReadAhead();
+    
+    bool readSamples(int* const* destChannels, int numDestChannels, int startOffsetInDestBuffer,
+                     juce::int64 startSampleInFile, int numSamples) override;
+    
+    int getStemMask() const { return stemMask; }
+
+private:
+    struct IndexEntry
+    {
+        int64_t offset;
+        uint32_t size;
+    };
+    
+    struct Block
+    {
+        juce::HeapBlock<uint8_t> raw;         // Bytes of one block as stored
+        juce::HeapBlock<uint8_t> decoded;     // 24-bit samples after decompression
+        juce::AudioBuffer<float> samples;     // Decoded block, one channel per stem channel
+        int index { -1 };
+    };
+    
+    enum AheadState { aheadIdle, aheadRequested, aheadDecoding, aheadReady };
+    
+    StemPackReader(juce::InputStream* stream, const juce::File& file);
+    bool readHeader();
+    void allocate(Block& block) const;
+    bool loadBlock(juce::InputStream& stream, int blockIndex, Block& block);
+    void requestBlock(int blockIndex);
+    int useTimeSlice() override;
+    
+    juce::File file;
+    int stemMask { 0 };
+    StemPack::Codec codec { StemPack::Codec::PCM };
+    int blockFrames { 0 };
+    std::vector<IndexEntry> index;
+    uint32_t largestBlock { 0 };
+    
+    // blocks[current] is what reads copy from; with read-ahead the other one is filled
+    // by the background thread, which owns it while the state is requested or decoding
+    Block blocks[2];
+    std::atomic<int> current { 0 };
+    bool readAhead { false };
+    std::unique_ptr<juce::InputStream> aheadInput;
+    std::atomic<int> aheadState { aheadIdle };
+    std::atomic<int> aheadBlock { -1 };
+    
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(StemPackReader)
+};
+
+class StemPackWriter
+{
+public:
+    StemPackWriter(const juce::File& destination, double sampleRate, int stemMask,
+                   StemPack::Codec codec, int blockFrames = StemPack::defaultBlockFrames);
+    ~StemPackWriter();
+    
+    bool isOpen() const { return stream != nullptr; }
+    int getNumChannels() const { return numChannels; }
+    
+    // Appends frames for every channel (two per stem in stem type order)
+    bool write(const float* const* channels, int numFrames);
+    
+    // Flushes the last block, writes the seek index and moves the file into place
+    bool finish();
+
+private:
+    bool flushBlock();
+    
+    juce::TemporaryFile tempFile;
+    std::unique_ptr<juce::FileOutputStream> stream;
+    
+    double sampleRate;
+    int stemMask;
+    int numChannels;
+    StemPack::Codec codec;
+    int blockFrames;
+    
+    juce::AudioBuffer<float> pending;
+    int pendingFrames { 0 };
+    int64_t totalFrames { 0 };
+    std::vector<std::pair<int64_t, uint32_t>> index;
+    juce::MemoryBlock encoded;
+    
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(StemPackWriter)
+};
+
+// Packs loose-stem songs into .stempack files next to their stems
+class StemPackConverter
+{
+public:
+    // Songs with float or wider-than-24-bit stems are packed as Codec::Float whatever codec is given
+    static bool convertSong(const DetectedSong& song, const juce::File& destination,
+                            StemPack::Codec codec, juce::String& error);
+    
+    // Converts every loose-stem song in parallel. shouldStop is polled between songs;
+    // progress is called from worker threads with the number of songs finished so far.
+    // Returns the number of songs packed and adds "song: reason" for each one that wasn't.
+    static int convertSongs(const juce::Array<DetectedSong>& songs, StemPack::Codec codec,
+                            std::function<bool()> shouldStop,
+                            std::function<void(int, int)> progress,
+                            juce::StringArray& failures);
+    
+    static juce::File getDestinationFor(const DetectedSong& song);
+};
@@ -0,0 +1,132 @@
+#include "StemSource.h"
+#include "StemPack.h"
+
+StemSource::StemSource(const juce::File& f)
+    : file(f)
+{
+}
+
+StemSource::~StemSource()
+{
+    releaseResources();
+}
+
+bool StemSource::open(juce::AudioFormatManager& formatManager, const StemFileInfo* probedInfo)
+{
+    if (StemPack::isStemPackFile(file))
+    {
+        auto pack = StemPackReader::open(file);
+        
+        if (pack != nullptr)
+            pack->setReadAhead();
+        
+        reader = std::move(pack);
+    }
+    else if (probedInfo != nullptr && probedInfo->valid)
+    {
+        for (int i = 0; i < formatManager.getNumKnownFormats() && reader == nullptr; ++i)
+        {
+            auto* format = formatManager.getKnownFormat(i);
+            if (format->getFormatName() == probedInfo->formatName)
+                if (auto stream = file.createInputStream())
+                    reader.reset(format->createReaderFor(stream.release(), true));
+        }
+    }
+    
+    if (reader == nullptr)
+        reader.reset(formatManager.createReaderFor(file));
+    
+    if (reader == nullptr || reader->numChannels == 0 || static_cast<int>(reader->numChannels) > maxChannels)
+    {
+        reader.reset();
+        return false;
+    }
+    
+    fileSampleRate = reader->sampleRate;
+    resampler = std::make_unique<juce::ResamplingAudioSource>(&readerInput, false, getNumChannels());
+    return true;
+}
+
+void StemSource::prepareToPlay(double sampleRate, int samplesPerBlock)
+{
+    currentSampleRate = sampleRate;
+    
+    if (reader == nullptr)
+        return;
+    
+    block.setSize(getNumChannels(), samplesPerBlock, false, false, true);
+    blockStart = -1;
+    blockLength = 0;
+    
+    resampler->setResamplingRatio(fileSampleRate / sampleRate);
+    resampler->prepareToPlay(samplesPerBlock, sampleRate);
+}
+
+void StemSource::releaseResources()
+{
+    if (resampler != nullptr)
+        resampler->releaseResources();
+}
+
+void StemSource::readFromFile(const juce::AudioSourceChannelInfo& info)
+{
+    float* channels[maxChannels];
+    const int numChannels = juce::jmin(info.buffer->getNumChannels(), getNumChannels());
+    
+    for (int ch = 0; ch < numChannels; ++ch)
+        channels[ch] = info.buffer->getWritePointer(ch, info.startSample);
+    
+    // The reader zero-fills anything past the end of the file
+    reader->read(channels, numChannels, readPosition, info.numSamples);
+    readPosition += info.numSamples;
+}
+
+const juce::AudioBuffer<float>& StemSource::readBlock(int64_t startSample, int numSamples)
+{
+    if (reader == nullptr)
+    {
+        block.setSize(1, numSamples, false, false, true);
+        block.clear();
+        return block;
+    }
+    
+    if (startSample == blockStart && numSamples == blockLength)
+        return block;
+    
+    if (numSamples > block.getNumSamples())
+        block.setSize(getNumChannels(), numSamples, false, false, true);
+    
+    // Anything other than the block right after the previous one is a seek
+    if (startSample != blockStart + blockLength)
+    {
+        readPosition = static_cast<int64_t>(static_cast<double>(startSample) * fileSampleRate / currentSampleRate);
+        resampler->flushBuffers();
+    }
+    
+    juce::AudioSourceChannelInfo info(&block, 0, numSamples);
+    
+    if (fileSampleRate == currentSampleRate)
+        readFromFile(info);
+    else
+        resampler->getNextAudioBlock(info);
+    
+    blockStart = startSample;
+    blockLength = numSamples;
+    return block;
+}
+
+int StemSource::getStemMask() const
+{
+    if (auto* pack = dynamic_cast<StemPackReader*>(reader.get()))
+        return pack->getStemMask();
+    
+    return 0;
+}
+
+int64_t StemSource::getTotalLengthInSamples() const
+{
+    if (reader == nullptr || fileSampleRate <= 0.0)
+        return 0;
+    
+    return static_cast<int64_t>(static_cast<double>(reader->lengthInSamples) * currentSampleRate / fileSampleRate);
+}
@@ -0,0 +1,66 @@
+#pragma once
+
+#include <JuceHeader.h>
+#include "StemDetector.h"
+
+// Decodes one audio file for one or more stems. A loose stem file has its own source;
+// a multichannel stem container is decoded once per block by a single source and each
+// stem reads its channel pair straight out of the shared block.
+class StemSource
+{
+public:
+    explicit StemSource(const juce::File& file);
+    ~StemSource();
+
+    // If probedInfo is given, the reader is opened with the format that probed it
+    // instead of letting every registered format try to parse the header
+    bool open(juce::AudioFormatManager& formatManager, const StemFileInfo* probedInfo = nullptr);
+    
+    void prepareToPlay(double sampleRate, int samplesPerBlock);
+    void releaseResources();
+    
+    // Returns every channel for [startSample, startSample + numSamples) at the playback
+    // sample rate. Repeated calls for the same range reuse the decoded block.
+    const juce::AudioBuffer<float>& readBlock(int64_t startSample, int numSamples);
+    
+    const juce::File& getFile() const { return file; }
+    int getNumChannels() const { return reader != nullptr ? static_cast<int>(reader->numChannels) : 0; }
+    double getFileSampleRate() const { return fileSampleRate; }
+    int64_t getFileLengthInSamples() const { return reader != nullptr ? reader->lengthInSamples : 0; }
+    
+    // Stem types held by a stem pack, 0 for other formats
+    int getStemMask() const;
+    
+    // Length at the playback sample rate
+    int64_t getTotalLengthInSamples() const;
+
+private:
+    // Feeds the resampler straight from the reader
+    struct ReaderInput : public juce::AudioSource
+    {
+        explicit ReaderInput(StemSource& s) : owner(s) {}
+        void prepareToPlay(int, double) override {}
+        void releaseResources() override {}
+        void getNextAudioBlock(const juce::AudioSourceChannelInfo& info) override { owner.readFromFile(info); }
+        StemSource& owner;
+    };
+    
+    void readFromFile(const juce::AudioSourceChannelInfo& info);
+    
+    static constexpr int maxChannels = 32;
+    
+    juce::File file;
+    std::unique_ptr<juce::AudioFormatReader> reader;
+    ReaderInput readerInput { *this };
+    std::unique_ptr<juce::ResamplingAudioSource> resampler;
+    
+    juce::AudioBuffer<float> block;
+    int64_t blockStart { -1 };
+    int blockLength { 0 };
+    int64_t readPosition { 0 };     // Next reader sample fed to the resampler
+    
+    double currentSampleRate { 44100.0 };
+    double fileSampleRate { 44100.0 };
+    
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(StemSource)
+};
@@ -1,84 +1,48 @@
 #include "StemTrack.h"
+#include "PeakCache.h"
 
-StemTrack::StemTrack(const juce::File& f, const juce::String& type)
-    : file(f), stemType(type)
+StemTrack::StemTrack(std::shared_ptr<StemSource> s, int first, int count, const juce::String& type)
+    : source(std::move(s)), firstChannel(first), numChannels(count), stemType(type)
 {
 }
 
 StemTrack::~StemTrack()
 {
-    releaseResources();
 }
 
-bool StemTrack::loadFile(juce::AudioFormatManager& formatManager)
+void StemTrack::createPeaks()
 {
-    auto* reader = formatManager.createReaderFor(file);
+    // Displays draw at most a stereo pair
+    const int numPeakChannels = juce::jmin(2, numChannels);
     
-    if (reader == nullptr)
-        return false;
+    peaks = PeakCache::load(getFile(), firstChannel, numPeakChannels,
+                            source->getFileLengthInSamples(), source->getFileSampleRate());
     
-    fileSampleRate = reader->sampleRate;
-    
-    readerSource = std::make_unique<juce::AudioFormatReaderSource>(reader, true);
-    resamplingSource = std::make_unique<juce::ResamplingAudioSource>(readerSource.get(), false, 2);
-    
-    // Create thumbnail
-    thumbnail = std::make_unique<juce::AudioThumbnail>(512, formatManager, thumbnailCache);
-    thumbnail->setSource(new juce::FileInputSource(file));
-    
-    loaded = true;
-    return true;
+    if (peaks == nullptr)
+        peaks = std::make_shared<WaveformPeaks>(numPeakChannels, source->getFileLengthInSamples(),
+                                                source->getFileSampleRate());
 }
 
-void StemTrack::prepareToPlay(double sampleRate, int samplesPerBlock)
+const juce::AudioBuffer<float>& StemTrack::readBlock(int64_t startSample, int numSamples)
 {
-    currentSampleRate = sampleRate;
+    const auto& block = source->readBlock(startSample, numSamples);
     
-    if (resamplingSource != nullptr)
-    {
-        resamplingSource->setResamplingRatio(fileSampleRate / sampleRate);
-        resamplingSource->prepareToPlay(samplesPerBlock, sampleRate);
-    }
-}
-
-void StemTrack::releaseResources()
-{
-    if (resamplingSource != nullptr)
-        resamplingSource->releaseResources();
-}
-
-void StemTrack::getNextAudioBlock(juce::AudioBuffer<float>& buffer, int64_t startSample)
-{
-    if (!loaded || readerSource == nullptr || muted)
-    {
-        buffer.clear();
-        return;
-    }
-    
-    // Set position
-    readerSource->setNextReadPosition(startSample);
+    if (firstChannel == 0 && numChannels == block.getNumChannels())
+        return block;
     
-    // Create audio source channel info
-    juce::AudioSourceChannelInfo info(&buffer, 0, buffer.getNumSamples());
+    // Point at our channel pair inside the shared block
+    jassert(numChannels <= 2);
+    float* channels[2];
+    for (int ch = 0; ch < numChannels; ++ch)
+        channels[ch] = const_cast<float*>(block.getReadPointer(firstChannel + ch));
     
-    // Get audio from resampling source
-    resamplingSource->getNextAudioBlock(info);
-    
-    // Apply volume
-    buffer.applyGain(volume);
-}
-
-int64_t StemTrack::getTotalLengthInSamples() const
-{
-    if (readerSource != nullptr)
-        return readerSource->getTotalLength();
-    return 0;
+    channelView.setDataToReferTo(channels, numChannels, numSamples);
+    return channelView;
 }
 
 double StemTrack::getLengthInSeconds() const
 {
-    if (fileSampleRate > 0)
-        return static_cast<double>(getTotalLengthInSamples()) / fileSampleRate;
+    if (source->getFileSampleRate() > 0)
+        return static_cast<double>(source->getFileLengthInSamples()) / source->getFileSampleRate();
     return 0.0;
 }
-
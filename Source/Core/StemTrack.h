@@ -1,21 +1,31 @@
 #pragma once
 
 #include <JuceHeader.h>
+#include "StemDetector.h"
+#include "StemSource.h"
+#include "WaveformPeaks.h"
 
 class StemTrack
 {
 public:
-    StemTrack(const juce::File& file, const juce::String& stemType);
+    // Plays numChannels channels of source starting at firstChannel. Several tracks may
+    // share one source when their stems come from the same container file.
+    StemTrack(std::shared_ptr<StemSource> source, int firstChannel, int numChannels,
+              const juce::String& stemType);
     ~StemTrack();
 
-    bool loadFile(juce::AudioFormatManager& formatManager);
-    void prepareToPlay(double sampleRate, int samplesPerBlock);
-    void releaseResources();
+    // Maps this stem's cached peak pyramid, or allocates an empty one for StemEngine
+    // to fill in the background
+    void createPeaks();
     
-    void getNextAudioBlock(juce::AudioBuffer<float>& buffer, int64_t startSample);
+    // Returns a view of this stem's channels in the source's decoded block; nothing is copied
+    const juce::AudioBuffer<float>& readBlock(int64_t startSample, int numSamples);
     
     const juce::String& getStemType() const { return stemType; }
-    const juce::File& getFile() const { return file; }
+    const juce::File& getFile() const { return source->getFile(); }
+    StemSource& getSource() { return *source; }
+    int getFirstChannel() const { return firstChannel; }
+    int getNumChannels() const { return numChannels; }
     
     float getVolume() const { return volume; }
     void setVolume(float newVolume) { volume = juce::jlimit(0.0f, 1.0f, newVolume); }
@@ -26,32 +36,26 @@ public:
     bool isSolo() const { return solo; }
     void setSolo(bool shouldSolo) { solo = shouldSolo; }
     
-    int64_t getTotalLengthInSamples() const;
+    int64_t getTotalLengthInSamples() const { return source->getTotalLengthInSamples(); }
     double getLengthInSeconds() const;
-    double getSampleRate() const { return currentSampleRate; }
     
-    juce::AudioThumbnail* getThumbnail() { return thumbnail.get(); }
-    
-    bool isLoaded() const { return loaded; }
+    // Shared with the builder job, so it stays valid while the track is replaced
+    std::shared_ptr<WaveformPeaks> getPeaks() const { return peaks; }
 
 private:
-    juce::File file;
+    std::shared_ptr<StemSource> source;
+    int firstChannel { 0 };
+    int numChannels { 2 };
     juce::String stemType;
     
-    std::unique_ptr<juce::AudioFormatReaderSource> readerSource;
-    std::unique_ptr<juce::ResamplingAudioSource> resamplingSource;
-    
-    juce::AudioThumbnailCache thumbnailCache { 1 };
-    std::unique_ptr<juce::AudioThumbnail> thumbnail;
+    juce::AudioBuffer<float> channelView;
     
-    float volume { 1.0f };
-    bool muted { false };
-    bool solo { false };
-    bool loaded { false };
+    std::shared_ptr<WaveformPeaks> peaks;
     
-    double currentSampleRate { 44100.0 };
-    double fileSampleRate { 44100.0 };
+    // Set from the message thread, read by the audio thread
+    std::atomic<float> volume { 1.0f };
+    std::atomic<bool> muted { false };
+    std::atomic<bool> solo { false };
     
     JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(StemTrack)
 };
-
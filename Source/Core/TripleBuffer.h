@@ -0,0 +1,44 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+
+// Wait-free single-writer, single-reader hand-over of a value. The writer fills
+// getWriteBuffer() and publishes it; the reader picks up the most recently published
+// value with update(). Neither side ever blocks or sees a partly written value, and
+// values published between two reads are simply skipped.
+template <typename T>
+class TripleBuffer
+{
+public:
+    TripleBuffer() = default;
+    
+    // Writer side
+    T& getWriteBuffer() { return buffers[(size_t) writeIndex]; }
+    
+    void publish()
+    {
+        writeIndex = shared.exchange(writeIndex | newDataBit, std::memory_order_acq_rel) & indexMask;
+    }
+    
+    // Reader side; returns true if a newer value was published since the last call
+    bool update()
+    {
+        if ((shared.load(std::memory_order_acquire) & newDataBit) == 0)
+            return false;
+        
+        readIndex = shared.exchange(readIndex, std::memory_order_acq_rel) & indexMask;
+        return true;
+    }
+    
+    const T& getReadBuffer() const { return buffers[(size_t) readIndex]; }
+
+private:
+    static constexpr int indexMask = 3;
+    static constexpr int newDataBit = 4;
+    
+    std::array<T, 3> buffers {};
+    int writeIndex { 0 };
+    int readIndex { 1 };
+    std::atomic<int> shared { 2 };
+};
@@ -0,0 +1,112 @@
+#include "WaveformBuilder.h"
+#include "StemPack.h"
+#include "PeakCache.h"
+
+WaveformBuilder::Build::Build(const juce::File& f, std::vector<Target> t, bool sidecars)
+    : file(f), targets(std::move(t)), useSidecars(sidecars),
+      numSegments(targets.empty() ? 0 : targets.front().peaks->getNumSegments()),
+      claimed(new std::atomic<bool>[(size_t) juce::jmax(1, numSegments)])
+{
+    // Segments restored from the cache are already done
+    for (int segment = 0; segment < numSegments; ++segment)
+        claimed[(size_t) segment] = std::all_of(targets.begin(), targets.end(), [segment](const Target& target)
+        {
+            return target.peaks->isSegmentReady(segment);
+        });
+}
+
+WaveformBuilder::WaveformBuilder(std::shared_ptr<Build> b, std::shared_ptr<const WaveformFocus> f)
+    : juce::ThreadPoolJob("Waveform: " + b->file.getFileName()), build(std::move(b)), focus(std::move(f))
+{
+}
+
+juce::ThreadPoolJob::JobStatus WaveformBuilder::runJob()
+{
+    if (build->targets.empty())
+        return jobHasFinished;
+    
+    juce::AudioFormatManager formatManager;
+    formatManager.registerBasicFormats();
+    
+    std::unique_ptr<juce::AudioFormatReader> reader(StemPack::createReaderFor(formatManager, build->file));
+    if (reader == nullptr)
+        return jobHasFinished;
+    
+    const int numChannels = static_cast<int>(reader->numChannels);
+    juce::AudioBuffer<float> buffer(numChannels, WaveformPeaks::samplesPerSegment);
+    const int64_t length = build->targets.front().peaks->getLengthInSamples();
+    
+    while (!shouldExit())
+    {
+        const int segment = claimNextSegment();
+        if (segment < 0)
+            break;
+        
+        const int64_t start = static_cast<int64_t>(segment) * WaveformPeaks::samplesPerSegment;
+        const int numSamples = static_cast<int>(juce::jmin<int64_t>(WaveformPeaks::samplesPerSegment, length - start));
+        
+        reader->read(buffer.getArrayOfWritePointers(), numChannels, start, numSamples);
+        
+        for (const auto& target : build->targets)
+        {
+            const float* channels[2];
+            for (int ch = 0; ch < target.peaks->getNumChannels(); ++ch)
+                channels[ch] = buffer.getReadPointer(juce::jmin(target.firstChannel + ch, numChannels - 1));
+            
+            target.peaks->computeSegment(segment, channels, numSamples);
+        }
+    }
+    
+    // Whichever job sees the pyramids complete saves them; a cancelled build starts over next time
+    const bool complete = std::all_of(build->targets.begin(), build->targets.end(), [](const Target& target)
+    {
+        return target.peaks->isComplete();
+    });
+    
+    if (complete && !build->saved.exchange(true))
+        for (const auto& target : build->targets)
+            PeakCache::save(*target.peaks, build->file, target.firstChannel, build->useSidecars);
+    
+    return jobHasFinished;
+}
+
+int WaveformBuilder::claimNextSegment()
+{
+    for (;;)
+    {
+        int best = -1;
+        double bestPriority = 0.0;
+        
+        for (int segment = 0; segment < build->numSegments; ++segment)
+        {
+            if (build->claimed[(size_t) segment].load(std::memory_order_relaxed))
+                continue;
+            
+            const double priority = getPriority(segment);
+            if (best < 0 || priority < bestPriority)
+            {
+                best = segment;
+                bestPriority = priority;
+            }
+        }
+        
+        // Another job may have taken it since the scan; look again if so
+        if (best < 0 || !build->claimed[(size_t) best].exchange(true))
+            return best;
+    }
+}
+
+double WaveformBuilder::getPriority(int segment) const
+{
+    const double position = (segment + 0.5) / build->numSegments;
+    const double playhead = focus->playhead.load(std::memory_order_relaxed);
+    const juce::Range<double> visible(focus->visibleStart.load(std::memory_order_relaxed),
+                                      focus->visibleEnd.load(std::memory_order_relaxed));
+    
+    // Visible segments come first, spreading out from the playhead (or the left
+    // edge when it is off screen); the rest follow by distance from the view
+    if (visible.contains(position))
+        return std::abs(position - (visible.contains(playhead) ? playhead : visible.getStart()));
+    
+    return 1.0 + (position < visible.getStart() ? visible.getStart() - position : position - visible.getEnd());
+}
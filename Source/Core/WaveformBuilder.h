@@ -0,0 +1,57 @@
+#pragma once
+
+#include <JuceHeader.h>
+#include "WaveformPeaks.h"
+
+// Part of the song the user is looking at, as normalised positions. The UI moves
+// it every frame and the builders summarise the nearest segments first.
+struct WaveformFocus
+{
+    std::atomic<double> playhead { 0.0 };
+    std::atomic<double> visibleStart { 0.0 };
+    std::atomic<double> visibleEnd { 1.0 };
+};
+
+// Background job that fills the peak pyramids of every stem read from one audio
+// file (one for a loose stem, several for a container) from a single decode.
+// Several jobs may share a file; each claims segments in order of distance from
+// the focus, so the visible part of the waveform appears first.
+// Finished pyramids are written to the PeakCache.
+class WaveformBuilder : public juce::ThreadPoolJob
+{
+public:
+    struct Target
+    {
+        std::shared_ptr<WaveformPeaks> peaks;
+        int firstChannel;
+    };
+    
+    // Work on one file, shared by all the jobs building it
+    struct Build
+    {
+        Build(const juce::File& file, std::vector<Target> targets, bool useSidecars);
+        
+        const juce::File file;
+        const std::vector<Target> targets;
+        const bool useSidecars;
+        const int numSegments;
+        
+        std::unique_ptr<std::atomic<bool>[]> claimed;
+        std::atomic<bool> saved { false };
+    };
+    
+    WaveformBuilder(std::shared_ptr<Build> build, std::shared_ptr<const WaveformFocus> focus);
+    ~WaveformBuilder() override = default;
+    
+    JobStatus runJob() override;
+
+private:
+    // Returns the unclaimed segment closest to the focus, or -1 when none are left
+    int claimNextSegment();
+    double getPriority(int segment) const;
+    
+    std::shared_ptr<Build> build;
+    std::shared_ptr<const WaveformFocus> focus;
+    
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(WaveformBuilder)
+};
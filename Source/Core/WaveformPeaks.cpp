@@ -0,0 +1,267 @@
+#include "WaveformPeaks.h"
+
+namespace
+{
+    int16_t toPeakValue(float sample)
+    {
+        return static_cast<int16_t>(juce::jlimit(-32767, 32767, juce::roundToInt(sample * 32767.0f)));
+    }
+    
+    uint16_t toRmsValue(float rms)
+    {
+        return static_cast<uint16_t>(juce::roundToInt(juce::jlimit(0.0f, 1.0f, rms) * 65535.0f));
+    }
+    
+    float fromRmsValue(uint16_t rms)
+    {
+        return static_cast<float>(rms) / 65535.0f;
+    }
+    
+    // Square-root scaling keeps quiet bands distinguishable in 8 bits
+    uint8_t toBandValue(float rms)
+    {
+        return static_cast<uint8_t>(juce::roundToInt(std::sqrt(juce::jlimit(0.0f, 1.0f, rms)) * 255.0f));
+    }
+    
+    float fromBandValue(uint8_t band)
+    {
+        const float value = static_cast<float>(band) / 255.0f;
+        return value * value;
+    }
+    
+    // Mean energy of a group of band values, as a band value
+    uint8_t mergeBandValues(const uint8_t* values, int stride, int count)
+    {
+        float sumSquares = 0.0f;
+        
+        for (int i = 0; i < count; ++i)
+        {
+            const float rms = fromBandValue(values[i * stride]);
+            sumSquares += rms * rms;
+        }
+        
+        return toBandValue(std::sqrt(sumSquares / static_cast<float>(count)));
+    }
+    
+    // One-pole low-pass, started at the first sample so segments need no warm-up
+    void lowPass(const float* input, float* output, int numSamples, float coefficient)
+    {
+        float state = numSamples > 0 ? input[0] : 0.0f;
+        
+        for (int i = 0; i < numSamples; ++i)
+        {
+            state += coefficient * (input[i] - state);
+            output[i] = state;
+        }
+    }
+    
+    float onePoleCoefficient(double frequency, double sampleRate)
+    {
+        if (sampleRate <= 0.0)
+            return 1.0f;
+        
+        return static_cast<float>(1.0 - std::exp(-juce::MathConstants<double>::twoPi * frequency / sampleRate));
+    }
+    
+    // Four independent accumulators let the compiler vectorise the loop
+    float sumOfSquares(const float* samples, int numSamples)
+    {
+        float sums[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+        int i = 0;
+        
+        for (; i + 4 <= numSamples; i += 4)
+        {
+            sums[0] += samples[i] * samples[i];
+            sums[1] += samples[i + 1] * samples[i + 1];
+            sums[2] += samples[i + 2] * samples[i + 2];
+            sums[3] += samples[i + 3] * samples[i + 3];
+        }
+        
+        for (; i < numSamples; ++i)
+            sums[0] += samples[i] * samples[i];
+        
+        return sums[0] + sums[1] + sums[2] + sums[3];
+    }
+}
+
+WaveformPeaks::WaveformPeaks(int channels, int64_t length, double rate)
+    : numChannels(juce::jmax(1, channels)), lengthInSamples(juce::jmax<int64_t>(0, length)), sampleRate(rate)
+{
+    size_t total = 0;
+    
+    for (int level = 0; level < numLevels; ++level)
+    {
+        const int64_t samplesPerPeak = getSamplesPerPeak(level);
+        numPeaks[(size_t) level] = static_cast<int>((lengthInSamples + samplesPerPeak - 1) / samplesPerPeak);
+        levelOffsets[(size_t) level] = total;
+        total += static_cast<size_t>(numPeaks[(size_t) level]) * static_cast<size_t>(numChannels);
+    }
+    
+    totalPeaks = total;
+    storage.resize(total, Peak {});
+    data = storage.data();
+    
+    numSegments = static_cast<int>((lengthInSamples + samplesPerSegment - 1) / samplesPerSegment);
+    segmentReady = std::make_unique<std::atomic<bool>[]>(static_cast<size_t>(numSegments));
+    
+    for (int i = 0; i < numSegments; ++i)
+        segmentReady[(size_t) i] = false;
+}
+
+const WaveformPeaks::Peak* WaveformPeaks::getPeaks(int level, int channel) const
+{
+    return data + levelOffsets[(size_t) level] + static_cast<size_t>(channel) * static_cast<size_t>(numPeaks[(size_t) level]);
+}
+
+WaveformPeaks::Peak* WaveformPeaks::getWritablePeaks(int level, int channel)
+{
+    return data + levelOffsets[(size_t) level] + static_cast<size_t>(channel) * static_cast<size_t>(numPeaks[(size_t) level]);
+}
+
+int WaveformPeaks::chooseLevel(double samplesPerPixel)
+{
+    int level = 0;
+    
+    while (level + 1 < numLevels && getSamplesPerPeak(level + 1) <= samplesPerPixel)
+        ++level;
+    
+    return level;
+}
+
+bool WaveformPeaks::getRange(int level, int channel, int64_t startSample, int64_t endSample, Peak& result) const
+{
+    const int64_t samplesPerPeak = getSamplesPerPeak(level);
+    const int first = static_cast<int>(juce::jmax<int64_t>(0, startSample / samplesPerPeak));
+    const int last = static_cast<int>(juce::jmin<int64_t>(numPeaks[(size_t) level], (endSample + samplesPerPeak - 1) / samplesPerPeak));
+    
+    if (first >= last)
+        return false;
+    
+    // Every segment the range touches must be finished; at the top level one range can
+    // span many of them while builders are still writing the later ones
+    const int peaksPerSegment = samplesPerSegment / static_cast<int>(samplesPerPeak);
+    for (int segment = first / peaksPerSegment; segment <= (last - 1) / peaksPerSegment; ++segment)
+        if (!isSegmentReady(segment))
+            return false;
+    
+    const Peak* peaks = getPeaks(level, juce::jmin(channel, numChannels - 1));
+    Peak merged = peaks[first];
+    
+    for (int i = first + 1; i < last; ++i)
+    {
+        merged.min = juce::jmin(merged.min, peaks[i].min);
+        merged.max = juce::jmax(merged.max, peaks[i].max);
+        merged.rms = juce::jmax(merged.rms, peaks[i].rms);
+        merged.low = juce::jmax(merged.low, peaks[i].low);
+        merged.mid = juce::jmax(merged.mid, peaks[i].mid);
+        merged.high = juce::jmax(merged.high, peaks[i].high);
+    }
+    
+    result = merged;
+    return true;
+}
+
+bool WaveformPeaks::attachMappedData(std::unique_ptr<juce::MemoryMappedFile> mappedFile, size_t dataOffset)
+{
+    if (mappedFile == nullptr || mappedFile->getData() == nullptr
+        || mappedFile->getSize() != dataOffset + getDataSize()
+        || dataOffset % alignof(Peak) != 0)
+        return false;
+    
+    mapped = std::move(mappedFile);
+    data = reinterpret_cast<Peak*>(static_cast<char*>(mapped->getData()) + dataOffset);
+    
+    // The owned copy is no longer needed
+    std::vector<Peak>().swap(storage);
+    
+    for (int i = 0; i < numSegments; ++i)
+        segmentReady[(size_t) i].store(true, std::memory_order_release);
+    
+    readySegments = numSegments;
+    return true;
+}
+
+void WaveformPeaks::computeSegment(int segment, const float* const* channels, int numSamples)
+{
+    jassert(segment >= 0 && segment < numSegments);
+    
+    if (isSegmentReady(segment))
+        return;
+    
+    // Band split: low = LP(lowBandTop), mid = LP(highBandBottom) - low, high = the rest.
+    // The recursive filters run serially; everything after them is vector operations.
+    const float lowCoefficient = onePoleCoefficient(lowBandTop, sampleRate);
+    const float highCoefficient = onePoleCoefficient(juce::jmin(highBandBottom, sampleRate * 0.45), sampleRate);
+    juce::AudioBuffer<float> bands(3, numSamples);
+    float* low = bands.getWritePointer(0);
+    float* mid = bands.getWritePointer(1);
+    float* high = bands.getWritePointer(2);
+    
+    for (int ch = 0; ch < numChannels; ++ch)
+    {
+        const float* samples = channels[ch];
+        
+        lowPass(samples, low, numSamples, lowCoefficient);
+        lowPass(samples, mid, numSamples, highCoefficient);
+        juce::FloatVectorOperations::subtract(high, samples, mid, numSamples);
+        juce::FloatVectorOperations::subtract(mid, low, numSamples);
+        
+        // Level 0 straight from the samples
+        const int firstPeak = segment * (samplesPerSegment / baseSamplesPerPeak);
+        const int count = (numSamples + baseSamplesPerPeak - 1) / baseSamplesPerPeak;
+        Peak* level0 = getWritablePeaks(0, ch) + firstPeak;
+        
+        for (int i = 0; i < count; ++i)
+        {
+            const int offset = i * baseSamplesPerPeak;
+            const int length = juce::jmin(baseSamplesPerPeak, numSamples - offset);
+            const auto range = juce::FloatVectorOperations::findMinAndMax(samples + offset, length);
+            const float scale = 1.0f / static_cast<float>(length);
+            const float rms = std::sqrt(sumOfSquares(samples + offset, length) * scale);
+            
+            level0[i] = { toPeakValue(range.getStart()), toPeakValue(range.getEnd()), toRmsValue(rms),
+                          toBandValue(std::sqrt(sumOfSquares(low + offset, length) * scale)),
+                          toBandValue(std::sqrt(sumOfSquares(mid + offset, length) * scale)),
+                          toBandValue(std::sqrt(sumOfSquares(high + offset, length) * scale)),
+                          0 };
+        }
+        
+        // Each level above merges groups of levelRatio peaks of the one below
+        int previousCount = count;
+        
+        for (int level = 1; level < numLevels; ++level)
+        {
+            const int peaksPerSegment = samplesPerSegment / getSamplesPerPeak(level);
+            const Peak* below = getPeaks(level - 1, ch) + segment * peaksPerSegment * levelRatio;
+            Peak* above = getWritablePeaks(level, ch) + segment * peaksPerSegment;
+            const int levelCount = (previousCount + levelRatio - 1) / levelRatio;
+            
+            for (int i = 0; i < levelCount; ++i)
+            {
+                const int start = i * levelRatio;
+                const int end = juce::jmin(start + levelRatio, previousCount);
+                Peak merged = below[start];
+                float sumSquares = 0.0f;
+                
+                for (int j = start; j < end; ++j)
+                {
+                    merged.min = juce::jmin(merged.min, below[j].min);
+                    merged.max = juce::jmax(merged.max, below[j].max);
+                    const float rms = fromRmsValue(below[j].rms);
+                    sumSquares += rms * rms;
+                }
+                
+                merged.rms = toRmsValue(std::sqrt(sumSquares / static_cast<float>(end - start)));
+                merged.low = mergeBandValues(&below[start].low, sizeof(Peak), end - start);
+                merged.mid = mergeBandValues(&below[start].mid, sizeof(Peak), end - start);
+                merged.high = mergeBandValues(&below[start].high, sizeof(Peak), end - start);
+                above[i] = merged;
+            }
+            
+            previousCount = levelCount;
+        }
+    }
+    
+    segmentReady[(size_t) segment].store(true, std::memory_order_release);
+    ++readySegments;
+}
@@ -0,0 +1,93 @@
+#pragma once
+
+#include <JuceHeader.h>
+#include <atomic>
+
+// Min/max/RMS summary of one stem at several resolutions, built in one decode pass,
+// plus the RMS of its low, mid and high bands for frequency-coloured drawing.
+// Level 0 has one peak per baseSamplesPerPeak file samples and every level above
+// merges levelRatio peaks of the one below, so a display can pick the level that
+// matches its pixel width and draw in O(pixels) at any zoom.
+//
+// The file is summarised in independent segments of samplesPerSegment samples,
+// which may be computed in any order and from any thread; readers only use peaks
+// of segments that are marked ready.
+class WaveformPeaks
+{
+public:
+    struct Peak
+    {
+        int16_t min;
+        int16_t max;
+        uint16_t rms;
+        uint8_t low, mid, high;  // Band RMS, square-root scaled
+        uint8_t reserved;
+    };
+    
+    // Crossover frequencies of the band split
+    static constexpr double lowBandTop = 200.0;
+    static constexpr double highBandBottom = 2500.0;
+    
+    static constexpr int numLevels = 6;
+    static constexpr int baseSamplesPerPeak = 128;
+    static constexpr int levelRatio = 4;
+    static constexpr int samplesPerSegment = baseSamplesPerPeak * 1024;  // One peak at the top level
+    
+    WaveformPeaks(int numChannels, int64_t lengthInSamples, double sampleRate);
+    ~WaveformPeaks() = default;
+    
+    int getNumChannels() const { return numChannels; }
+    int64_t getLengthInSamples() const { return lengthInSamples; }
+    double getSampleRate() const { return sampleRate; }
+    double getLengthInSeconds() const { return sampleRate > 0.0 ? static_cast<double>(lengthInSamples) / sampleRate : 0.0; }
+    
+    static int getSamplesPerPeak(int level) { return baseSamplesPerPeak << (2 * level); }
+    int getNumPeaks(int level) const { return numPeaks[(size_t) level]; }
+    const Peak* getPeaks(int level, int channel) const;
+    
+    // Coarsest level that still has at least one peak per pixel
+    static int chooseLevel(double samplesPerPixel);
+    
+    // Merged peak over [startSample, endSample) of a channel at the given level.
+    // Returns false if that part of the file hasn't been summarised yet.
+    bool getRange(int level, int channel, int64_t startSample, int64_t endSample, Peak& result) const;
+    
+    int getNumSegments() const { return numSegments; }
+    bool isSegmentReady(int segment) const { return segmentReady[(size_t) segment].load(std::memory_order_acquire); }
+    bool isComplete() const { return readySegments.load() == numSegments; }
+    
+    // Bumped every time a segment completes, so displays know when to redraw
+    int getVersion() const { return readySegments.load(); }
+    
+    // Computes every level of one segment from its decoded samples. numSamples is
+    // samplesPerSegment except for the final segment.
+    void computeSegment(int segment, const float* const* channels, int numSamples);
+    
+    // Raw peak storage, as written to and read back from PeakCache files
+    const void* getData() const { return data; }
+    size_t getDataSize() const { return totalPeaks * sizeof(Peak); }
+    
+    // Reads peaks straight out of a mapped cache file starting at dataOffset instead of
+    // the owned storage, and marks every segment ready. Fails if the sizes don't match.
+    bool attachMappedData(std::unique_ptr<juce::MemoryMappedFile> mappedFile, size_t dataOffset);
+
+private:
+    Peak* getWritablePeaks(int level, int channel);
+    
+    int numChannels;
+    int64_t lengthInSamples;
+    double sampleRate;
+    
+    std::array<int, numLevels> numPeaks {};
+    std::array<size_t, numLevels> levelOffsets {};   // Into data; each level holds every channel in turn
+    size_t totalPeaks { 0 };
+    std::vector<Peak> storage;
+    Peak* data { nullptr };
+    std::unique_ptr<juce::MemoryMappedFile> mapped;
+    
+    int numSegments { 0 };
+    std::unique_ptr<std::atomic<bool>[]> segmentReady;
+    std::atomic<int> readySegments { 0 };
+    
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(WaveformPeaks)
+};
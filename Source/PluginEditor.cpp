@@ -2,7 +2,7 @@
 #include "PluginEditor.h"
 
 StemPlayerAudioProcessorEditor::StemPlayerAudioProcessorEditor(StemPlayerAudioProcessor& p)
-    : AudioProcessorEditor(&p), audioProcessor(p)
+    : AudioProcessorEditor(&p), audioProcessor(p), frameScheduler(*this, p.getStemEngine())
 {
     setLookAndFeel(&customLookAndFeel);
     
@@ -31,12 +31,19 @@ StemPlayerAudioProcessorEditor::StemPlayerAudioProcessorEditor(StemPlayerAudioPr
     setResizable(true, true);
     setResizeLimits(600, 400, 1920, 1080);
     
-    startTimerHz(30);
+    frameScheduler.addClient(mainScreen.get());
+    
+    // Songs also change from MIDI program changes, with or without this editor open
+    audioProcessor.getSongSwitcher().onSongChanged = [this](const juce::String& songName) {
+        mainScreen->songLoaded(songName);
+        showScreen(StemPlayerAudioProcessor::Screen::Main);
+    };
 }
 
 StemPlayerAudioProcessorEditor::~StemPlayerAudioProcessorEditor()
 {
-    stopTimer();
+    audioProcessor.getSongSwitcher().onSongChanged = nullptr;
+    frameScheduler.removeClient(mainScreen.get());
     setLookAndFeel(nullptr);
 }
 
@@ -72,12 +79,6 @@ void StemPlayerAudioProcessorEditor::saveWindowBounds()
     }
 }
 
-void StemPlayerAudioProcessorEditor::timerCallback()
-{
-    if (mainScreen->isVisible())
-        mainScreen->updatePlaybackPosition();
-}
-
 void StemPlayerAudioProcessorEditor::showScreen(StemPlayerAudioProcessor::Screen screen)
 {
     audioProcessor.setCurrentScreen(screen);
@@ -92,13 +93,3 @@ void StemPlayerAudioProcessorEditor::showScreen(StemPlayerAudioProcessor::Screen
     if (screen == StemPlayerAudioProcessor::Screen::Main)
         mainScreen->updateWaveformDisplayMode();
 }
-
-void StemPlayerAudioProcessorEditor::onSongSelected(const juce::String& songName, 
-                                                     const std::array<juce::File, NUM_STEM_TYPES>& stemFiles,
-                                                     const std::array<bool, NUM_STEM_TYPES>& stemFound)
-{
-    audioProcessor.getStemEngine().loadSong(songName, stemFiles, stemFound);
-    mainScreen->songLoaded(songName);
-    showScreen(StemPlayerAudioProcessor::Screen::Main);
-}
-
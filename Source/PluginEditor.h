@@ -7,9 +7,9 @@
 #include "UI/MainScreen.h"
 #include "UI/SettingsScreen.h"
 #include "UI/LookAndFeel.h"
+#include "UI/FrameScheduler.h"
 
-class StemPlayerAudioProcessorEditor : public juce::AudioProcessorEditor,
-                                        public juce::Timer
+class StemPlayerAudioProcessorEditor : public juce::AudioProcessorEditor
 {
 public:
     explicit StemPlayerAudioProcessorEditor(StemPlayerAudioProcessor&);
@@ -18,11 +18,8 @@ public:
     void paint(juce::Graphics&) override;
     void resized() override;
     void moved() override;
-    void timerCallback() override;
 
     void showScreen(StemPlayerAudioProcessor::Screen screen);
-    void onSongSelected(const juce::String& songName, const std::array<juce::File, NUM_STEM_TYPES>& stemFiles, 
-                        const std::array<bool, NUM_STEM_TYPES>& stemFound);
 
 private:
     void saveWindowBounds();
@@ -34,6 +31,8 @@ private:
     std::unique_ptr<SelectionScreen> selectionScreen;
     std::unique_ptr<MainScreen> mainScreen;
     std::unique_ptr<SettingsScreen> settingsScreen;
+    
+    FrameScheduler frameScheduler;
 
     JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(StemPlayerAudioProcessorEditor)
 };
@@ -6,6 +6,10 @@ StemPlayerAudioProcessor::StemPlayerAudioProcessor()
                      .withOutput("Output", juce::AudioChannelSet::stereo(), true))
 {
     appSettings.loadSettings();
+    libraryIndex.loadIndex();
+    mixMemory.load();
+    stemEngine.setPeakSidecars(appSettings.getPeakSidecars());
+    updateOscReceiver();
     
     if (appSettings.getDefaultFolder().isNotEmpty())
         currentScreen = Screen::Selection;
@@ -15,6 +19,17 @@ StemPlayerAudioProcessor::~StemPlayerAudioProcessor()
 {
 }
 
+bool StemPlayerAudioProcessor::updateOscReceiver()
+{
+    if (!appSettings.getOscEnabled())
+    {
+        oscReceiver.stop();
+        return true;
+    }
+    
+    return oscReceiver.start(appSettings.getOscPort());
+}
+
 const juce::String StemPlayerAudioProcessor::getName() const
 {
     return JucePlugin_Name;
@@ -27,7 +42,7 @@ bool StemPlayerAudioProcessor::acceptsMidi() const
 
 bool StemPlayerAudioProcessor::producesMidi() const
 {
-    return false;
+    return true;
 }
 
 bool StemPlayerAudioProcessor::isMidiEffect() const
@@ -87,15 +102,13 @@ void StemPlayerAudioProcessor::processBlock(juce::AudioBuffer<float>& buffer,
 {
     juce::ScopedNoDenormals noDenormals;
 
-    // Process MIDI for learn
-    midiLearnManager.processMidiMessages(midiMessages, stemEngine);
-
     // Clear output
     for (auto i = getTotalNumInputChannels(); i < getTotalNumOutputChannels(); ++i)
         buffer.clear(i, 0, buffer.getNumSamples());
 
-    // Process stems
-    stemEngine.processBlock(buffer);
+    // Process stems, applying mapped MIDI at each event's sample position; what goes
+    // back out is feedback for the controller
+    stemEngine.processBlock(buffer, midiMessages, midiLearnManager, mixParameters);
 }
 
 bool StemPlayerAudioProcessor::hasEditor() const
@@ -116,6 +129,9 @@ void StemPlayerAudioProcessor::getStateInformation(juce::MemoryBlock& destData)
     auto midiMappings = midiLearnManager.getStateAsValueTree();
     state.addChild(midiMappings, -1, nullptr);
     
+    // Host parameters, one id/value pair each
+    state.addChild(parameters.copyState(), -1, nullptr);
+    
     std::unique_ptr<juce::XmlElement> xml(state.createXml());
     copyXmlToBinary(*xml, destData);
 }
@@ -131,6 +147,10 @@ void StemPlayerAudioProcessor::setStateInformation(const void* data, int sizeInB
         auto midiMappings = state.getChildWithName("MidiMappings");
         if (midiMappings.isValid())
             midiLearnManager.loadStateFromValueTree(midiMappings);
+        
+        auto parameterState = state.getChildWithName(parameters.state.getType());
+        if (parameterState.isValid())
+            parameters.replaceState(parameterState);
     }
 }
 
@@ -4,6 +4,10 @@
 #include "Core/StemEngine.h"
 #include "Core/MidiLearnManager.h"
 #include "Core/AppSettings.h"
+#include "Core/LibraryIndex.h"
+#include "Core/SongSwitcher.h"
+#include "Core/MixParameters.h"
+#include "Core/OscReceiver.h"
 
 class StemPlayerAudioProcessor : public juce::AudioProcessor
 {
@@ -40,6 +44,13 @@ public:
     StemEngine& getStemEngine() { return stemEngine; }
     MidiLearnManager& getMidiLearnManager() { return midiLearnManager; }
     AppSettings& getAppSettings() { return appSettings; }
+    LibraryIndex& getLibraryIndex() { return libraryIndex; }
+    SongSwitcher& getSongSwitcher() { return songSwitcher; }
+    juce::AudioProcessorValueTreeState& getParameters() { return parameters; }
+    OscReceiver& getOscReceiver() { return oscReceiver; }
+    
+    // Starts or stops the OSC receiver to match the settings; false if the port can't be used
+    bool updateOscReceiver();
 
     enum class Screen { Selection, Main, Settings };
     Screen getCurrentScreen() const { return currentScreen; }
@@ -49,6 +60,12 @@ private:
     StemEngine stemEngine;
     MidiLearnManager midiLearnManager;
     AppSettings appSettings;
+    LibraryIndex libraryIndex;
+    MixMemory mixMemory;
+    SongSwitcher songSwitcher { stemEngine, mixMemory };
+    juce::AudioProcessorValueTreeState parameters { *this, nullptr, "Parameters", MixParameters::createLayout() };
+    MixParameters mixParameters { parameters };
+    OscReceiver oscReceiver { stemEngine };
     Screen currentScreen { Screen::Selection };
 
     JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(StemPlayerAudioProcessor)
@@ -0,0 +1,16 @@
+#include "FrameScheduler.h"
+
+FrameScheduler::FrameScheduler(juce::Component& c, StemEngine& e)
+    : component(c), engine(e),
+      vblankAttachment(&c, [this]() { onFrame(); })
+{
+}
+
+void FrameScheduler::onFrame()
+{
+    if (!component.isShowing() || clients.isEmpty())
+        return;
+    
+    engine.getState(state);
+    clients.call([this](Client& client) { client.frameUpdate(state); });
+}
@@ -0,0 +1,36 @@
+#pragma once
+
+#include <JuceHeader.h>
+#include "../Core/StemEngine.h"
+
+// Drives every per-frame UI update from the display refresh of the component it is
+// attached to. Each frame takes one snapshot of the engine state and hands it to every
+// client, so all of them show the same instant. Nothing runs while the component isn't
+// showing (hidden, minimised or closed).
+class FrameScheduler
+{
+public:
+    class Client
+    {
+    public:
+        virtual ~Client() = default;
+        virtual void frameUpdate(const StemEngine::State& state) = 0;
+    };
+    
+    FrameScheduler(juce::Component& component, StemEngine& engine);
+    ~FrameScheduler() = default;
+    
+    void addClient(Client* client) { clients.add(client); }
+    void removeClient(Client* client) { clients.remove(client); }
+
+private:
+    void onFrame();
+    
+    juce::Component& component;
+    StemEngine& engine;
+    juce::ListenerList<Client> clients;
+    StemEngine::State state;
+    juce::VBlankAttachment vblankAttachment;
+    
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(FrameScheduler)
+};
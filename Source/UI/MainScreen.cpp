@@ -8,6 +8,7 @@ PlayheadOverlay::PlayheadOverlay(MainScreen& owner)
     : mainScreen(owner)
 {
     setInterceptsMouseClicks(true, false);
+    cuePoints.fill(-1.0);
 }
 
 void PlayheadOverlay::paint(juce::Graphics& g)
@@ -15,10 +16,30 @@ void PlayheadOverlay::paint(juce::Graphics& g)
     if (getWidth() <= 0)
         return;
     
-    if (playbackPosition >= 0.0 && playbackPosition <= 1.0)
+    // Numbered cue markers along the top
+    g.setFont(juce::Font(10.0f, juce::Font::bold));
+    
+    for (int i = 0; i < StemEngine::numCuePoints; ++i)
+    {
+        const double cue = cuePoints[(size_t) i];
+        if (cue < 0.0 || !visibleRange.contains(cue))
+            continue;
+        
+        const float cueX = 2.0f + (float) ((cue - visibleRange.getStart()) / visibleRange.getLength()) * ((float) getWidth() - 4.0f);
+        
+        g.setColour(StemPlayerLookAndFeel::accentPrimary.withAlpha(0.5f));
+        g.fillRect(cueX - 0.5f, 0.0f, 1.0f, (float) getHeight());
+        g.setColour(StemPlayerLookAndFeel::accentPrimary);
+        g.fillRect(cueX, 0.0f, 12.0f, 12.0f);
+        g.setColour(StemPlayerLookAndFeel::backgroundDark);
+        g.drawText(juce::String(i + 1), juce::Rectangle<float>(cueX, 0.0f, 12.0f, 12.0f), juce::Justification::centred, false);
+    }
+    
+    if (playbackPosition >= 0.0 && visibleRange.contains(playbackPosition))
     {
         // Minimal style - simple vertical line
-        float playheadX = 2.0f + (float)playbackPosition * ((float)getWidth() - 4.0f);
+        const double relative = (playbackPosition - visibleRange.getStart()) / visibleRange.getLength();
+        float playheadX = 2.0f + (float)relative * ((float)getWidth() - 4.0f);
         
         // Thin glow
         g.setColour(StemPlayerLookAndFeel::playheadColor.withAlpha(0.2f));
@@ -35,14 +56,8 @@ void PlayheadOverlay::mouseDown(const juce::MouseEvent& event)
     if (waveformArea.isEmpty())
         return;
     
-    // The overlay is now positioned directly over the waveform area
-    // so event.position.x is already relative to the waveform
-    float relativeX = event.position.x - 4.0f;
-    float width = (float)getWidth() - 8.0f;
-    
-    double newPosition = juce::jlimit(0.0, 1.0, (double)(relativeX / width));
-    playbackPosition = newPosition;
-    repaint();
+    double newPosition = getPositionAt(event.position.x);
+    setPlaybackPosition(newPosition);
     
     if (onPositionChanged)
         onPositionChanged(newPosition);
@@ -53,11 +68,79 @@ void PlayheadOverlay::mouseDrag(const juce::MouseEvent& event)
     mouseDown(event);
 }
 
+void PlayheadOverlay::mouseDoubleClick(const juce::MouseEvent&)
+{
+    if (onZoomReset)
+        onZoomReset();
+}
+
+void PlayheadOverlay::mouseWheelMove(const juce::MouseEvent& event, const juce::MouseWheelDetails& wheel)
+{
+    // Horizontal wheel or shift+wheel scrolls, vertical wheel zooms around the mouse
+    if (wheel.deltaX != 0.0f || event.mods.isShiftDown())
+    {
+        const float delta = wheel.deltaX != 0.0f ? wheel.deltaX : wheel.deltaY;
+        
+        if (onScroll)
+            onScroll(-delta * visibleRange.getLength());
+    }
+    else if (wheel.deltaY != 0.0f && onZoom)
+    {
+        onZoom(getPositionAt(event.position.x), std::pow(0.5, wheel.deltaY * 3.0f));
+    }
+}
+
+void PlayheadOverlay::mouseMagnify(const juce::MouseEvent& event, float scaleFactor)
+{
+    if (onZoom && scaleFactor > 0.0f)
+        onZoom(getPositionAt(event.position.x), 1.0 / scaleFactor);
+}
+
+double PlayheadOverlay::getPositionAt(float x) const
+{
+    // The overlay is positioned directly over the waveform area
+    // so x is already relative to the waveform
+    float relativeX = x - 4.0f;
+    float width = (float)getWidth() - 8.0f;
+    
+    double relative = juce::jlimit(0.0, 1.0, (double)(relativeX / width));
+    return visibleRange.getStart() + relative * visibleRange.getLength();
+}
+
+void PlayheadOverlay::setVisibleRange(juce::Range<double> normalizedRange)
+{
+    visibleRange = normalizedRange;
+    repaint();
+}
+
 void PlayheadOverlay::setPlaybackPosition(double normalizedPosition)
 {
-    if (std::abs(playbackPosition - normalizedPosition) > 0.001)
+    const auto oldArea = getPlayheadArea(playbackPosition);
+    const auto newArea = getPlayheadArea(normalizedPosition);
+    playbackPosition = normalizedPosition;
+    
+    // Repaint once the playhead reaches another pixel of the visible range, however far zoomed in
+    if (newArea != oldArea)
+    {
+        // The overlay is transparent, so a full repaint would redraw every track
+        // underneath it; only the strips under the old and new playhead change
+        repaint(oldArea);
+        repaint(newArea);
+    }
+}
+
+juce::Rectangle<int> PlayheadOverlay::getPlayheadArea(double position) const
+{
+    const double relative = (position - visibleRange.getStart()) / visibleRange.getLength();
+    const int x = 2 + juce::roundToInt(relative * (getWidth() - 4));
+    return { x - 3, 0, 6, getHeight() };
+}
+
+void PlayheadOverlay::setCuePoints(const std::array<double, StemEngine::numCuePoints>& normalizedCues)
+{
+    if (cuePoints != normalizedCues)
     {
-        playbackPosition = normalizedPosition;
+        cuePoints = normalizedCues;
         repaint();
     }
 }
@@ -106,6 +189,31 @@ MainScreen::MainScreen(StemPlayerAudioProcessor& processor,
     };
     addAndMakeVisible(stopButton);
     
+    // Mix automation: play back the song's recorded moves, or record new ones
+    automationButton.setTooltip("Play back this song's recorded mix moves");
+    automationButton.setColour(juce::TextButton::buttonOnColourId, StemPlayerLookAndFeel::accentPrimary);
+    automationButton.onClick = [this]() {
+        auto& engine = audioProcessor.getStemEngine();
+        engine.setAutomationPlayback(engine.getAutomationMode() == StemEngine::AutomationMode::Off);
+    };
+    addAndMakeVisible(automationButton);
+    
+    recordButton.setTooltip("Record volume, mute and solo moves for this song, replacing what was recorded before");
+    recordButton.setColour(juce::TextButton::buttonOnColourId, juce::Colours::red.darker(0.2f));
+    recordButton.onClick = [this]() {
+        auto& switcher = audioProcessor.getSongSwitcher();
+        if (audioProcessor.getStemEngine().getAutomationMode() == StemEngine::AutomationMode::Write)
+            switcher.stopAutomationRecording();
+        else
+            switcher.startAutomationRecording();
+    };
+    addAndMakeVisible(recordButton);
+    
+    // Named mixes of this song, for A/B'ing practice mixes
+    mixesButton.setTooltip("Recall, save or delete named mixes of this song");
+    mixesButton.onClick = [this]() { showMixesMenu(); };
+    addAndMakeVisible(mixesButton);
+    
     // Time display
     timeLabel.setFont(juce::Font(14.0f, juce::Font::FontStyleFlags::plain));
     timeLabel.setColour(juce::Label::textColourId, StemPlayerLookAndFeel::textSecondary);
@@ -122,8 +230,17 @@ MainScreen::MainScreen(StemPlayerAudioProcessor& processor,
     playheadOverlay.onPositionChanged = [this](double pos) {
         audioProcessor.getStemEngine().setPositionNormalized(pos);
     };
+    playheadOverlay.onZoom = [this](double anchor, double factor) { zoomAround(anchor, factor); };
+    playheadOverlay.onScroll = [this](double delta) { setVisibleRange(visibleRange + delta); };
+    playheadOverlay.onZoomReset = [this]() { setVisibleRange({ 0.0, 1.0 }); };
     addAndMakeVisible(playheadOverlay);
     
+    // Scroll bar for the zoomed view, only shown while zoomed in
+    zoomScrollBar.setRangeLimits(0.0, 1.0);
+    zoomScrollBar.setAutoHide(false);
+    zoomScrollBar.addListener(this);
+    addChildComponent(zoomScrollBar);
+    
     // Enable keyboard focus
     setWantsKeyboardFocus(true);
     addKeyListener(this);
@@ -131,6 +248,7 @@ MainScreen::MainScreen(StemPlayerAudioProcessor& processor,
 
 MainScreen::~MainScreen()
 {
+    zoomScrollBar.removeListener(this);
     removeKeyListener(this);
 }
 
@@ -215,10 +333,21 @@ void MainScreen::resized()
     playPauseButton.setBounds(header.removeFromRight(40));
     header.removeFromRight(20);
     
+    // Automation buttons
+    recordButton.setBounds(header.removeFromRight(48).reduced(0, 4));
+    header.removeFromRight(6);
+    automationButton.setBounds(header.removeFromRight(48).reduced(0, 4));
+    header.removeFromRight(6);
+    mixesButton.setBounds(header.removeFromRight(60).reduced(0, 4));
+    header.removeFromRight(20);
+    
     // Song name takes remaining center space
     titleLabel.setVisible(false);  // Hide "Now Playing" label to save space
     songNameLabel.setBounds(header);
     
+    if (zoomScrollBar.isVisible())
+        zoomScrollBar.setBounds(bounds.removeFromBottom(10));
+    
     // Tracks area - full width, no padding
     auto viewportBounds = bounds;
     tracksViewport.setBounds(viewportBounds);
@@ -252,6 +381,7 @@ void MainScreen::resized()
 void MainScreen::songLoaded(const juce::String& songName)
 {
     songNameLabel.setText(songName, juce::dontSendNotification);
+    visibleRange = { 0.0, 1.0 };
     createTrackComponents();
     updateWaveformDisplayMode();
     updateTransportButtons();
@@ -272,9 +402,11 @@ void MainScreen::createTrackComponents()
         
         auto trackComp = std::make_unique<StemTrackComponent>(i);
         
-        trackComp->setTrack(engine.getTrack(i));
+        trackComp->setTrack(engine.getLoadedTrack(i));
         trackComp->setDrawPlayhead(false);  // Disable individual playheads
         trackComp->setTrackLoaded(true);
+        trackComp->setSpectrogramTiles(&spectrogramTiles);
+        trackComp->setSpectrogramMode(spectrogramModes[(size_t) i]);
         
         trackComp->onVolumeChanged = [this](int trackIndex, float volume) {
             audioProcessor.getStemEngine().setTrackVolume(trackIndex, volume);
@@ -284,9 +416,51 @@ void MainScreen::createTrackComponents()
             audioProcessor.getStemEngine().setPositionNormalized(pos);
         };
         
+        trackComp->onSpectrogramModeChanged = [this](int trackIndex, bool spectrogram) {
+            spectrogramModes[(size_t) trackIndex] = spectrogram;
+        };
+        
         tracksContainer.addAndMakeVisible(trackComp.get());
         trackComponents.push_back(std::move(trackComp));
     }
+    
+    setVisibleRange(visibleRange);
+}
+
+void MainScreen::setVisibleRange(juce::Range<double> newRange)
+{
+    // Keep the range inside the song without changing its length
+    newRange = juce::Range<double>(0.0, 1.0).constrainRange(newRange);
+    visibleRange = newRange;
+    
+    for (auto& trackComp : trackComponents)
+        trackComp->setVisibleRange(visibleRange);
+    
+    playheadOverlay.setVisibleRange(visibleRange);
+    zoomScrollBar.setCurrentRange(visibleRange, juce::dontSendNotification);
+    
+    const bool zoomed = visibleRange.getLength() < 1.0;
+    if (zoomScrollBar.isVisible() != zoomed)
+    {
+        zoomScrollBar.setVisible(zoomed);
+        resized();
+    }
+}
+
+void MainScreen::zoomAround(double anchor, double lengthFactor)
+{
+    const double totalSeconds = audioProcessor.getStemEngine().getTotalLengthInSeconds();
+    const double minLength = totalSeconds > minVisibleSeconds ? minVisibleSeconds / totalSeconds : 1.0;
+    const double newLength = juce::jlimit(minLength, 1.0, visibleRange.getLength() * lengthFactor);
+    
+    // The anchor stays under the mouse
+    const double anchorOffset = (anchor - visibleRange.getStart()) / visibleRange.getLength();
+    setVisibleRange({ anchor - anchorOffset * newLength, anchor + (1.0 - anchorOffset) * newLength });
+}
+
+void MainScreen::scrollBarMoved(juce::ScrollBar*, double newRangeStart)
+{
+    setVisibleRange(visibleRange.movedToStartAt(newRangeStart));
 }
 
 void MainScreen::updatePlayheadOverlay()
@@ -319,34 +493,94 @@ void MainScreen::updatePlayheadOverlay()
     }
 }
 
-void MainScreen::updatePlaybackPosition()
+void MainScreen::frameUpdate(const StemEngine::State& state)
 {
-    auto& engine = audioProcessor.getStemEngine();
-    double pos = engine.getPositionNormalized();
+    if (!isVisible())
+        return;
+    
+    double pos = state.getPositionNormalized();
+    
+    // Page a zoomed view along with the playhead while playing
+    if (state.playing && visibleRange.getLength() < 1.0 && !visibleRange.contains(pos))
+        setVisibleRange(visibleRange.movedToStartAt(pos));
+    
+    // Waveforms still being built fill in around what is on screen first
+    audioProcessor.getStemEngine().setWaveformFocus(pos, visibleRange);
     
     // Update playhead overlay
     playheadOverlay.setPlaybackPosition(pos);
-    updatePlayheadOverlay();
+    
+    std::array<double, StemEngine::numCuePoints> cues;
+    for (size_t i = 0; i < cues.size(); ++i)
+        cues[i] = state.cuePoints[i] >= 0 && state.totalLengthInSamples > 0
+                    ? static_cast<double>(state.cuePoints[i]) / static_cast<double>(state.totalLengthInSamples) : -1.0;
+    playheadOverlay.setCuePoints(cues);
     
     // Still update individual track positions for waveform rendering (without playhead)
     for (auto& trackComp : trackComponents)
-        trackComp->updatePlaybackPosition(pos);
+        trackComp->frameUpdate(pos, state.levels[(size_t) trackComp->getTrackIndex()]);
     
     // Update time display
-    double currentTime = engine.getPositionInSeconds();
-    double totalTime = engine.getTotalLengthInSeconds();
-    timeLabel.setText(formatTime(currentTime) + " / " + formatTime(totalTime), 
+    timeLabel.setText(formatTime(state.getPositionInSeconds()) + " / " + formatTime(state.getTotalLengthInSeconds()), 
                       juce::dontSendNotification);
     
     // Update stem volumes from MIDI (in case they changed via MIDI)
+    const bool anySolo = std::find(state.solo.begin(), state.solo.end(), true) != state.solo.end();
+    
     for (auto& trackComp : trackComponents)
     {
-        int stemIndex = trackComp->getTrackIndex();
-        if (auto* track = engine.getTrack(stemIndex))
-            trackComp->setVolume(track->getVolume());
+        const auto index = (size_t) trackComp->getTrackIndex();
+        trackComp->setVolume(state.volumes[index]);
+        trackComp->setMixState(state.muted[index], state.solo[index], !state.muted[index] && (!anySolo || state.solo[index]));
     }
     
-    updateTransportButtons();
+    const auto icon = state.playing ? IconType::Pause : IconType::Play;
+    if (playPauseButton.getIconType() != icon)
+        playPauseButton.setIconType(icon);
+    
+    const auto automationMode = audioProcessor.getStemEngine().getAutomationMode();
+    automationButton.setToggleState(automationMode == StemEngine::AutomationMode::Read, juce::dontSendNotification);
+    recordButton.setToggleState(automationMode == StemEngine::AutomationMode::Write, juce::dontSendNotification);
+}
+
+void MainScreen::showMixesMenu()
+{
+    const auto names = audioProcessor.getSongSwitcher().getMixSnapshotNames();
+    juce::PopupMenu menu;
+    juce::PopupMenu deleteMenu;
+    
+    for (const auto& name : names)
+    {
+        menu.addItem(name, [this, name]() { audioProcessor.getSongSwitcher().recallMixSnapshot(name); });
+        deleteMenu.addItem(name, [this, name]() { audioProcessor.getSongSwitcher().removeMixSnapshot(name); });
+    }
+    
+    if (names.isEmpty())
+        menu.addItem("No saved mixes", false, false, std::function<void()>());
+    
+    menu.addSeparator();
+    menu.addItem("Save Mix As...", [this]() { saveMixAs(); });
+    menu.addSubMenu("Delete", deleteMenu, !names.isEmpty());
+    
+    menu.showMenuAsync(juce::PopupMenu::Options().withTargetComponent(&mixesButton));
+}
+
+void MainScreen::saveMixAs()
+{
+    const int count = audioProcessor.getSongSwitcher().getMixSnapshotNames().size();
+    
+    auto* window = new juce::AlertWindow("Save Mix", "Name for the current mix of this song:", juce::MessageBoxIconType::NoIcon);
+    window->addTextEditor("name", "Mix " + juce::String(count + 1));
+    window->addButton("Save", 1, juce::KeyPress(juce::KeyPress::returnKey));
+    window->addButton("Cancel", 0, juce::KeyPress(juce::KeyPress::escapeKey));
+    
+    // The window is deleted once the callback has run; a name in use is overwritten
+    window->enterModalState(true, juce::ModalCallbackFunction::create([this, window](int result)
+    {
+        const auto name = window->getTextEditorContents("name").trim();
+        if (result == 1 && name.isNotEmpty())
+            audioProcessor.getSongSwitcher().saveMixSnapshot(name);
+    }), true);
 }
 
 void MainScreen::updateTransportButtons()
@@ -365,7 +599,11 @@ juce::String MainScreen::formatTime(double seconds)
 void MainScreen::updateWaveformDisplayMode()
 {
     bool separateChannels = audioProcessor.getAppSettings().getShowSeparateChannels();
+    bool frequencyColours = audioProcessor.getAppSettings().getFrequencyColours();
     
     for (auto& trackComp : trackComponents)
+    {
         trackComp->setShowSeparateChannels(separateChannels);
+        trackComp->setFrequencyColours(frequencyColours);
+    }
 }
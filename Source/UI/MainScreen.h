@@ -3,6 +3,7 @@
 #include <JuceHeader.h>
 #include "StemTrackComponent.h"
 #include "IconButton.h"
+#include "FrameScheduler.h"
 
 class StemPlayerAudioProcessor;
 class StemPlayerAudioProcessorEditor;
@@ -17,20 +18,36 @@ public:
     void paint(juce::Graphics& g) override;
     void mouseDown(const juce::MouseEvent& event) override;
     void mouseDrag(const juce::MouseEvent& event) override;
+    void mouseDoubleClick(const juce::MouseEvent& event) override;
+    void mouseWheelMove(const juce::MouseEvent& event, const juce::MouseWheelDetails& wheel) override;
+    void mouseMagnify(const juce::MouseEvent& event, float scaleFactor) override;
     
     void setPlaybackPosition(double normalizedPosition);
     void setWaveformBounds(juce::Rectangle<int> bounds);
+    void setVisibleRange(juce::Range<double> normalizedRange);
+    // Normalised cue positions, negative for cues that aren't set
+    void setCuePoints(const std::array<double, StemEngine::numCuePoints>& normalizedCues);
     
     std::function<void(double)> onPositionChanged;
+    std::function<void(double, double)> onZoom;     // Normalised anchor position, length factor
+    std::function<void(double)> onScroll;           // Normalised distance
+    std::function<void()> onZoomReset;
 
 private:
+    double getPositionAt(float x) const;
+    juce::Rectangle<int> getPlayheadArea(double position) const;
+    
     MainScreen& mainScreen;
     double playbackPosition { 0.0 };
+    juce::Range<double> visibleRange { 0.0, 1.0 };
     juce::Rectangle<int> waveformArea;
+    std::array<double, StemEngine::numCuePoints> cuePoints;
 };
 
 class MainScreen : public juce::Component,
-                   public juce::KeyListener
+                   public juce::KeyListener,
+                   public juce::ScrollBar::Listener,
+                   public FrameScheduler::Client
 {
 public:
     MainScreen(StemPlayerAudioProcessor& processor, 
@@ -42,15 +59,24 @@ public:
     void visibilityChanged() override;
     
     bool keyPressed(const juce::KeyPress& key, juce::Component* originatingComponent) override;
+    void scrollBarMoved(juce::ScrollBar* scrollBar, double newRangeStart) override;
     
     void songLoaded(const juce::String& songName);
-    void updatePlaybackPosition();
+    void frameUpdate(const StemEngine::State& state) override;
     void updateWaveformDisplayMode();
 
 private:
     void createTrackComponents();
     void updateTransportButtons();
     void updatePlayheadOverlay();
+    
+    // Saved mixes of the song: recall, save and delete
+    void showMixesMenu();
+    void saveMixAs();
+    
+    // Zoom and scroll, shared by every track and the playhead overlay
+    void setVisibleRange(juce::Range<double> newRange);
+    void zoomAround(double anchor, double lengthFactor);
     juce::String formatTime(double seconds);
     
     StemPlayerAudioProcessor& audioProcessor;
@@ -61,13 +87,24 @@ private:
     IconButton backButton { IconType::Back };
     IconButton playPauseButton { IconType::Play };
     IconButton stopButton { IconType::Stop };
+    juce::TextButton automationButton { "Auto" };
+    juce::TextButton recordButton { "Rec" };
+    juce::TextButton mixesButton { "Mixes" };
     juce::Label timeLabel;
     
     juce::Viewport tracksViewport;
     juce::Component tracksContainer;
+    
+    // Shared by every track so the tile memory bound covers all stems together
+    SpectrogramTiles spectrogramTiles { 192 };
+    std::array<bool, NUM_STEM_TYPES> spectrogramModes {};
     std::vector<std::unique_ptr<StemTrackComponent>> trackComponents;
     
     PlayheadOverlay playheadOverlay;
+    juce::ScrollBar zoomScrollBar { false };
+    juce::Range<double> visibleRange { 0.0, 1.0 };
+    
+    static constexpr double minVisibleSeconds = 0.5;
     
     JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(MainScreen)
 };
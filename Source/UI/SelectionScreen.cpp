@@ -3,65 +3,146 @@
 #include "../PluginEditor.h"
 #include "LookAndFeel.h"
 
+namespace
+{
+    // Same shaping as Graphics::drawText, done once per row instead of every paint
+    void addText(juce::GlyphArrangement& glyphs, const juce::Font& font, const juce::String& text,
+                 juce::Rectangle<int> area, juce::Justification justification)
+    {
+        if (text.isEmpty() || area.isEmpty())
+            return;
+        
+        glyphs.addCurtailedLineOfText(font, text, 0.0f, 0.0f, static_cast<float>(area.getWidth()), true);
+        glyphs.justifyGlyphs(0, glyphs.getNumGlyphs(), static_cast<float>(area.getX()), static_cast<float>(area.getY()),
+                             static_cast<float>(area.getWidth()), static_cast<float>(area.getHeight()), justification);
+    }
+    
+    juce::uint64 combineHash(juce::uint64 hash, juce::uint64 value)
+    {
+        return (hash ^ value) * 1099511628211ULL;
+    }
+}
+
 // SongListModel implementation
-void SongListModel::setSongs(const juce::Array<DetectedSong>& songs)
+void SongListModel::setCatalog(std::shared_ptr<const SongCatalog> newCatalog)
+{
+    catalog = std::move(newCatalog);
+    clearFilter();
+}
+
+void SongListModel::setFilter(std::vector<int> songIndices)
 {
-    detectedSongs = songs;
+    visibleSongs = std::move(songIndices);
+    filtered = true;
 }
 
-const DetectedSong* SongListModel::getSong(int index) const
+void SongListModel::clearFilter()
 {
-    if (index >= 0 && index < detectedSongs.size())
-        return &detectedSongs.getReference(index);
-    return nullptr;
+    visibleSongs.clear();
+    filtered = false;
+}
+
+int SongListModel::getSongIndex(int row) const
+{
+    if (catalog == nullptr || row < 0)
+        return -1;
+    
+    if (filtered)
+    {
+        if (row >= static_cast<int>(visibleSongs.size()))
+            return -1;
+        row = visibleSongs[(size_t) row];
+    }
+    
+    return row < catalog->size() ? row : -1;
+}
+
+juce::uint64 SongListModel::getRowKey(int row) const
+{
+    const int songIndex = getSongIndex(row);
+    return songIndex >= 0 ? getContentKey(songIndex) : 0;
+}
+
+juce::uint64 SongListModel::getContentKey(int songIndex) const
+{
+    juce::uint64 key = 14695981039346656037ULL;
+    key = combineHash(key, (juce::uint64) catalog->getName(songIndex).hashCode64());
+    key = combineHash(key, (juce::uint64) catalog->getDurationLabel(songIndex).hashCode64());
+    key = combineHash(key, (juce::uint64) catalog->getWarning(songIndex).hashCode64());
+    key = combineHash(key, (juce::uint64) catalog->getStemLabel(songIndex).hashCode64());
+    return key;
+}
+
+const SongListModel::RowLayout& SongListModel::getRowLayout(int songIndex, int width, int height)
+{
+    const auto key = combineHash(getContentKey(songIndex), (juce::uint64) width << 32 | (juce::uint64) height);
+    
+    auto found = layoutCache.find(key);
+    if (found != layoutCache.end())
+        return found->second;
+    
+    // Only a screenful of rows is ever in use, so starting over is cheaper than tracking age
+    if (layoutCache.size() >= maxCachedLayouts)
+        layoutCache.clear();
+    
+    RowLayout& layout = layoutCache[key];
+    
+    auto bounds = juce::Rectangle<int>(0, 0, width, height).reduced(4, 2);
+    auto topRow = bounds.reduced(8, 0).removeFromTop(height / 2 + 4);
+    auto bottomRow = bounds.reduced(8, 0).removeFromBottom(height / 2);
+    
+    // Duration on the right of the name
+    const auto& duration = catalog->getDurationLabel(songIndex);
+    if (duration.isNotEmpty())
+        addText(layout.duration, durationFont, duration, topRow.removeFromRight(50), juce::Justification::centredRight);
+    
+    addText(layout.name, nameFont, catalog->getName(songIndex), topRow, juce::Justification::centredLeft);
+    
+    // Format problems found while probing
+    const auto& warning = catalog->getWarning(songIndex);
+    if (warning.isNotEmpty())
+        addText(layout.warning, detailFont, warning, bottomRow.removeFromRight(bottomRow.getWidth() / 2),
+                juce::Justification::centredRight);
+    
+    // Which stems are available (label cached per stem combination)
+    addText(layout.stems, detailFont, catalog->getStemLabel(songIndex), bottomRow, juce::Justification::centredLeft);
+    
+    return layout;
 }
 
 int SongListModel::getNumRows()
 {
-    return detectedSongs.size();
+    if (catalog == nullptr)
+        return 0;
+    return filtered ? static_cast<int>(visibleSongs.size()) : catalog->size();
 }
 
 void SongListModel::paintListBoxItem(int rowNumber, juce::Graphics& g, 
                                       int width, int height, bool rowIsSelected)
 {
-    if (rowNumber < 0 || rowNumber >= detectedSongs.size())
+    int songIndex = getSongIndex(rowNumber);
+    if (songIndex < 0)
         return;
     
-    auto bounds = juce::Rectangle<int>(0, 0, width, height).reduced(4, 2);
-    
     // Background
     if (rowIsSelected)
     {
         g.setColour(StemPlayerLookAndFeel::accentPrimary.withAlpha(0.3f));
-        g.fillRect(bounds.toFloat());
+        g.fillRect(juce::Rectangle<int>(0, 0, width, height).reduced(4, 2).toFloat());
     }
     
-    const auto& song = detectedSongs.getReference(rowNumber);
+    // Text is shaped once per row content and size, then just drawn
+    const auto& layout = getRowLayout(songIndex, width, height);
+    
+    g.setColour(StemPlayerLookAndFeel::textSecondary);
+    layout.duration.draw(g);
+    layout.stems.draw(g);
     
-    // Song name
     g.setColour(StemPlayerLookAndFeel::textPrimary);
-    g.setFont(juce::Font(15.0f, juce::Font::bold));
-    g.drawText(song.songName, bounds.reduced(8, 0).removeFromTop(height / 2 + 4), 
-               juce::Justification::centredLeft, true);
-    
-    // Show which stems are available
-    juce::String stemInfo;
-    int stemCount = 0;
-    for (int i = 0; i < NUM_STEM_TYPES; ++i)
-    {
-        if (song.stemFound[i])
-        {
-            if (stemCount > 0) stemInfo += ", ";
-            stemInfo += StemDetector::getStemTypeName(i);
-            stemCount++;
-        }
-    }
-    stemInfo = juce::String(stemCount) + " stems: " + stemInfo;
+    layout.name.draw(g);
     
-    g.setColour(StemPlayerLookAndFeel::textSecondary);
-    g.setFont(juce::Font(12.0f));
-    g.drawText(stemInfo, bounds.reduced(8, 0).removeFromBottom(height / 2), 
-               juce::Justification::centredLeft, true);
+    g.setColour(StemPlayerLookAndFeel::accentPrimary);
+    layout.warning.draw(g);
 }
 
 void SongListModel::listBoxItemClicked(int row, const juce::MouseEvent& /*e*/)
@@ -111,6 +192,24 @@ SelectionScreen::SelectionScreen(StemPlayerAudioProcessor& processor,
     };
     addAndMakeVisible(settingsButton);
     
+    // Search box filters the list as you type
+    searchBox.setFont(juce::Font(14.0f));
+    searchBox.setTextToShowWhenEmpty("Search songs and folders", StemPlayerLookAndFeel::textSecondary);
+    searchBox.setColour(juce::TextEditor::backgroundColourId, StemPlayerLookAndFeel::backgroundLight);
+    searchBox.setColour(juce::TextEditor::textColourId, StemPlayerLookAndFeel::textPrimary);
+    searchBox.setColour(juce::TextEditor::outlineColourId, StemPlayerLookAndFeel::backgroundLight);
+    searchBox.onTextChange = [this]() { applySearch(); };
+    searchBox.onReturnKey = [this]() {
+        // Enter loads the best match
+        if (songListModel.getNumRows() > 0)
+        {
+            songListBox.selectRow(0);
+            selectedSongIndex = 0;
+            loadSelectedSong();
+        }
+    };
+    addAndMakeVisible(searchBox);
+    
     // Song list
     songListModel.onSongSelected = [this](int row) {
         selectedSongIndex = row;
@@ -170,14 +269,18 @@ void SelectionScreen::resized()
     header.removeFromRight(15);
     
     // Status label (song count)
-    statusLabel.setBounds(header.removeFromRight(100));
+    statusLabel.setBounds(header.removeFromRight(160));
     header.removeFromRight(10);
     
     // Folder path takes remaining space
     folderLabel.setBounds(header);
     
-    // Song list takes remaining space
+    // Search box above the list
     bounds.reduce(15, 10);
+    searchBox.setBounds(bounds.removeFromTop(30));
+    bounds.removeFromTop(8);
+    
+    // Song list takes remaining space
     songListBox.setBounds(bounds);
 }
 
@@ -308,28 +411,129 @@ void SelectionScreen::scanCurrentFolder()
 #endif
     
     folderLabel.setText(currentFolder.getFullPathName(), juce::dontSendNotification);
+    statusLabel.setText("Scanning...", juce::dontSendNotification);
+    
+    const int generation = ++scanGeneration;
+    
+    scanPool.addJob([folder = currentFolder,
+                     patterns = stemDetector.getPatterns(),
+                     &libraryIndex = audioProcessor.getLibraryIndex(),
+                     safeThis = juce::Component::SafePointer<SelectionScreen>(this),
+                     generation]() {
+        StemDetector detector;
+        detector.setPatterns(patterns);
+        
+        // The full scan results are only needed until the compact catalog is built
+        auto newCatalog = std::make_shared<SongCatalog>();
+        {
+            auto songs = detector.scanDirectory(folder);
+            libraryIndex.probeSongs(songs);
+            
+            for (const auto& song : songs)
+                newCatalog->addSong(song);
+            
+            newCatalog->finishBuilding();
+        }
+        
+        // Search ids are positions in the sorted catalog, so indexing waits for the sort
+        auto newSearchIndex = std::make_shared<SongSearchIndex>();
+        for (int i = 0; i < newCatalog->size(); ++i)
+            newSearchIndex->addSong(newCatalog->getName(i), newCatalog->getDirectory(i));
+        
+        juce::MessageManager::callAsync([safeThis, generation, newCatalog, newSearchIndex]() {
+            // A newer scan may have started while this one ran
+            if (safeThis != nullptr && safeThis->scanGeneration == generation)
+                safeThis->scanFinished(newCatalog, newSearchIndex);
+        });
+    });
+}
+
+void SelectionScreen::scanFinished(std::shared_ptr<const SongCatalog> newCatalog,
+                                   std::shared_ptr<const SongSearchIndex> newSearchIndex)
+{
+    catalog = std::move(newCatalog);
+    searchIndex = std::move(newSearchIndex);
+    audioProcessor.getSongSwitcher().setCatalog(catalog);
+    
+    int firstRow = 0;
+    const auto previousKeys = getVisibleRowKeys(firstRow);
+    
+    songListModel.setCatalog(catalog);
+    applySearch();
+    
+    // A rescan usually changes few rows, if any
+    repaintChangedRows(firstRow, previousKeys);
+}
+
+void SelectionScreen::applySearch()
+{
+    auto query = searchBox.getText().trim();
+    
+    int firstRow = 0;
+    const auto previousKeys = getVisibleRowKeys(firstRow);
+    
+    if (query.isEmpty() || searchIndex == nullptr)
+    {
+        songListModel.clearFilter();
+    }
+    else
+    {
+        std::vector<int> matches;
+        searchIndex->search(query, matches);
+        songListModel.setFilter(std::move(matches));
+    }
     
-    detectedSongs = stemDetector.scanDirectory(currentFolder);
-    songListModel.setSongs(detectedSongs);
     songListBox.updateContent();
+    songListBox.deselectAllRows();
+    repaintChangedRows(firstRow, previousKeys);
     
     selectedSongIndex = -1;
     loadButton.setEnabled(false);
     
-    if (detectedSongs.isEmpty())
+    updateStatus();
+}
+
+std::vector<juce::uint64> SelectionScreen::getVisibleRowKeys(int& firstRow) const
+{
+    firstRow = juce::jmax(0, songListBox.getRowContainingPosition(0, 0));
+    
+    std::vector<juce::uint64> keys;
+    for (int row = firstRow; row <= firstRow + songListBox.getNumRowsOnScreen(); ++row)
+        keys.push_back(songListModel.getRowKey(row));
+    
+    return keys;
+}
+
+void SelectionScreen::repaintChangedRows(int firstRow, const std::vector<juce::uint64>& previousKeys)
+{
+    for (size_t i = 0; i < previousKeys.size(); ++i)
+    {
+        const int row = firstRow + static_cast<int>(i);
+        
+        if (songListModel.getRowKey(row) != previousKeys[i])
+            songListBox.repaintRow(row);
+    }
+}
+
+void SelectionScreen::updateStatus()
+{
+    if (catalog == nullptr || catalog->isEmpty())
         statusLabel.setText("No songs found. Check stem patterns in settings.", 
                            juce::dontSendNotification);
+    else if (songListModel.isFiltered())
+        statusLabel.setText(juce::String(songListModel.getNumRows()) + " of " 
+                            + juce::String(catalog->size()) + " songs", 
+                           juce::dontSendNotification);
     else
-        statusLabel.setText(juce::String(detectedSongs.size()) + " songs found", 
+        statusLabel.setText(juce::String(catalog->size()) + " songs, "
+                            + juce::String((int) catalog->getBytesPerSong()) + " B each", 
                            juce::dontSendNotification);
 }
 
 void SelectionScreen::loadSelectedSong()
 {
-    if (selectedSongIndex < 0 || selectedSongIndex >= detectedSongs.size())
-        return;
-    
-    const auto& song = detectedSongs.getReference(selectedSongIndex);
-    editor.onSongSelected(song.songName, song.stemFiles, song.stemFound);
+    int songIndex = songListModel.getSongIndex(selectedSongIndex);
+    if (songIndex >= 0)
+        audioProcessor.getSongSwitcher().loadSong(songIndex);
 }
 
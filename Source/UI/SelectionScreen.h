@@ -2,6 +2,8 @@
 
 #include <JuceHeader.h>
 #include "../Core/StemDetector.h"
+#include "../Core/SongSearchIndex.h"
+#include "../Core/SongCatalog.h"
 #include "IconButton.h"
 
 class StemPlayerAudioProcessor;
@@ -12,8 +14,18 @@ class SongListModel : public juce::ListBoxModel
 public:
     SongListModel() = default;
     
-    void setSongs(const juce::Array<DetectedSong>& songs);
-    const DetectedSong* getSong(int index) const;
+    // Shares the screen's catalog rather than copying it
+    void setCatalog(std::shared_ptr<const SongCatalog> newCatalog);
+    void setFilter(std::vector<int> songIndices);
+    void clearFilter();
+    bool isFiltered() const { return filtered; }
+    
+    // Catalog index shown in the given row, or -1
+    int getSongIndex(int row) const;
+    
+    // Hash of everything a row displays (0 for an empty row), so a rescan can
+    // repaint just the rows whose content changed
+    juce::uint64 getRowKey(int row) const;
     
     int getNumRows() override;
     void paintListBoxItem(int rowNumber, juce::Graphics& g, int width, int height,
@@ -25,7 +37,26 @@ public:
     std::function<void(int)> onSongDoubleClicked;
 
 private:
-    juce::Array<DetectedSong> detectedSongs;
+    // Pre-shaped text of one row; colours are applied when drawing
+    struct RowLayout
+    {
+        juce::GlyphArrangement name, duration, warning, stems;
+    };
+    
+    juce::uint64 getContentKey(int songIndex) const;
+    const RowLayout& getRowLayout(int songIndex, int width, int height);
+    
+    std::shared_ptr<const SongCatalog> catalog;
+    std::vector<int> visibleSongs;  // Catalog indices shown when filtered
+    bool filtered { false };
+    
+    // Keyed by row content and size, so filtering and rescans reuse shaped rows
+    std::unordered_map<juce::uint64, RowLayout> layoutCache;
+    static constexpr size_t maxCachedLayouts = 512;
+    
+    const juce::Font nameFont { 15.0f, juce::Font::bold };
+    const juce::Font durationFont { 13.0f };
+    const juce::Font detailFont { 12.0f };
     
     JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(SongListModel)
 };
@@ -45,7 +76,16 @@ public:
 private:
     void browseForFolder();
     void scanCurrentFolder();
+    void scanFinished(std::shared_ptr<const SongCatalog> newCatalog,
+                      std::shared_ptr<const SongSearchIndex> newSearchIndex);
     void loadSelectedSong();
+    void applySearch();
+    
+    // Content keys of the rows on screen, starting at firstRow; after a content change,
+    // only rows whose key differs from before are repainted
+    std::vector<juce::uint64> getVisibleRowKeys(int& firstRow) const;
+    void repaintChangedRows(int firstRow, const std::vector<juce::uint64>& previousKeys);
+    void updateStatus();
     
     StemPlayerAudioProcessor& audioProcessor;
     StemPlayerAudioProcessorEditor& editor;
@@ -57,14 +97,21 @@ private:
     IconButton settingsButton { IconType::Settings };
     IconButton loadButton { IconType::Load };
     
+    juce::TextEditor searchBox;
     juce::ListBox songListBox;
     SongListModel songListModel;
     
     juce::Label statusLabel;
     
     juce::File currentFolder;
-    juce::Array<DetectedSong> detectedSongs;
-    int selectedSongIndex { -1 };
+    std::shared_ptr<const SongCatalog> catalog;
+    std::shared_ptr<const SongSearchIndex> searchIndex;  // Built with the catalog, ids are catalog indices
+    int selectedSongIndex { -1 };  // Row in the (possibly filtered) list
+    
+    // Scans and probes run here so large libraries don't block the UI; only the
+    // newest scan's result is shown. Last member, so jobs finish before the rest goes
+    int scanGeneration { 0 };
+    juce::ThreadPool scanPool { juce::ThreadPoolOptions{}.withThreadName("Library scan").withNumberOfThreadsToUse(1) };
     
     JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(SelectionScreen)
 };
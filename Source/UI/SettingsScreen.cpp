@@ -2,11 +2,68 @@
 #include "../PluginProcessor.h"
 #include "../PluginEditor.h"
 #include "LookAndFeel.h"
+#include "../Core/StemPack.h"
 
 #if JucePlugin_Build_Standalone
 #include <juce_audio_plugin_client/Standalone/juce_StandaloneFilterWindow.h>
 #endif
 
+namespace
+{
+    // Packs every loose-stem song of a folder behind a progress window.
+    // Deletes itself when done.
+    class PackFolderThread : public juce::ThreadWithProgressWindow
+    {
+    public:
+        PackFolderThread(const juce::Array<DetectedSong>& s, StemPack::Codec c)
+            : juce::ThreadWithProgressWindow("Packing Stems", true, true),
+              songs(s), codec(c)
+        {
+        }
+        
+        void run() override
+        {
+            packed = StemPackConverter::convertSongs(songs, codec,
+                [this]() { return threadShouldExit(); },
+                [this](int done, int total) {
+                    setProgress(static_cast<double>(done) / juce::jmax(1, total));
+                    setStatusMessage(juce::String(done) + " of " + juce::String(total) + " songs");
+                },
+                failures);
+        }
+        
+        void threadComplete(bool userPressedCancel) override
+        {
+            auto message = juce::String(packed) + " songs packed"
+                               + (userPressedCancel ? " before cancelling." : ".");
+            
+            if (!failures.isEmpty())
+            {
+                // Keep the box a sensible size for big folders
+                constexpr int maxListed = 10;
+                failures.sort(true);
+                
+                message << "\n\n" << failures.size() << " couldn't be packed:\n"
+                        << failures.joinIntoString("\n", 0, maxListed);
+                
+                if (failures.size() > maxListed)
+                    message << "\n...and " << (failures.size() - maxListed) << " more";
+            }
+            
+            juce::AlertWindow::showMessageBoxAsync(failures.isEmpty() ? juce::MessageBoxIconType::InfoIcon
+                                                                      : juce::MessageBoxIconType::WarningIcon,
+                                                   "Stem Packs", message);
+            delete this;
+        }
+        
+    private:
+        juce::Array<DetectedSong> songs;
+        StemPack::Codec codec;
+        int packed { 0 };
+        juce::StringArray failures;
+    };
+}
+
 // AudioSettingsPanel implementation
 AudioSettingsPanel::AudioSettingsPanel(juce::AudioDeviceManager& deviceManager,
                                        std::function<void()> onClose)
@@ -33,7 +90,7 @@ AudioSettingsPanel::AudioSettingsPanel(juce::AudioDeviceManager& deviceManager,
         0, 2,    // min/max input channels
         0, 2,    // min/max output channels
         false,   // show MIDI input options
-        false,   // show MIDI output options
+        true,    // show MIDI output options, for controller feedback
         false,   // show channels as stereo pairs
         false    // hide advanced options
     );
@@ -76,13 +133,26 @@ MidiAssignmentRow::MidiAssignmentRow(MidiControlType type, MidiLearnManager& man
     
     ccEditor.setFont(juce::Font(13.0f));
     ccEditor.setJustification(juce::Justification::centred);
-    ccEditor.setInputRestrictions(3, "0123456789");
+    ccEditor.setInputRestrictions(6, "0123456789/NRnr#");
     ccEditor.setColour(juce::TextEditor::backgroundColourId, StemPlayerLookAndFeel::backgroundLight);
     ccEditor.setColour(juce::TextEditor::textColourId, StemPlayerLookAndFeel::textPrimary);
     ccEditor.setColour(juce::TextEditor::outlineColourId, StemPlayerLookAndFeel::backgroundLight);
     ccEditor.addListener(this);
     addAndMakeVisible(ccEditor);
     
+    // Item IDs are the enum values plus one
+    modeBox.addItemList({ "Absolute", "Relative (2's comp.)", "Relative (sign bit)", "Relative (offset)" }, 1);
+    modeBox.onChange = [this]() {
+        midiManager.setValueMode(controlType, static_cast<MidiValueMode>(modeBox.getSelectedId() - 1));
+    };
+    addAndMakeVisible(modeBox);
+    
+    curveBox.addItemList({ "Linear", "Decibel", "Squared" }, 1);
+    curveBox.onChange = [this]() {
+        midiManager.setCurve(controlType, static_cast<MidiCurve>(curveBox.getSelectedId() - 1));
+    };
+    addAndMakeVisible(curveBox);
+    
     learnButton.setButtonText("Learn");
     learnButton.onClick = [this]() {
         if (midiManager.isLearning() && midiManager.getLearningControlType() == controlType)
@@ -131,17 +201,20 @@ void MidiAssignmentRow::resized()
     learnButton.setBounds(bounds.removeFromRight(50));
     bounds.removeFromRight(8);
     
-    ccEditor.setBounds(bounds.removeFromRight(50));
+    curveBox.setBounds(bounds.removeFromRight(80));
+    bounds.removeFromRight(4);
+    modeBox.setBounds(bounds.removeFromRight(130));
+    bounds.removeFromRight(4);
+    ccEditor.setBounds(bounds.removeFromRight(60));
 }
 
 void MidiAssignmentRow::updateFromManager()
 {
-    int cc = midiManager.getMappedCC(controlType);
+    const auto mapping = midiManager.getMapping(controlType);
     
-    if (cc >= 0)
-        ccEditor.setText(juce::String(cc), juce::dontSendNotification);
-    else
-        ccEditor.setText("", juce::dontSendNotification);
+    ccEditor.setText(MidiLearnManager::describeSource(mapping), juce::dontSendNotification);
+    modeBox.setSelectedId(static_cast<int>(mapping.mode) + 1, juce::dontSendNotification);
+    curveBox.setSelectedId(static_cast<int>(mapping.curve) + 1, juce::dontSendNotification);
     
     if (midiManager.isLearning() && midiManager.getLearningControlType() == controlType)
         learnButton.setButtonText("...");
@@ -171,11 +244,12 @@ void MidiAssignmentRow::applyTextValue()
     }
     else
     {
-        int cc = text.getIntValue();
-        if (cc >= 0 && cc <= 127)
-            midiManager.setMapping(controlType, cc);
-        else
-            updateFromManager();
+        MidiSource source;
+        int number;
+        if (MidiLearnManager::parseSource(text, source, number))
+            midiManager.setMapping(controlType, number, midiManager.getMapping(controlType).channel, source);
+        
+        updateFromManager();
     }
 }
 
@@ -319,6 +393,40 @@ SettingsScreen::SettingsScreen(StemPlayerAudioProcessor& processor,
     };
     contentContainer.addAndMakeVisible(separateChannelsToggle);
     
+    frequencyColoursToggle.setButtonText("Colour waveforms by frequency (low/mid/high)");
+    frequencyColoursToggle.setColour(juce::ToggleButton::textColourId, StemPlayerLookAndFeel::textPrimary);
+    frequencyColoursToggle.setColour(juce::ToggleButton::tickColourId, StemPlayerLookAndFeel::accentPrimary);
+    frequencyColoursToggle.setToggleState(audioProcessor.getAppSettings().getFrequencyColours(), juce::dontSendNotification);
+    frequencyColoursToggle.onClick = [this]() {
+        audioProcessor.getAppSettings().setFrequencyColours(frequencyColoursToggle.getToggleState());
+    };
+    contentContainer.addAndMakeVisible(frequencyColoursToggle);
+    
+    peakSidecarsToggle.setButtonText("Save waveform data next to stems (.peaks)");
+    peakSidecarsToggle.setColour(juce::ToggleButton::textColourId, StemPlayerLookAndFeel::textPrimary);
+    peakSidecarsToggle.setColour(juce::ToggleButton::tickColourId, StemPlayerLookAndFeel::accentPrimary);
+    peakSidecarsToggle.setToggleState(audioProcessor.getAppSettings().getPeakSidecars(), juce::dontSendNotification);
+    peakSidecarsToggle.onClick = [this]() {
+        audioProcessor.getAppSettings().setPeakSidecars(peakSidecarsToggle.getToggleState());
+        audioProcessor.getStemEngine().setPeakSidecars(peakSidecarsToggle.getToggleState());
+    };
+    contentContainer.addAndMakeVisible(peakSidecarsToggle);
+    
+    // Stem packs section
+    packSectionLabel.setText("Stem Packs", juce::dontSendNotification);
+    packSectionLabel.setFont(juce::Font(14.0f, juce::Font::bold));
+    packSectionLabel.setColour(juce::Label::textColourId, StemPlayerLookAndFeel::textPrimary);
+    contentContainer.addAndMakeVisible(packSectionLabel);
+    
+    compressPacksToggle.setButtonText("Lossless compression (smaller, more CPU)");
+    compressPacksToggle.setColour(juce::ToggleButton::textColourId, StemPlayerLookAndFeel::textPrimary);
+    compressPacksToggle.setColour(juce::ToggleButton::tickColourId, StemPlayerLookAndFeel::accentPrimary);
+    contentContainer.addAndMakeVisible(compressPacksToggle);
+    
+    packFolderButton.setButtonText("Pack Folder...");
+    packFolderButton.onClick = [this]() { packFolder(); };
+    contentContainer.addAndMakeVisible(packFolderButton);
+    
     // Stem patterns section
     patternsSectionLabel.setText("Stem Detection (Regex)", juce::dontSendNotification);
     patternsSectionLabel.setFont(juce::Font(14.0f, juce::Font::bold));
@@ -336,12 +444,59 @@ SettingsScreen::SettingsScreen(StemPlayerAudioProcessor& processor,
     resetPatternsButton.onClick = [this]() { resetPatternsToDefault(); };
     contentContainer.addAndMakeVisible(resetPatternsButton);
     
+    // OSC section
+    oscSectionLabel.setText("OSC Control", juce::dontSendNotification);
+    oscSectionLabel.setFont(juce::Font(14.0f, juce::Font::bold));
+    oscSectionLabel.setColour(juce::Label::textColourId, StemPlayerLookAndFeel::textPrimary);
+    contentContainer.addAndMakeVisible(oscSectionLabel);
+    
+    oscToggle.setButtonText("Receive OSC on local UDP port");
+    oscToggle.setColour(juce::ToggleButton::textColourId, StemPlayerLookAndFeel::textPrimary);
+    oscToggle.setColour(juce::ToggleButton::tickColourId, StemPlayerLookAndFeel::accentPrimary);
+    oscToggle.setToggleState(audioProcessor.getAppSettings().getOscEnabled(), juce::dontSendNotification);
+    oscToggle.onClick = [this]() {
+        audioProcessor.getAppSettings().setOscEnabled(oscToggle.getToggleState());
+        updateOscReceiver();
+    };
+    contentContainer.addAndMakeVisible(oscToggle);
+    
+    oscPortEditor.setColour(juce::TextEditor::backgroundColourId, StemPlayerLookAndFeel::backgroundLight);
+    oscPortEditor.setColour(juce::TextEditor::textColourId, StemPlayerLookAndFeel::textPrimary);
+    oscPortEditor.setColour(juce::TextEditor::outlineColourId, StemPlayerLookAndFeel::backgroundLight);
+    oscPortEditor.setInputRestrictions(5, "0123456789");
+    oscPortEditor.setJustification(juce::Justification::centred);
+    oscPortEditor.setText(juce::String(audioProcessor.getAppSettings().getOscPort()), false);
+    oscPortEditor.onReturnKey = [this]() { oscPortEditor.unfocusAllComponents(); };
+    oscPortEditor.onFocusLost = [this]() {
+        const int port = oscPortEditor.getText().getIntValue();
+        if (port != audioProcessor.getAppSettings().getOscPort())
+        {
+            audioProcessor.getAppSettings().setOscPort(port);
+            updateOscReceiver();
+        }
+        
+        oscPortEditor.setText(juce::String(audioProcessor.getAppSettings().getOscPort()), false);
+    };
+    contentContainer.addAndMakeVisible(oscPortEditor);
+    
+    oscStatusLabel.setColour(juce::Label::textColourId, StemPlayerLookAndFeel::textSecondary);
+    contentContainer.addAndMakeVisible(oscStatusLabel);
+    updateOscStatus(audioProcessor.getOscReceiver().isListening());
+    
     // MIDI assignment section
     midiSectionLabel.setText("MIDI Control", juce::dontSendNotification);
     midiSectionLabel.setFont(juce::Font(14.0f, juce::Font::bold));
     midiSectionLabel.setColour(juce::Label::textColourId, StemPlayerLookAndFeel::textPrimary);
     contentContainer.addAndMakeVisible(midiSectionLabel);
     
+    programChangeToggle.setButtonText("Program change selects song (0 = first in list)");
+    programChangeToggle.setColour(juce::ToggleButton::textColourId, StemPlayerLookAndFeel::textPrimary);
+    programChangeToggle.setColour(juce::ToggleButton::tickColourId, StemPlayerLookAndFeel::accentPrimary);
+    programChangeToggle.onClick = [this]() {
+        audioProcessor.getMidiLearnManager().setProgramChangeSelectsSong(programChangeToggle.getToggleState());
+    };
+    contentContainer.addAndMakeVisible(programChangeToggle);
+    
     // Create MIDI assignment rows
     for (int i = 0; i < MidiLearnManager::getNumControls(); ++i)
     {
@@ -414,8 +569,19 @@ void SettingsScreen::layoutContent()
     displaySectionLabel.setBounds(0, y, contentWidth, 20);
     y += 24;
     separateChannelsToggle.setBounds(0, y, contentWidth, 24);
+    y += 26;
+    frequencyColoursToggle.setBounds(0, y, contentWidth, 24);
+    y += 26;
+    peakSidecarsToggle.setBounds(0, y, contentWidth, 24);
     y += 24 + 16;
     
+    // Stem packs section
+    packSectionLabel.setBounds(0, y, contentWidth, 20);
+    y += 24;
+    packFolderButton.setBounds(contentWidth - 110, y, 110, 28);
+    compressPacksToggle.setBounds(0, y + 2, contentWidth - 110 - 8, 24);
+    y += 28 + 16;
+    
     // Stem patterns section
     patternsSectionLabel.setBounds(0, y, contentWidth, 20);
     y += 24;
@@ -429,10 +595,21 @@ void SettingsScreen::layoutContent()
     resetPatternsButton.setBounds(0, y, 120, 28);
     y += 28 + 16;
     
+    // OSC section
+    oscSectionLabel.setBounds(0, y, contentWidth, 20);
+    y += 24;
+    oscPortEditor.setBounds(260, y, 70, 24);
+    oscToggle.setBounds(0, y, 252, 24);
+    oscStatusLabel.setBounds(340, y, contentWidth - 340, 24);
+    y += 24 + 16;
+    
     // MIDI section
     midiSectionLabel.setBounds(0, y, contentWidth, 20);
     y += 24;
     
+    programChangeToggle.setBounds(0, y, contentWidth, 24);
+    y += 28;
+    
     int midiRowHeight = 30;
     for (auto& row : midiRows)
     {
@@ -470,10 +647,28 @@ void SettingsScreen::visibilityChanged()
 
 void SettingsScreen::updateMidiRows()
 {
+    programChangeToggle.setToggleState(audioProcessor.getMidiLearnManager().getProgramChangeSelectsSong(),
+                                       juce::dontSendNotification);
+    
     for (auto& row : midiRows)
         row->updateFromManager();
 }
 
+void SettingsScreen::updateOscReceiver()
+{
+    updateOscStatus(audioProcessor.updateOscReceiver());
+}
+
+void SettingsScreen::updateOscStatus(bool portAvailable)
+{
+    if (!audioProcessor.getAppSettings().getOscEnabled())
+        oscStatusLabel.setText({}, juce::dontSendNotification);
+    else if (portAvailable)
+        oscStatusLabel.setText("Listening on 127.0.0.1", juce::dontSendNotification);
+    else
+        oscStatusLabel.setText("Port unavailable", juce::dontSendNotification);
+}
+
 void SettingsScreen::updatePatternRows()
 {
     for (int i = 0; i < NUM_STEM_TYPES; ++i)
@@ -497,6 +692,26 @@ void SettingsScreen::browseForDefaultFolder()
     });
 }
 
+void SettingsScreen::packFolder()
+{
+    auto chooser = std::make_shared<juce::FileChooser>(
+        "Select Folder to Pack", juce::File(audioProcessor.getAppSettings().getDefaultFolder()), "", true);
+    
+    chooser->launchAsync(juce::FileBrowserComponent::openMode | 
+                         juce::FileBrowserComponent::canSelectDirectories,
+                         [this, chooser](const juce::FileChooser& fc) {
+        auto result = fc.getResult();
+        if (!result.isDirectory())
+            return;
+        
+        StemDetector detector;
+        detector.setPatterns(audioProcessor.getAppSettings().getStemRegexPatterns());
+        
+        auto codec = compressPacksToggle.getToggleState() ? StemPack::Codec::Deflate : StemPack::Codec::PCM;
+        (new PackFolderThread(detector.scanDirectory(result), codec))->launchThread();
+    });
+}
+
 void SettingsScreen::resetPatternsToDefault()
 {
     editingPatterns = StemDetector::getDefaultPatterns();
@@ -52,6 +52,8 @@ private:
     
     juce::Label nameLabel;
     juce::TextEditor ccEditor;
+    juce::ComboBox modeBox;
+    juce::ComboBox curveBox;
     juce::TextButton learnButton;
     juce::TextButton clearButton;
     
@@ -102,10 +104,13 @@ public:
 private:
     void showAudioSettings();
     void browseForDefaultFolder();
+    void packFolder();
     void resetPatternsToDefault();
     void savePatterns();
     void updateMidiRows();
     void updatePatternRows();
+    void updateOscReceiver();
+    void updateOscStatus(bool portAvailable);
     void layoutContent();
     
     StemPlayerAudioProcessor& audioProcessor;
@@ -128,6 +133,13 @@ private:
     // Display section
     juce::Label displaySectionLabel;
     juce::ToggleButton separateChannelsToggle;
+    juce::ToggleButton frequencyColoursToggle;
+    juce::ToggleButton peakSidecarsToggle;
+    
+    // Stem packs section
+    juce::Label packSectionLabel;
+    juce::ToggleButton compressPacksToggle;
+    juce::TextButton packFolderButton;
     
     // Stem patterns section
     juce::Label patternsSectionLabel;
@@ -135,8 +147,15 @@ private:
     juce::TextButton resetPatternsButton;
     std::array<juce::String, NUM_STEM_TYPES> editingPatterns;
     
+    // OSC section
+    juce::Label oscSectionLabel;
+    juce::ToggleButton oscToggle;
+    juce::TextEditor oscPortEditor;
+    juce::Label oscStatusLabel;
+    
     // MIDI assignment section
     juce::Label midiSectionLabel;
+    juce::ToggleButton programChangeToggle;
     std::vector<std::unique_ptr<MidiAssignmentRow>> midiRows;
     
     // Audio settings overlay
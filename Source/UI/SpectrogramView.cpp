@@ -0,0 +1,101 @@
+#include "SpectrogramView.h"
+#include "LookAndFeel.h"
+
+SpectrogramView::SpectrogramView()
+{
+    // Seeking and zooming are handled by the playhead overlay above
+    setInterceptsMouseClicks(false, false);
+    setOpaque(true);
+}
+
+void SpectrogramView::setTiles(SpectrogramTiles* newTiles)
+{
+    tiles = newTiles;
+    repaint();
+}
+
+void SpectrogramView::setTrack(StemTrack* track)
+{
+    currentTrack = track;
+    repaint();
+}
+
+void SpectrogramView::setVisibleRange(juce::Range<double> normalizedRange)
+{
+    if (visibleRange != normalizedRange)
+    {
+        visibleRange = normalizedRange;
+        repaint();
+    }
+}
+
+void SpectrogramView::setBackgroundColour(juce::Colour colour)
+{
+    if (backgroundColour != colour)
+    {
+        backgroundColour = colour;
+        repaint();
+    }
+}
+
+void SpectrogramView::paint(juce::Graphics& g)
+{
+    g.fillAll(backgroundColour);
+    
+    if (tiles == nullptr || currentTrack == nullptr)
+    {
+        g.setColour(StemPlayerLookAndFeel::textSecondary);
+        g.drawText("No spectrogram", getLocalBounds(), juce::Justification::centred);
+        return;
+    }
+    
+    paintedVersion = tiles->getVersion();
+    missingTiles = forEachVisibleTile([&g](const juce::Image& image, juce::Rectangle<float> area)
+    {
+        if (image.isValid())
+            g.drawImage(image, area);
+    });
+}
+
+void SpectrogramView::updateTiles()
+{
+    if (missingTiles == 0 || tiles == nullptr || currentTrack == nullptr || !isShowing())
+        return;
+    
+    // Asking again keeps the tiles from being dropped as out of view
+    forEachVisibleTile([](const juce::Image&, juce::Rectangle<float>) {});
+    
+    if (tiles->getVersion() != paintedVersion)
+        repaint();
+}
+
+int SpectrogramView::forEachVisibleTile(const std::function<void(const juce::Image&, juce::Rectangle<float>)>& function) const
+{
+    const auto bounds = getLocalBounds().toFloat();
+    const double totalSamples = static_cast<double>(currentTrack->getPeaks()->getLengthInSamples());
+    if (bounds.isEmpty() || totalSamples <= 0.0)
+        return 0;
+    
+    // Tiles come from the level closest to one frame per pixel and are stretched to fit
+    const double firstSample = visibleRange.getStart() * totalSamples;
+    const double lastSample = visibleRange.getEnd() * totalSamples;
+    const double samplesPerPixel = (lastSample - firstSample) / bounds.getWidth();
+    const int level = SpectrogramTiles::chooseLevel(samplesPerPixel);
+    const auto samplesPerTile = static_cast<double>(SpectrogramTiles::getSamplesPerTile(level));
+    
+    const int firstTile = static_cast<int>(firstSample / samplesPerTile);
+    const int lastTile = static_cast<int>(std::ceil(juce::jmin(lastSample, totalSamples) / samplesPerTile));
+    int missing = 0;
+    
+    for (int index = firstTile; index < lastTile; ++index)
+    {
+        const auto image = tiles->getTile(*currentTrack, level, index);
+        if (!image.isValid())
+            ++missing;
+        
+        const auto x = bounds.getX() + static_cast<float>((index * samplesPerTile - firstSample) / samplesPerPixel);
+        function(image, { x, bounds.getY(), static_cast<float>(samplesPerTile / samplesPerPixel), bounds.getHeight() });
+    }
+    
+    return missing;
+}
@@ -0,0 +1,40 @@
+#pragma once
+
+#include <JuceHeader.h>
+#include "../Core/StemTrack.h"
+#include "../Core/SpectrogramTiles.h"
+
+// Spectrogram of one stem over the visible range, drawn from cached tiles.
+// Only tiles that intersect the view are requested; missing ones stay blank
+// until the background pool delivers them.
+class SpectrogramView : public juce::Component
+{
+public:
+    SpectrogramView();
+    ~SpectrogramView() override = default;
+    
+    void setTiles(SpectrogramTiles* tiles);
+    void setTrack(StemTrack* track);
+    void setVisibleRange(juce::Range<double> normalizedRange);
+    void setBackgroundColour(juce::Colour colour);
+    
+    void paint(juce::Graphics& g) override;
+    
+    // Keeps missing visible tiles queued and repaints once some of them have arrived
+    void updateTiles();
+
+private:
+    // Calls the function with each visible tile's image (possibly null) and target area;
+    // returns the number of tiles not computed yet
+    int forEachVisibleTile(const std::function<void(const juce::Image&, juce::Rectangle<float>)>& function) const;
+    
+    SpectrogramTiles* tiles { nullptr };
+    StemTrack* currentTrack { nullptr };
+    juce::Range<double> visibleRange { 0.0, 1.0 };
+    juce::Colour backgroundColour { 0xff1a1a2e };
+    
+    int paintedVersion { -1 };
+    int missingTiles { 0 };
+    
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(SpectrogramView)
+};
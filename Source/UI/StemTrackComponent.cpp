@@ -65,6 +65,7 @@ StemTrackComponent::StemTrackComponent(int index)
     stemNameLabel.setFont(juce::Font(11.0f, juce::Font::bold));
     stemNameLabel.setColour(juce::Label::textColourId, StemPlayerLookAndFeel::textSecondary);
     stemNameLabel.setJustificationType(juce::Justification::centred);
+    stemNameLabel.setInterceptsMouseClicks(false, false);  // Right-clicks reach the view menu
     addAndMakeVisible(stemNameLabel);
     
     // Volume slider (rotary knob with value displayed inside)
@@ -75,13 +76,9 @@ StemTrackComponent::StemTrackComponent(int index)
     volumeSlider.setRange(0.0, 1.0, 0.01);
     volumeSlider.setValue(1.0);
     volumeSlider.onValueChange = [this]() {
-        if (currentTrack != nullptr && trackLoaded)
-        {
-            currentTrack->setVolume(static_cast<float>(volumeSlider.getValue()));
-            
-            if (onVolumeChanged)
-                onVolumeChanged(trackIndex, static_cast<float>(volumeSlider.getValue()));
-        }
+        // The engine applies the change on its next block
+        if (currentTrack != nullptr && trackLoaded && onVolumeChanged)
+            onVolumeChanged(trackIndex, static_cast<float>(volumeSlider.getValue()));
     };
     
     volumeSlider.onMuteChanged = [this](bool muted) {
@@ -97,6 +94,9 @@ StemTrackComponent::StemTrackComponent(int index)
             onPositionChanged(pos);
     };
     addAndMakeVisible(waveformDisplay);
+    
+    // Spectrogram takes the waveform's place when switched on from the menu
+    addChildComponent(spectrogramView);
 }
 
 StemTrackComponent::~StemTrackComponent()
@@ -120,8 +120,11 @@ void StemTrackComponent::setTrack(StemTrack* track)
         waveformDisplay.setTrack(nullptr);
     }
     
+    spectrogramView.setTrack(track);
+    
     // Set colors - dark background, light waveform
     waveformDisplay.setBackgroundColour(getStemBackgroundColor(trackIndex));
+    spectrogramView.setBackgroundColour(getStemBackgroundColor(trackIndex));
     waveformDisplay.setWaveformColour(getStemColor(trackIndex));
     
     repaint();
@@ -155,14 +158,48 @@ void StemTrackComponent::setTrackLoaded(bool loaded)
     repaint();
 }
 
-void StemTrackComponent::updatePlaybackPosition(double normalizedPosition)
+void StemTrackComponent::frameUpdate(double normalizedPosition, float level)
 {
     waveformDisplay.setPlaybackPosition(normalizedPosition);
+    
+    if (spectrogramView.isVisible())
+        spectrogramView.updateTiles();
+    else
+        waveformDisplay.updatePeaks();
+    
+    // Peak meter with a short fall-off; only the meter strip is repainted
+    const float newLevel = juce::jmax(juce::jlimit(0.0f, 1.0f, level), meterLevel * 0.85f);
+    if (std::abs(newLevel - meterLevel) > 0.005f)
+    {
+        meterLevel = newLevel < 0.005f ? 0.0f : newLevel;
+        repaint(getMeterBounds());
+    }
+}
+
+juce::Rectangle<int> StemTrackComponent::getMeterBounds() const
+{
+    // Thin strip along the right edge of the controls area
+    return { 70 - 5, 4, 3, juce::jmax(0, getHeight() - 8) };
 }
 
 void StemTrackComponent::setVolume(float volume)
 {
-    volumeSlider.setValue(volume, juce::sendNotificationSync);
+    // Mirrors the engine, so nothing is sent back; a knob being dragged is ahead of it anyway
+    if (!volumeSlider.isMouseButtonDown())
+        volumeSlider.setValue(volume, juce::dontSendNotification);
+}
+
+void StemTrackComponent::setMixState(bool muted, bool soloed, bool audible)
+{
+    const auto name = StemDetector::getStemTypeName(trackIndex) + (soloed ? " S" : muted ? " M" : "");
+    if (stemNameLabel.getText() != name)
+        stemNameLabel.setText(name, juce::dontSendNotification);
+    
+    if (silenced == audible)
+    {
+        silenced = !audible;
+        repaint(waveformDisplay.getBounds());
+    }
 }
 
 void StemTrackComponent::setShowSeparateChannels(bool separate)
@@ -170,11 +207,33 @@ void StemTrackComponent::setShowSeparateChannels(bool separate)
     waveformDisplay.setShowSeparateChannels(separate);
 }
 
+void StemTrackComponent::setFrequencyColours(bool useFrequencyColours)
+{
+    waveformDisplay.setFrequencyColours(useFrequencyColours);
+}
+
+void StemTrackComponent::setVisibleRange(juce::Range<double> normalizedRange)
+{
+    waveformDisplay.setVisibleRange(normalizedRange);
+    spectrogramView.setVisibleRange(normalizedRange);
+}
+
 void StemTrackComponent::setDrawPlayhead(bool shouldDraw)
 {
     waveformDisplay.setDrawPlayhead(shouldDraw);
 }
 
+void StemTrackComponent::setSpectrogramTiles(SpectrogramTiles* tiles)
+{
+    spectrogramView.setTiles(tiles);
+}
+
+void StemTrackComponent::setSpectrogramMode(bool shouldShowSpectrogram)
+{
+    spectrogramView.setVisible(shouldShowSpectrogram);
+    waveformDisplay.setVisible(!shouldShowSpectrogram);
+}
+
 juce::Rectangle<int> StemTrackComponent::getWaveformBounds() const
 {
     return waveformDisplay.getBounds().translated(getX(), getY());
@@ -188,6 +247,13 @@ void StemTrackComponent::paint(juce::Graphics& g)
     g.setColour(StemPlayerLookAndFeel::backgroundMedium);
     g.fillRect(bounds.removeFromLeft(70.0f));
     
+    // Output level meter
+    auto meterBounds = getMeterBounds().toFloat();
+    g.setColour(StemPlayerLookAndFeel::backgroundDark);
+    g.fillRect(meterBounds);
+    g.setColour(getStemColor(trackIndex));
+    g.fillRect(meterBounds.removeFromBottom(meterBounds.getHeight() * meterLevel));
+    
     // Thin bottom border for separation
     g.setColour(StemPlayerLookAndFeel::backgroundDark);
     g.fillRect(getLocalBounds().toFloat().removeFromBottom(1.0f));
@@ -202,6 +268,16 @@ void StemTrackComponent::paint(juce::Graphics& g)
     }
 }
 
+void StemTrackComponent::paintOverChildren(juce::Graphics& g)
+{
+    // Covers the waveform or spectrogram, whichever is showing
+    if (silenced)
+    {
+        g.setColour(StemPlayerLookAndFeel::backgroundDark.withAlpha(0.6f));
+        g.fillRect(waveformDisplay.getBounds());
+    }
+}
+
 void StemTrackComponent::resized()
 {
     auto bounds = getLocalBounds();
@@ -222,6 +298,27 @@ void StemTrackComponent::resized()
     
     // Waveform takes full remaining height
     waveformDisplay.setBounds(bounds);
+    spectrogramView.setBounds(bounds);
+}
+
+void StemTrackComponent::mouseDown(const juce::MouseEvent& event)
+{
+    if (!event.mods.isPopupMenu() || !trackLoaded)
+        return;
+    
+    auto choose = [this](bool spectrogram)
+    {
+        setSpectrogramMode(spectrogram);
+        
+        if (onSpectrogramModeChanged)
+            onSpectrogramModeChanged(trackIndex, spectrogram);
+    };
+    
+    juce::PopupMenu menu;
+    menu.addItem("Waveform", true, !isSpectrogramMode(), [choose]() { choose(false); });
+    menu.addItem("Spectrogram", true, isSpectrogramMode(), [choose]() { choose(true); });
+    
+    menu.showMenuAsync(juce::PopupMenu::Options().withTargetComponent(this).withMousePosition());
 }
 
 juce::Colour StemTrackComponent::getStemColor(int stemIndex)
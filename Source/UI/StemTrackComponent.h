@@ -4,6 +4,7 @@
 #include "../Core/StemTrack.h"
 #include "../Core/StemDetector.h"
 #include "WaveformDisplay.h"
+#include "SpectrogramView.h"
 
 // Custom slider that supports click-to-mute
 class MuteableSlider : public juce::Slider
@@ -37,11 +38,21 @@ public:
 
     void setTrack(StemTrack* track);
     void setTrackLoaded(bool loaded);
-    void updatePlaybackPosition(double normalizedPosition);
+    // Called once per display frame by MainScreen with the stem's latest output level
+    void frameUpdate(double normalizedPosition, float level);
     void setVolume(float volume);
+    // Engine mute and solo (set from MIDI); a silenced stem is drawn faded
+    void setMixState(bool muted, bool soloed, bool audible);
     void setShowSeparateChannels(bool separate);
+    void setFrequencyColours(bool useFrequencyColours);
+    void setVisibleRange(juce::Range<double> normalizedRange);
     void setDrawPlayhead(bool shouldDraw);
     
+    // Shows a spectrogram instead of the waveform, e.g. to check for bleed between stems
+    void setSpectrogramTiles(SpectrogramTiles* tiles);
+    void setSpectrogramMode(bool shouldShowSpectrogram);
+    bool isSpectrogramMode() const { return spectrogramView.isVisible(); }
+    
     // Get the waveform bounds relative to parent for overlay positioning
     juce::Rectangle<int> getWaveformBounds() const;
     
@@ -49,19 +60,27 @@ public:
     int getTrackIndex() const { return trackIndex; }
     
     void paint(juce::Graphics& g) override;
+    void paintOverChildren(juce::Graphics& g) override;
     void resized() override;
+    void mouseDown(const juce::MouseEvent& event) override;
     
     std::function<void(int, float)> onVolumeChanged;
+    std::function<void(int, bool)> onSpectrogramModeChanged;
     std::function<void(double)> onPositionChanged;
 
 private:
     int trackIndex;
     StemTrack* currentTrack { nullptr };
     bool trackLoaded { false };
+    bool silenced { false };
     
     juce::Label stemNameLabel;
     MuteableSlider volumeSlider;
     WaveformDisplay waveformDisplay;
+    SpectrogramView spectrogramView;
+    
+    juce::Rectangle<int> getMeterBounds() const;
+    float meterLevel { 0.0f };
     
     // Colors for different stem types
     juce::Colour getStemColor(int stemIndex);
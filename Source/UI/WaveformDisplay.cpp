@@ -7,27 +7,32 @@ WaveformDisplay::WaveformDisplay()
     waveformColourRight = juce::Colour(0xff60a5fa);  // Blue for right channel
     backgroundColour = StemPlayerLookAndFeel::backgroundLight;
     playheadColour = StemPlayerLookAndFeel::playheadColor;
-    
-    startTimerHz(30);
 }
 
 WaveformDisplay::~WaveformDisplay()
 {
-    stopTimer();
 }
 
 void WaveformDisplay::setTrack(StemTrack* track)
 {
     currentTrack = track;
-    repaint();
+    peaks = track != nullptr ? track->getPeaks() : nullptr;
+    paintedVersion = -1;
+    invalidateImage();
 }
 
 void WaveformDisplay::setPlaybackPosition(double normalizedPosition)
 {
-    if (std::abs(playbackPosition - normalizedPosition) > 0.001)
+    const auto oldArea = getPlayheadArea(playbackPosition);
+    const auto newArea = getPlayheadArea(normalizedPosition);
+    playbackPosition = normalizedPosition;
+    
+    // Only the strips under the old and new playhead need redrawing, and only
+    // once it reaches another pixel of the visible range
+    if (drawPlayhead && newArea != oldArea)
     {
-        playbackPosition = normalizedPosition;
-        repaint();
+        repaint(oldArea);
+        repaint(newArea);
     }
 }
 
@@ -36,27 +41,121 @@ void WaveformDisplay::setShowSeparateChannels(bool separate)
     if (showSeparateChannels != separate)
     {
         showSeparateChannels = separate;
-        repaint();
+        invalidateImage();
+    }
+}
+
+void WaveformDisplay::setVisibleRange(juce::Range<double> normalizedRange)
+{
+    if (visibleRange != normalizedRange)
+    {
+        visibleRange = normalizedRange;
+        invalidateImage();
+    }
+}
+
+void WaveformDisplay::setBackgroundColour(juce::Colour colour)
+{
+    if (backgroundColour != colour)
+    {
+        backgroundColour = colour;
+        invalidateImage();
+    }
+}
+
+void WaveformDisplay::setWaveformColour(juce::Colour colour)
+{
+    if (waveformColour != colour)
+    {
+        waveformColour = colour;
+        invalidateImage();
+    }
+}
+
+void WaveformDisplay::setFrequencyColours(bool shouldUseFrequencyColours)
+{
+    if (frequencyColours != shouldUseFrequencyColours)
+    {
+        frequencyColours = shouldUseFrequencyColours;
+        invalidateImage();
+    }
+}
+
+void WaveformDisplay::invalidateImage()
+{
+    imageValid = false;
+    repaint();
+}
+
+juce::Rectangle<int> WaveformDisplay::getPlayheadArea(double position) const
+{
+    const double relative = (position - visibleRange.getStart()) / visibleRange.getLength();
+    const int x = 2 + juce::roundToInt(relative * (getWidth() - 4));
+    return { x - 2, 0, 4, getHeight() };
+}
+
+void WaveformDisplay::renderWaveformImage(float scale)
+{
+    const int width = juce::roundToInt(getWidth() * scale);
+    const int height = juce::roundToInt(getHeight() * scale);
+    
+    if (width <= 0 || height <= 0)
+    {
+        waveformImage = {};
+        return;
     }
+    
+    if (waveformImage.getWidth() != width || waveformImage.getHeight() != height)
+        waveformImage = juce::Image(juce::Image::ARGB, width, height, false);
+    
+    // Drawn at the display's pixel density so the cached copy stays sharp
+    juce::Graphics g(waveformImage);
+    g.addTransform(juce::AffineTransform::scale(scale));
+    drawWaveform(g, getLocalBounds().toFloat());
+    
+    imageScale = scale;
+    imageValid = true;
 }
 
 void WaveformDisplay::paint(juce::Graphics& g)
 {
     auto bounds = getLocalBounds().toFloat();
+    const float scale = g.getInternalContext().getPhysicalPixelScaleFactor();
     
+    if (!imageValid || scale != imageScale || (peaks != nullptr && peaks->getVersion() != paintedVersion))
+        renderWaveformImage(scale);
+    
+    if (waveformImage.isValid())
+        g.drawImage(waveformImage, bounds);
+    
+    // Draw playhead (only if enabled) - minimal style
+    if (drawPlayhead && playbackPosition > 0.0 && visibleRange.contains(playbackPosition))
+    {
+        const double relative = (playbackPosition - visibleRange.getStart()) / visibleRange.getLength();
+        float playheadX = bounds.getX() + 2.0f + 
+                          (float)relative * (bounds.getWidth() - 4.0f);
+        
+        // Simple vertical line
+        g.setColour(playheadColour);
+        g.fillRect(playheadX - 1.0f, bounds.getY(), 2.0f, bounds.getHeight());
+    }
+}
+
+void WaveformDisplay::drawWaveform(juce::Graphics& g, juce::Rectangle<float> bounds)
+{
     // Flat background
     g.setColour(backgroundColour);
     g.fillRect(bounds);
     
     // Draw waveform - full height
-    if (currentTrack != nullptr && currentTrack->getThumbnail() != nullptr)
+    if (peaks != nullptr)
     {
-        auto* thumbnail = currentTrack->getThumbnail();
+        paintedVersion = peaks->getVersion();
         
-        if (thumbnail->getTotalLength() > 0)
+        if (peaks->getLengthInSamples() > 0)
         {
             auto waveformBounds = bounds.reduced(2.0f, 2.0f);
-            int numChannels = thumbnail->getNumChannels();
+            int numChannels = peaks->getNumChannels();
             
             if (showSeparateChannels && numChannels > 1)
             {
@@ -80,9 +179,7 @@ void WaveformDisplay::paint(juce::Graphics& g)
                                juce::Justification::centred);
                     
                     // Draw channel waveform
-                    g.setColour(waveformColour.withAlpha(alpha));
-                    thumbnail->drawChannel(g, channelBounds.toNearestInt(), 
-                                           0.0, thumbnail->getTotalLength(), ch, 1.0f);
+                    drawChannel(g, channelBounds, ch, alpha);
                     
                     // Subtle separator line between channels
                     if (ch < numChannels - 1)
@@ -96,16 +193,11 @@ void WaveformDisplay::paint(juce::Graphics& g)
             else
             {
                 // Mixed mode - overlay all channels with the stem color
-                int numChannelsToDraw = thumbnail->getNumChannels();
-                
-                for (int ch = 0; ch < numChannelsToDraw; ++ch)
+                for (int ch = 0; ch < numChannels; ++ch)
                 {
                     // Use slightly different alpha for each channel to create depth
                     float alpha = (ch == 0) ? 1.0f : 0.7f;
-                    
-                    g.setColour(waveformColour.withAlpha(alpha));
-                    thumbnail->drawChannel(g, waveformBounds.toNearestInt(), 
-                                           0.0, thumbnail->getTotalLength(), ch, 1.0f);
+                    drawChannel(g, waveformBounds, ch, alpha);
                 }
             }
         }
@@ -116,22 +208,111 @@ void WaveformDisplay::paint(juce::Graphics& g)
         g.setColour(StemPlayerLookAndFeel::textSecondary);
         g.drawText("No waveform", bounds, juce::Justification::centred);
     }
+}
+
+void WaveformDisplay::drawChannel(juce::Graphics& g, juce::Rectangle<float> area, int channel, float alpha) const
+{
+    const int width = static_cast<int>(area.getWidth());
+    if (width <= 0)
+        return;
     
-    // Draw playhead (only if enabled) - minimal style
-    if (drawPlayhead && playbackPosition > 0.0 && playbackPosition <= 1.0)
+    // One merged peak per pixel column of the visible range, from the level closest to the
+    // pixel width; only peaks inside the visible range are read
+    const double totalSamples = static_cast<double>(peaks->getLengthInSamples());
+    const double firstSample = visibleRange.getStart() * totalSamples;
+    const double samplesPerPixel = visibleRange.getLength() * totalSamples / width;
+    const int level = WaveformPeaks::chooseLevel(samplesPerPixel);
+    const float centreY = area.getCentreY();
+    const float scale = area.getHeight() * 0.5f / 32767.0f;
+    const float rmsScale = area.getHeight() * 0.5f / 65535.0f;
+    
+    // A single bucket holds everything when drawing in the stem colour
+    const int numColours = frequencyColours ? numFrequencyColours : 1;
+    std::array<juce::RectangleList<float>, numFrequencyColours> peakColumns, rmsColumns;
+    peakColumns[0].ensureStorageAllocated(width);
+    rmsColumns[0].ensureStorageAllocated(width);
+    
+    for (int x = 0; x < width; ++x)
     {
-        float playheadX = bounds.getX() + 2.0f + 
-                          (float)playbackPosition * (bounds.getWidth() - 4.0f);
+        const auto start = static_cast<int64_t>(firstSample + x * samplesPerPixel);
+        const auto end = juce::jmax(start + 1, static_cast<int64_t>(firstSample + (x + 1) * samplesPerPixel));
         
-        // Simple vertical line
-        g.setColour(playheadColour);
-        g.fillRect(playheadX - 1.0f, bounds.getY(), 2.0f, bounds.getHeight());
+        // Parts of the file not summarised yet are left empty
+        WaveformPeaks::Peak peak;
+        if (!peaks->getRange(level, channel, start, end, peak))
+            continue;
+        
+        const float top = centreY - peak.max * scale;
+        const float bottom = centreY - peak.min * scale;
+        const float columnX = area.getX() + static_cast<float>(x);
+        const int colour = frequencyColours ? getFrequencyColourIndex(peak) : 0;
+        peakColumns[(size_t) colour].addWithoutMerging({ columnX, top, 1.0f, juce::jmax(1.0f, bottom - top) });
+        
+        const float rmsHeight = peak.rms * rmsScale;
+        rmsColumns[(size_t) colour].addWithoutMerging({ columnX, centreY - rmsHeight, 1.0f, rmsHeight * 2.0f });
+    }
+    
+    for (int i = 0; i < numColours; ++i)
+    {
+        const auto colour = frequencyColours ? getFrequencyPalette()[(size_t) i] : waveformColour;
+        
+        if (!peakColumns[(size_t) i].isEmpty())
+        {
+            g.setColour(colour.withAlpha(alpha * 0.7f));
+            g.fillRectList(peakColumns[(size_t) i]);
+        }
+    }
+    
+    // RMS body on top shows loudness within the peak envelope
+    for (int i = 0; i < numColours; ++i)
+    {
+        const auto colour = frequencyColours ? getFrequencyPalette()[(size_t) i] : waveformColour;
+        
+        if (!rmsColumns[(size_t) i].isEmpty())
+        {
+            g.setColour(colour.withAlpha(alpha));
+            g.fillRectList(rmsColumns[(size_t) i]);
+        }
     }
 }
 
+int WaveformDisplay::getFrequencyColourIndex(const WaveformPeaks::Peak& peak)
+{
+    // Spectral balance from 0 (all low) to 1 (all high), weighted by band level
+    const float low = static_cast<float>(peak.low) * peak.low;
+    const float mid = static_cast<float>(peak.mid) * peak.mid;
+    const float high = static_cast<float>(peak.high) * peak.high;
+    const float total = low + mid + high;
+    
+    if (total <= 0.0f)
+        return 0;
+    
+    const float balance = (mid * 0.5f + high) / total;
+    return juce::jlimit(0, numFrequencyColours - 1, static_cast<int>(balance * numFrequencyColours));
+}
+
+const std::array<juce::Colour, WaveformDisplay::numFrequencyColours>& WaveformDisplay::getFrequencyPalette()
+{
+    // Bass red through mids green to highs blue, as on DJ decks
+    static const auto palette = []
+    {
+        std::array<juce::Colour, numFrequencyColours> colours;
+        
+        for (int i = 0; i < numFrequencyColours; ++i)
+        {
+            const float balance = (static_cast<float>(i) + 0.5f) / numFrequencyColours;
+            colours[(size_t) i] = juce::Colour::fromHSV(balance * 0.66f, 0.75f, 1.0f, 1.0f);
+        }
+        
+        return colours;
+    }();
+    
+    return palette;
+}
+
 void WaveformDisplay::resized()
 {
-    // Nothing specific needed here
+    invalidateImage();
 }
 
 void WaveformDisplay::mouseDown(const juce::MouseEvent& event)
@@ -149,21 +330,18 @@ void WaveformDisplay::updatePositionFromMouse(const juce::MouseEvent& event)
     auto bounds = getLocalBounds().toFloat().reduced(4.0f, 0);
     
     double newPosition = (event.position.x - bounds.getX()) / bounds.getWidth();
-    newPosition = juce::jlimit(0.0, 1.0, newPosition);
+    newPosition = juce::jlimit(0.0, 1.0, visibleRange.getStart() + newPosition * visibleRange.getLength());
     
-    playbackPosition = newPosition;
-    repaint();
+    setPlaybackPosition(newPosition);
     
     if (onPositionChanged)
         onPositionChanged(newPosition);
 }
 
-void WaveformDisplay::timerCallback()
+void WaveformDisplay::updatePeaks()
 {
-    // Check if thumbnail has been updated
-    if (currentTrack != nullptr && currentTrack->getThumbnail() != nullptr)
-    {
-        if (currentTrack->getThumbnail()->isFullyLoaded())
-            repaint();
-    }
+    // Redraw as the background builder completes more of the waveform; a finished
+    // waveform never changes, so nothing is repainted from here after that
+    if (peaks != nullptr && peaks->getVersion() != paintedVersion)
+        invalidateImage();
 }
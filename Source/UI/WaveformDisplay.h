@@ -3,8 +3,7 @@
 #include <JuceHeader.h>
 #include "../Core/StemTrack.h"
 
-class WaveformDisplay : public juce::Component,
-                         public juce::Timer
+class WaveformDisplay : public juce::Component
 {
 public:
     WaveformDisplay();
@@ -13,26 +12,52 @@ public:
     void setTrack(StemTrack* track);
     void setPlaybackPosition(double normalizedPosition);
     void setShowSeparateChannels(bool separate);
+    
+    // Part of the song shown across the component, as normalised positions
+    void setVisibleRange(juce::Range<double> normalizedRange);
     void setDrawPlayhead(bool shouldDraw) { drawPlayhead = shouldDraw; repaint(); }
-    void setBackgroundColour(juce::Colour colour) { backgroundColour = colour; repaint(); }
-    void setWaveformColour(juce::Colour colour) { waveformColour = colour; repaint(); }
+    void setBackgroundColour(juce::Colour colour);
+    void setWaveformColour(juce::Colour colour);
+    
+    // Colours each column by its low/mid/high balance instead of the stem colour
+    void setFrequencyColours(bool shouldUseFrequencyColours);
     
     void paint(juce::Graphics& g) override;
     void resized() override;
     void mouseDown(const juce::MouseEvent& event) override;
     void mouseDrag(const juce::MouseEvent& event) override;
     
-    void timerCallback() override;
+    // Redraws if the background builder has completed more of the waveform
+    void updatePeaks();
     
     std::function<void(double)> onPositionChanged;
 
 private:
     void updatePositionFromMouse(const juce::MouseEvent& event);
+    void invalidateImage();
+    void renderWaveformImage(float scale);
+    void drawWaveform(juce::Graphics& g, juce::Rectangle<float> bounds);
+    juce::Rectangle<int> getPlayheadArea(double position) const;
+    void drawChannel(juce::Graphics& g, juce::Rectangle<float> area, int channel, float alpha) const;
+    
+    // Columns are bucketed into a fixed palette so drawing stays one fill per colour
+    static constexpr int numFrequencyColours = 16;
+    static int getFrequencyColourIndex(const WaveformPeaks::Peak& peak);
+    static const std::array<juce::Colour, numFrequencyColours>& getFrequencyPalette();
     
     StemTrack* currentTrack { nullptr };
+    std::shared_ptr<WaveformPeaks> peaks;
+    int paintedVersion { -1 };
+    
+    // Everything but the playhead, redrawn only when the waveform itself changes
+    juce::Image waveformImage;
+    float imageScale { 0.0f };
+    bool imageValid { false };
     double playbackPosition { 0.0 };
+    juce::Range<double> visibleRange { 0.0, 1.0 };
     bool showSeparateChannels { false };
     bool drawPlayhead { true };
+    bool frequencyColours { false };
     
     juce::Colour waveformColour { 0xff6ee7b7 };
     juce::Colour waveformColourRight { 0xff60a5fa };  // Blue for right channel
@@ -0,0 +1,179 @@
+#include "TestEngine.h"
+
+// MIDI parsing in MidiLearnManager, fed through StemEngine::processBlock
+class MidiLearnTests : public juce::UnitTest
+{
+public:
+    MidiLearnTests() : juce::UnitTest("MIDI parsing", "MidiLearnManager") {}
+    
+    void runTest() override
+    {
+        beginTest("A 14-bit pair applies once the LSB arrives");
+        {
+            TestEngine test;
+            start(test);
+            test.midiLearn.setMapping(MidiControlType::Stem1Volume, 7, -1, MidiSource::Controller14Bit);
+            
+            test.process(controllers({ { 7, 64 }, { 39, 0 } }));
+            expectVolume(test, 8192.0f / 16383.0f);
+            
+            // The MSB alone is held, so the value never jumps by the old fine part
+            test.process(controllers({ { 7, 100 } }));
+            expectVolume(test, 8192.0f / 16383.0f);
+            
+            test.process(controllers({ { 39, 5 } }));
+            expectVolume(test, (100.0f * 128.0f + 5.0f) / 16383.0f);
+        }
+        
+        beginTest("NRPN data entry feeds the selected parameter");
+        {
+            TestEngine test;
+            start(test);
+            test.midiLearn.setMapping(MidiControlType::Stem1Volume, 1234, -1, MidiSource::Nrpn);
+            
+            // Parameter 1234 is 9 * 128 + 82
+            test.process(controllers({ { 99, 9 }, { 98, 82 }, { 6, 64 }, { 38, 0 } }));
+            expectVolume(test, 8192.0f / 16383.0f);
+            
+            test.process(controllers({ { 6, 32 }, { 38, 16 } }));
+            expectVolume(test, (32.0f * 128.0f + 16.0f) / 16383.0f);
+            
+            // The null parameter deselects it, so data entry that follows is ignored
+            test.process(controllers({ { 99, 127 }, { 98, 127 }, { 6, 127 }, { 38, 127 } }));
+            expectVolume(test, (32.0f * 128.0f + 16.0f) / 16383.0f);
+        }
+        
+        beginTest("RPN and NRPN with the same number are told apart");
+        {
+            TestEngine test;
+            start(test);
+            test.midiLearn.setMapping(MidiControlType::Stem1Volume, 0, -1, MidiSource::Rpn);
+            
+            test.process(controllers({ { 101, 0 }, { 100, 0 }, { 6, 32 }, { 38, 0 } }));
+            expectVolume(test, 4096.0f / 16383.0f);
+            
+            test.process(controllers({ { 99, 0 }, { 98, 0 }, { 6, 127 }, { 38, 127 } }));
+            expectVolume(test, 4096.0f / 16383.0f);
+        }
+        
+        beginTest("Relative encoders step the volume");
+        {
+            TestEngine test;
+            start(test);
+            test.midiLearn.setMapping(MidiControlType::Stem1Volume, 20);
+            constexpr float step = MidiLearnManager::relativeVolumeStep;
+            
+            test.midiLearn.setValueMode(MidiControlType::Stem1Volume, MidiValueMode::RelativeTwosComplement);
+            test.process(controllers({ { 20, 118 } }));
+            expectVolume(test, 1.0f - 10.0f * step);
+            test.process(controllers({ { 20, 2 } }));
+            expectVolume(test, 1.0f - 8.0f * step);
+            
+            test.midiLearn.setValueMode(MidiControlType::Stem1Volume, MidiValueMode::RelativeSignBit);
+            test.process(controllers({ { 20, 74 } }));
+            expectVolume(test, 1.0f - 18.0f * step);
+            test.process(controllers({ { 20, 3 } }));
+            expectVolume(test, 1.0f - 15.0f * step);
+            
+            test.midiLearn.setValueMode(MidiControlType::Stem1Volume, MidiValueMode::RelativeBinaryOffset);
+            test.process(controllers({ { 20, 54 } }));
+            expectVolume(test, 1.0f - 25.0f * step);
+            test.process(controllers({ { 20, 66 } }));
+            expectVolume(test, 1.0f - 23.0f * step);
+            
+            // 64 is no movement in binary offset
+            test.process(controllers({ { 20, 64 } }));
+            expectVolume(test, 1.0f - 23.0f * step);
+        }
+        
+        beginTest("Feedback inverts the curve");
+        {
+            TestEngine test;
+            start(test);
+            test.midiLearn.setMapping(MidiControlType::Stem1Volume, 7);
+            
+            test.midiLearn.setCurve(MidiControlType::Stem1Volume, MidiCurve::Decibel);
+            test.engine.setTrackVolume(0, juce::Decibels::decibelsToGain(-60.0f * 27.0f / 127.0f));
+            expectEquals(processUntilFeedback(test, 7), 100);
+            
+            test.midiLearn.setCurve(MidiControlType::Stem1Volume, MidiCurve::Squared);
+            test.engine.setTrackVolume(0, std::pow(100.0f / 127.0f, 2.0f));
+            expectEquals(processUntilFeedback(test, 7), 100);
+        }
+        
+        beginTest("Learning a CC below 32 followed by its LSB maps the pair");
+        {
+            TestEngine test;
+            start(test);
+            
+            test.midiLearn.startLearning(MidiControlType::Stem1Volume);
+            test.process(controllers({ { 7, 10 } }, 2));
+            test.process(controllers({ { 39, 0 } }, 2));
+            juce::MessageManager::getInstance()->runDispatchLoopUntil(50);
+            
+            const auto mapping = test.midiLearn.getMapping(MidiControlType::Stem1Volume);
+            expect(!test.midiLearn.isLearning());
+            expect(mapping.source == MidiSource::Controller14Bit);
+            expectEquals(mapping.ccNumber, 7);
+            expectEquals(mapping.channel, 2);
+        }
+        
+        beginTest("Learning a CC below 32 with no LSB maps it alone");
+        {
+            TestEngine test;
+            start(test);
+            
+            test.midiLearn.startLearning(MidiControlType::Stem1Volume);
+            test.process(controllers({ { 7, 10 } }));
+            
+            // Held back for two blocks in case the LSB follows
+            for (int i = 0; i < 3; ++i)
+                test.process();
+            
+            juce::MessageManager::getInstance()->runDispatchLoopUntil(50);
+            
+            const auto mapping = test.midiLearn.getMapping(MidiControlType::Stem1Volume);
+            expect(mapping.source == MidiSource::Controller);
+            expectEquals(mapping.ccNumber, 7);
+        }
+    }
+
+private:
+    // Loads the song and renders a block, so the host's volume of 1 is applied first
+    static void start(TestEngine& test)
+    {
+        test.load();
+        test.process();
+    }
+    
+    static juce::MidiBuffer controllers(std::initializer_list<std::pair<int, int>> messages, int channel = 1)
+    {
+        juce::MidiBuffer buffer;
+        int sample = 0;
+        
+        for (const auto& [cc, value] : messages)
+            buffer.addEvent(juce::MidiMessage::controllerEvent(channel, cc, value), sample++);
+        
+        return buffer;
+    }
+    
+    void expectVolume(TestEngine& test, float volume)
+    {
+        expectWithinAbsoluteError(test.getState().volumes[0], volume, 1.0e-4f);
+    }
+    
+    // Value of the last feedback sent on a CC within a few blocks, or -1 if none was
+    static int processUntilFeedback(TestEngine& test, int cc)
+    {
+        int value = -1;
+        
+        for (int block = 0; block < 8; ++block)
+            for (const auto event : test.process(juce::MidiBuffer()))
+                if (event.getMessage().isControllerOfType(cc))
+                    value = event.getMessage().getControllerValue();
+        
+        return value;
+    }
+};
+
+static MidiLearnTests midiLearnTests;
@@ -0,0 +1,82 @@
+#include "TestEngine.h"
+
+// Playback of recorded mix automation through StemEngine::processBlock
+class MixAutomationTests : public juce::UnitTest
+{
+public:
+    MixAutomationTests() : juce::UnitTest("Mix automation", "StemEngine") {}
+    
+    void runTest() override
+    {
+        beginTest("A take plays from its first event");
+        {
+            TestEngine test;
+            test.load(makeSettings());
+            test.engine.play();
+            
+            // The first block starts on the first event; this used to re-apply it forever
+            test.process();
+            auto state = test.getState();
+            expect(state.playing);
+            expectWithinAbsoluteError(state.volumes[0], 0.5f, 1.0e-6f);
+            expect(!state.muted[0]);
+            
+            // Both events at sample 1000 land in the second block
+            test.process();
+            state = test.getState();
+            expectWithinAbsoluteError(state.volumes[0], 0.25f, 1.0e-6f);
+            expect(state.muted[0]);
+            
+            while (test.getState().positionInSamples <= 3000)
+                test.process();
+            
+            expect(!test.getState().muted[0]);
+        }
+        
+        beginTest("Seeking back restores the mix at the new position");
+        {
+            TestEngine test;
+            test.load(makeSettings());
+            test.engine.play();
+            
+            while (test.getState().positionInSamples <= 3000)
+                test.process();
+            
+            // Back onto the events at sample 1000: they count as applied there
+            test.engine.setPosition(1000.0 / TestEngine::sampleRate);
+            test.process();
+            auto state = test.getState();
+            expectWithinAbsoluteError(state.volumes[0], 0.25f, 1.0e-6f);
+            expect(state.muted[0]);
+            
+            // Back to the start replays the take from its first event
+            test.engine.setPosition(0.0);
+            test.process();
+            state = test.getState();
+            expectWithinAbsoluteError(state.volumes[0], 0.5f, 1.0e-6f);
+            expect(!state.muted[0]);
+        }
+    }
+
+private:
+    // Like a recorded take, it starts with the whole mix of the stem: volume 0.5 and
+    // unmuted from the start, 0.25 and muted at sample 1000, unmuted again at 3000
+    static StemEngine::SongSettings makeSettings()
+    {
+        auto automation = std::make_shared<MixAutomation>();
+        automation->sampleRate = TestEngine::sampleRate;
+        automation->events = { { 0, 0.5f, 0, MixAutomation::Volume },
+                               { 0, 0.0f, 0, MixAutomation::Mute },
+                               { 0, 0.0f, 0, MixAutomation::Solo },
+                               { 1000, 0.25f, 0, MixAutomation::Volume },
+                               { 1000, 1.0f, 0, MixAutomation::Mute },
+                               { 3000, 0.0f, 0, MixAutomation::Mute } };
+        automation->sort();
+        
+        StemEngine::SongSettings settings;
+        settings.automation = automation;
+        return settings;
+    }
+};
+
+static MixAutomationTests mixAutomationTests;
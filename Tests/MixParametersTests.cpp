@@ -0,0 +1,123 @@
+#include "TestEngine.h"
+
+// Host parameters and the engine's mix kept in step by MixParameters
+class MixParametersTests : public juce::UnitTest
+{
+public:
+    MixParametersTests() : juce::UnitTest("Mix parameters", "MixParameters") {}
+    
+    void runTest() override
+    {
+        beginTest("Host changes apply at the start of the next block");
+        {
+            TestEngine test;
+            test.load();
+            test.process();
+            
+            setFromHost(test, "volume1", 0.25f);
+            setFromHost(test, "mute1", 1.0f);
+            test.process();
+            
+            const auto state = test.getState();
+            expectWithinAbsoluteError(state.volumes[0], 0.25f, 1.0e-6f);
+            expect(state.muted[0]);
+        }
+        
+        beginTest("A change posted in the same block wins over the host");
+        {
+            TestEngine test;
+            test.load();
+            test.process();
+            
+            setFromHost(test, "volume1", 0.25f);
+            test.engine.setTrackVolume(0, 0.6f);
+            test.process();
+            
+            expectWithinAbsoluteError(test.getState().volumes[0], 0.6f, 1.0e-6f);
+        }
+        
+        beginTest("Engine changes are reported back to the host");
+        {
+            TestEngine test;
+            test.load();
+            test.process();
+            
+            ChangeCounter counter(test, "volume1");
+            test.engine.setTrackVolume(0, 0.3f);
+            test.process();
+            pumpTimer();
+            
+            expectWithinAbsoluteError(getValue(test, "volume1"), 0.3f, 1.0e-4f);
+            expectEquals(counter.changes, 1);
+            
+            // The report comes back to the engine as a host change that changes nothing,
+            // and nothing is reported again
+            test.process();
+            pumpTimer();
+            test.process();
+            pumpTimer();
+            
+            expectWithinAbsoluteError(test.getState().volumes[0], 0.3f, 1.0e-4f);
+            expectEquals(counter.changes, 1);
+        }
+        
+        beginTest("Host changes are not echoed back");
+        {
+            TestEngine test;
+            test.load();
+            test.process();
+            
+            ChangeCounter counter(test, "volume1");
+            setFromHost(test, "volume1", 0.25f);
+            
+            // Before the audio thread has caught up, the engine's old value must not win
+            pumpTimer();
+            expectWithinAbsoluteError(getValue(test, "volume1"), 0.25f, 1.0e-6f);
+            
+            test.process();
+            pumpTimer();
+            test.process();
+            pumpTimer();
+            
+            expectWithinAbsoluteError(getValue(test, "volume1"), 0.25f, 1.0e-6f);
+            expectEquals(counter.changes, 1);
+        }
+    }
+
+private:
+    // Counts every notification a parameter sends, as the host would see them
+    struct ChangeCounter : public juce::AudioProcessorParameter::Listener
+    {
+        ChangeCounter(TestEngine& test, const juce::String& id) : parameter(*test.parameters.getParameter(id))
+        {
+            parameter.addListener(this);
+        }
+        
+        ~ChangeCounter() override { parameter.removeListener(this); }
+        
+        void parameterValueChanged(int, float) override { ++changes; }
+        void parameterGestureChanged(int, bool) override {}
+        
+        juce::AudioProcessorParameter& parameter;
+        int changes { 0 };
+    };
+    
+    static void setFromHost(TestEngine& test, const juce::String& id, float value)
+    {
+        auto* parameter = test.parameters.getParameter(id);
+        parameter->setValueNotifyingHost(parameter->convertTo0to1(value));
+    }
+    
+    static float getValue(TestEngine& test, const juce::String& id)
+    {
+        return test.parameters.getRawParameterValue(id)->load();
+    }
+    
+    // Long enough for a few ticks of the 30 Hz timer
+    static void pumpTimer()
+    {
+        juce::MessageManager::getInstance()->runDispatchLoopUntil(150);
+    }
+};
+
+static MixParametersTests mixParametersTests;
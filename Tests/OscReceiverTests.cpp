@@ -0,0 +1,250 @@
+#include "TestEngine.h"
+#include "../Source/Core/OscReceiver.h"
+
+// OSC over a real loopback socket, into a running engine
+class OscReceiverTests : public juce::UnitTest
+{
+public:
+    OscReceiverTests() : juce::UnitTest("OSC loopback", "OscReceiver") {}
+    
+    void runTest() override
+    {
+        TestEngine test;
+        test.load();
+        
+        OscReceiver receiver(test.engine);
+        const int port = startOnFreePort(receiver);
+        
+        beginTest("Binds to a local port");
+        expect(port > 0);
+        if (port <= 0)
+            return;
+        
+        juce::DatagramSocket sender;
+        int sent = 0;
+        
+        beginTest("Every packet becomes a command");
+        {
+            AudioThread audio(test);
+            audio.startThread(juce::Thread::Priority::highest);
+            
+            // Bursts stay well inside the socket buffer, so the kernel drops nothing
+            constexpr int numBursts = 64;
+            constexpr int burstSize = 16;
+            float lastVolume = 0.0f;
+            
+            for (int burst = 0; burst < numBursts; ++burst)
+            {
+                for (int i = 0; i < burstSize; ++i)
+                {
+                    lastVolume = static_cast<float>(++sent) / (numBursts * burstSize);
+                    send(sender, port, lastVolume);
+                }
+                
+                waitUntil([&] { return receiver.getNumHandled() + receiver.getNumRejected() >= (uint64_t) sent; }, 2000);
+            }
+            
+            expectEquals((int) receiver.getNumHandled(), sent);
+            expectEquals((int) receiver.getNumRejected(), 0);
+            expect(waitUntil([&] { return test.getState().volumes[0] == lastVolume; }, 2000),
+                   "The last command never reached the mix");
+        }
+        
+        beginTest("Commands reach the mix within a few blocks");
+        {
+            AudioThread audio(test);
+            audio.startThread(juce::Thread::Priority::highest);
+            
+            constexpr int numMessages = 100;
+            double totalMs = 0.0;
+            double worstMs = 0.0;
+            
+            for (int i = 0; i < numMessages; ++i)
+            {
+                // Alternating, so every message changes the volume
+                const float volume = i % 2 == 0 ? 0.2f : 0.8f;
+                const double sendTime = juce::Time::getMillisecondCounterHiRes();
+                send(sender, port, volume);
+                ++sent;
+                
+                if (!waitUntil([&] { return test.getState().volumes[0] == volume; }, 2000))
+                {
+                    expect(false, "Message " + juce::String(i) + " never reached the mix");
+                    break;
+                }
+                
+                const double latencyMs = juce::Time::getMillisecondCounterHiRes() - sendTime;
+                totalMs += latencyMs;
+                worstMs = juce::jmax(worstMs, latencyMs);
+            }
+            
+            logMessage("Latency: " + juce::String(totalMs / numMessages, 2) + " ms on average, "
+                       + juce::String(worstMs, 2) + " ms at worst");
+            
+            // A block is about 12 ms; allow for a busy machine
+            expectLessThan(worstMs, 250.0);
+        }
+        
+        beginTest("A sustained 2000 messages a second all reach the engine");
+        {
+            AudioThread audio(test);
+            audio.startThread(juce::Thread::Priority::highest);
+            
+            // 20 messages every 10 ms for three seconds, as a fader-heavy show would send
+            constexpr int messagesPerTick = 20;
+            constexpr int tickMs = 10;
+            constexpr int numTicks = 300;
+            
+            const auto handledBefore = receiver.getNumHandled();
+            const auto rejectedBefore = receiver.getNumRejected();
+            const double startTime = juce::Time::getMillisecondCounterHiRes();
+            float lastVolume = 0.0f;
+            
+            for (int tick = 0; tick < numTicks; ++tick)
+            {
+                for (int i = 0; i < messagesPerTick; ++i)
+                {
+                    lastVolume = static_cast<float>((tick * messagesPerTick + i) % 1000) / 1000.0f;
+                    send(sender, port, lastVolume);
+                }
+                
+                sent += messagesPerTick;
+                
+                // Keeps to the schedule, so a slow tick doesn't lower the overall rate
+                const double nextTick = startTime + (tick + 1) * tickMs;
+                const double waitMs = nextTick - juce::Time::getMillisecondCounterHiRes();
+                if (waitMs > 0.0)
+                    juce::Thread::sleep(juce::roundToInt(waitMs));
+            }
+            
+            const double seconds = (juce::Time::getMillisecondCounterHiRes() - startTime) / 1000.0;
+            const int total = numTicks * messagesPerTick;
+            logMessage("Sent " + juce::String(total) + " messages at " + juce::String(total / seconds, 0) + " a second");
+            
+            waitUntil([&] { return receiver.getNumHandled() + receiver.getNumRejected() >= (uint64_t) sent; }, 2000);
+            
+            expectEquals((int) (receiver.getNumHandled() - handledBefore), total);
+            expectEquals((int) (receiver.getNumRejected() - rejectedBefore), 0);
+            expect(waitUntil([&] { return test.getState().volumes[0] == lastVolume; }, 2000),
+                   "The last command never reached the mix");
+        }
+        
+        beginTest("Non-finite and out-of-range arguments are rejected");
+        {
+            const auto rejectedBefore = receiver.getNumRejected();
+            
+            send(sender, port, std::numeric_limits<float>::quiet_NaN());
+            send(sender, port, std::numeric_limits<float>::infinity());
+            send(sender, port, 1.5f);
+            send(sender, port, -0.5f);
+            sent += 4;
+            
+            expect(waitUntil([&] { return receiver.getNumRejected() - rejectedBefore >= 4; }, 2000),
+                   "A bad argument got through");
+        }
+        
+        beginTest("A flood beyond the queue is rejected and counted");
+        {
+            // Nothing drains the queue without the audio thread
+            const auto handledBefore = receiver.getNumHandled();
+            const auto rejectedBefore = receiver.getNumRejected();
+            constexpr int floodSize = 2048;
+            
+            for (int i = 0; i < floodSize; i += 32)
+            {
+                for (int j = 0; j < 32; ++j)
+                    send(sender, port, 0.5f);
+                
+                sent += 32;
+                waitUntil([&] { return receiver.getNumHandled() + receiver.getNumRejected() >= (uint64_t) sent; }, 2000);
+            }
+            
+            const auto handled = receiver.getNumHandled() - handledBefore;
+            const auto rejected = receiver.getNumRejected() - rejectedBefore;
+            expectEquals((int) (handled + rejected), floodSize);
+            expect(handled > 0 && handled < (uint64_t) floodSize);
+            
+            // Once the audio thread runs again, the queue drains and takes commands again
+            AudioThread audio(test);
+            audio.startThread(juce::Thread::Priority::highest);
+            
+            const auto handledAfterFlood = receiver.getNumHandled();
+            waitUntil([&] { return test.getState().volumes[0] == 0.5f; }, 2000);
+            send(sender, port, 0.3f);
+            
+            expect(waitUntil([&] { return receiver.getNumHandled() > handledAfterFlood
+                                          && test.getState().volumes[0] == 0.3f; }, 2000),
+                   "The engine didn't recover from the flood");
+        }
+        
+        receiver.stop();
+    }
+
+private:
+    // Renders blocks at the pace of a real device
+    struct AudioThread : public juce::Thread
+    {
+        explicit AudioThread(TestEngine& t) : juce::Thread("Audio"), test(t) {}
+        ~AudioThread() override { stopThread(1000); }
+        
+        void run() override
+        {
+            const int blockMs = juce::roundToInt(1000.0 * TestEngine::blockSize / TestEngine::sampleRate);
+            
+            while (!threadShouldExit())
+            {
+                test.process();
+                wait(blockMs);
+            }
+        }
+        
+        TestEngine& test;
+    };
+    
+    static int startOnFreePort(OscReceiver& receiver)
+    {
+        for (int port = 39000; port < 39100; ++port)
+            if (receiver.start(port))
+                return port;
+        
+        return -1;
+    }
+    
+    // "/stem/1/volume" with one float argument
+    static void send(juce::DatagramSocket& socket, int port, float volume)
+    {
+        juce::MemoryOutputStream message;
+        
+        auto writePadded = [&](const char* text) {
+            const size_t length = std::strlen(text) + 1;
+            message.write(text, length);
+            
+            for (size_t i = length; i % 4 != 0; ++i)
+                message.writeByte(0);
+        };
+        
+        writePadded("/stem/1/volume");
+        writePadded(",f");
+        message.writeFloatBigEndian(volume);
+        
+        socket.write("127.0.0.1", port, message.getData(), static_cast<int>(message.getDataSize()));
+    }
+    
+    template <typename Condition>
+    static bool waitUntil(Condition condition, int timeoutMs)
+    {
+        const auto end = juce::Time::getMillisecondCounter() + (juce::uint32) timeoutMs;
+        
+        while (!condition())
+        {
+            if (juce::Time::getMillisecondCounter() > end)
+                return false;
+            
+            juce::Thread::sleep(1);
+        }
+        
+        return true;
+    }
+};
+
+static OscReceiverTests oscReceiverTests;
@@ -0,0 +1,117 @@
+#pragma once
+
+#include <JuceHeader.h>
+#include "../Source/Core/StemEngine.h"
+#include "../Source/Core/MidiLearnManager.h"
+#include "../Source/Core/MixParameters.h"
+
+// A StemEngine with everything processBlock needs, playing a generated one-stem song
+// from a temporary folder. Blocks are rendered by calling process() from the test, or
+// from a thread standing in for the audio device.
+class TestEngine
+{
+public:
+    static constexpr double sampleRate = 44100.0;
+    static constexpr int blockSize = 512;
+    
+    explicit TestEngine(double songSeconds = 2.0)
+    {
+        folder.createDirectory();
+        
+        song.songName = "Test Song";
+        song.stemFiles[0] = folder.getChildFile("Test Song - Vocals.wav");
+        song.stemFound[0] = true;
+        writeStem(song.stemFiles[0], static_cast<int>(songSeconds * sampleRate));
+        
+        engine.prepareToPlay(sampleRate, blockSize);
+    }
+    
+    ~TestEngine()
+    {
+        engine.unloadSong();
+        folder.deleteRecursively();
+    }
+    
+    void load(const StemEngine::SongSettings& settings = {})
+    {
+        engine.loadSong(song, 0, settings);
+    }
+    
+    // Renders one block as the audio thread would
+    void process()
+    {
+        process(juce::MidiBuffer());
+    }
+    
+    // Same, with MIDI coming in; returns the feedback the engine sent back
+    const juce::MidiBuffer& process(const juce::MidiBuffer& input)
+    {
+        buffer.clear();
+        midi = input;
+        engine.processBlock(buffer, midi, midiLearn, mixParameters);
+        return midi;
+    }
+    
+    StemEngine::State getState()
+    {
+        StemEngine::State state;
+        engine.getState(state);
+        return state;
+    }
+    
+    StemEngine engine;
+
+private:
+    // Just enough of a processor to own the host parameters MixParameters reads
+    struct Processor : public juce::AudioProcessor
+    {
+        const juce::String getName() const override { return "Test"; }
+        void prepareToPlay(double, int) override {}
+        void releaseResources() override {}
+        void processBlock(juce::AudioBuffer<float>&, juce::MidiBuffer&) override {}
+        double getTailLengthSeconds() const override { return 0.0; }
+        bool acceptsMidi() const override { return true; }
+        bool producesMidi() const override { return true; }
+        juce::AudioProcessorEditor* createEditor() override { return nullptr; }
+        bool hasEditor() const override { return false; }
+        int getNumPrograms() override { return 1; }
+        int getCurrentProgram() override { return 0; }
+        void setCurrentProgram(int) override {}
+        const juce::String getProgramName(int) override { return {}; }
+        void changeProgramName(int, const juce::String&) override {}
+        void getStateInformation(juce::MemoryBlock&) override {}
+        void setStateInformation(const void*, int) override {}
+    };
+    
+    // Stereo 16-bit noise, so the stem is never silent
+    static void writeStem(const juce::File& file, int numFrames)
+    {
+        juce::AudioBuffer<float> samples(2, numFrames);
+        juce::Random random(1);
+        
+        for (int ch = 0; ch < samples.getNumChannels(); ++ch)
+            for (int i = 0; i < numFrames; ++i)
+                samples.setSample(ch, i, random.nextFloat() - 0.5f);
+        
+        juce::WavAudioFormat wav;
+        std::unique_ptr<juce::AudioFormatWriter> writer(wav.createWriterFor(new juce::FileOutputStream(file),
+                                                                            sampleRate, 2, 16, {}, 0));
+        jassert(writer != nullptr);
+        writer->writeFromAudioSampleBuffer(samples, 0, numFrames);
+    }
+    
+    juce::File folder { juce::File::getSpecialLocation(juce::File::tempDirectory)
+                            .getNonexistentChildFile("StemPlayerTests", "") };
+    DetectedSong song;
+    
+    Processor processor;
+
+public:
+    juce::AudioProcessorValueTreeState parameters { processor, nullptr, "Parameters", MixParameters::createLayout() };
+    MixParameters mixParameters { parameters };
+    MidiLearnManager midiLearn;
+
+private:
+    juce::AudioBuffer<float> buffer { 2, blockSize };
+    juce::MidiBuffer midi;
+};
@@ -0,0 +1,19 @@
+#include <JuceHeader.h>
+
+// Runs every juce::UnitTest linked in and fails if any expectation did
+int main()
+{
+    // MixParameters, MIDI learn and the OSC receiver need a message manager; tests that
+    // need its callbacks pump the loop themselves
+    juce::ScopedJuceInitialiser_GUI juceInitialiser;
+    
+    juce::UnitTestRunner runner;
+    runner.setAssertOnFailure(false);
+    runner.runAllTests();
+    
+    int failures = 0;
+    for (int i = 0; i < runner.getNumResults(); ++i)
+        failures += runner.getResult(i)->failures;
+    
+    return failures > 0 ? 1 : 0;
+}